@@ -0,0 +1,123 @@
+/**
+ * @file net_client.h
+ * @brief Defines the asynchronous client library (libnetclient) with pipelining and connection pooling.
+ *
+ * A NetClient owns a pool of non-blocking connections to one endpoint. Requests are
+ * serialized into per-connection output buffers, written in batches by net_client_flush,
+ * and matched back to their callbacks by sequence number. A NetClient is not thread-safe;
+ * use one instance per thread.
+ */
+#ifndef NET_CLIENT_H
+#define NET_CLIENT_H
+
+#include <stdint.h>
+#include "protocol/protocol.h"
+
+#define NET_CLIENT_MAX_IN_FLIGHT 4096
+
+/**
+ * @brief Completion callback.
+ *
+ * @param user_data The pointer given at submission.
+ * @param status 0 on success, -1 if the connection failed before a response arrived or the
+ * response failed its checksum.
+ * @param header Response header (NULL on failure).
+ * @param payload Response payload, valid only for the duration of the callback.
+ */
+typedef void (*net_client_callback_t)(void* user_data, int status, const PacketHeader* header, const uint8_t* payload);
+
+/**
+ * @brief Opaque handle to a connection pool for one endpoint.
+ */
+typedef struct NetClient NetClient;
+
+/**
+ * @brief Creates a pool and starts non-blocking connects.
+ *
+ * @param endpoint "host:port" for TCP or "unix:/path" for a Unix domain socket.
+ * @param pool_size Number of connections to keep open.
+ * @return The client, or NULL if the endpoint cannot be resolved.
+ */
+NetClient* net_client_create(const char* endpoint, uint32_t pool_size);
+
+/**
+ * @brief Queues a request on the least loaded connection. Nothing is written until a flush or poll.
+ * Requests must carry a payload; apart from HEARTBEAT, header-only frames are not answered by the server.
+ *
+ * @return 0 on success, -1 if no connection can accept another in-flight request.
+ */
+int net_client_submit(NetClient* client, uint16_t type, const uint8_t* payload, uint32_t payload_len,
+    net_client_callback_t callback, void* user_data);
+
+/**
+ * @brief Writes queued requests, one send per connection, without blocking.
+ *
+ * @return 0 on success, -1 if every connection has failed.
+ */
+int net_client_flush(NetClient* client);
+
+/**
+ * @brief Flushes, waits up to timeout_ms for I/O and runs the callbacks of completed requests.
+ * Callbacks may submit new requests but must not call net_client_poll.
+ *
+ * @return Number of completions (including failures), or -1 on error.
+ */
+int net_client_poll(NetClient* client, int timeout_ms);
+
+/**
+ * @brief Polls until every submitted request has completed.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int net_client_wait_all(NetClient* client);
+
+/**
+ * @brief Blocking request/response helper built on the asynchronous API.
+ *
+ * @param resp_header Receives the response header.
+ * @param resp_payload Buffer for the response payload (truncated to resp_capacity).
+ * @param resp_len Receives the number of payload bytes copied.
+ * @return 0 on success, -1 on failure.
+ */
+int net_client_call(NetClient* client, uint16_t type, const uint8_t* payload, uint32_t payload_len,
+    PacketHeader* resp_header, uint8_t* resp_payload, uint32_t resp_capacity, uint32_t* resp_len);
+
+/**
+ * @brief Installs a handler for frames that match no pending request (e.g. pub/sub pushes).
+ */
+void net_client_set_push_handler(NetClient* client, net_client_callback_t handler, void* user_data);
+
+/**
+ * @brief Sends subsequent requests as version 2 frames carrying a CRC32C trailer.
+ *
+ * The server answers checksummed requests with checksummed responses, which are verified
+ * before their callback runs. Payloads are limited to MAX_PAYLOAD_SIZE - PACKET_CRC32C_SIZE.
+ */
+void net_client_set_checksum(NetClient* client, int enabled);
+
+/**
+ * @brief Negotiates PROTOCOL_FEATURE_COMPRESSION on every connection, now and after each
+ * reconnect. Once a connection is granted it, request payloads of at least threshold bytes
+ * go out compressed whenever that makes them smaller. 0 turns compression off.
+ *
+ * Compressed responses are inflated before their callback runs. The negotiation is an ordinary
+ * request on each connection, so it briefly counts toward net_client_in_flight.
+ */
+void net_client_set_compression(NetClient* client, uint32_t threshold);
+
+/**
+ * @brief Reports the bytes written to and read from the sockets so far, headers and trailers included.
+ */
+void net_client_wire_bytes(const NetClient* client, uint64_t* sent, uint64_t* received);
+
+/**
+ * @brief Returns the number of requests submitted but not yet completed.
+ */
+uint32_t net_client_in_flight(const NetClient* client);
+
+/**
+ * @brief Fails every pending request, closes all connections and frees the pool.
+ */
+void net_client_destroy(NetClient* client);
+
+#endif
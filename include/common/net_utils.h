@@ -5,6 +5,10 @@
 #ifndef NET_UTILS_H
 #define NET_UTILS_H
 
+#include <sys/types.h>
+
+#define NET_MAX_PASSED_FDS 16
+
  /**
   * @brief Prints an error message and terminates the program with EXIT_FAILURE.
   *
@@ -20,4 +24,54 @@ void die_with_error(const char* error_message);
  */
 int setup_tcp_server_socket(const char* service);
 
+/**
+ * @brief Initializes a UDP server socket bound to the specified service port.
+ *
+ * @param service The port number or service name to bind to.
+ * @return The file descriptor of the bound datagram socket.
+ */
+int setup_udp_server_socket(const char* service);
+
+/**
+ * @brief Initializes a Unix domain stream socket listening on the given filesystem path.
+ * Any stale socket file at the path is removed first.
+ *
+ * @param path The filesystem path of the socket.
+ * @return The file descriptor of the listening socket.
+ */
+int setup_unix_server_socket(const char* path);
+
+/**
+ * @brief Initializes a Unix domain SOCK_SEQPACKET listener, which preserves message boundaries.
+ * Any stale socket file at the path is removed first.
+ *
+ * @param path The filesystem path of the socket.
+ * @return The file descriptor of the listening socket.
+ */
+int setup_unix_seqpacket_socket(const char* path);
+
+/**
+ * @brief Sends a buffer together with file descriptors over a Unix domain socket (SCM_RIGHTS).
+ *
+ * @param sock The connected Unix domain socket.
+ * @param data The bytes to send alongside the descriptors (must be non-empty).
+ * @param len Number of bytes to send.
+ * @param fds Descriptors to pass to the peer.
+ * @param fd_count Number of descriptors, at most NET_MAX_PASSED_FDS.
+ * @return Bytes sent, or -1 on error.
+ */
+ssize_t send_with_fds(int sock, const void* data, size_t len, const int* fds, int fd_count);
+
+/**
+ * @brief Receives a buffer and any file descriptors passed with it (SCM_RIGHTS).
+ *
+ * @param sock The connected Unix domain socket.
+ * @param data Destination buffer.
+ * @param len Capacity of the destination buffer.
+ * @param fds Receives the passed descriptors.
+ * @param fd_count In: capacity of fds. Out: number of descriptors received.
+ * @return Bytes received, 0 on orderly shutdown, or -1 on error.
+ */
+ssize_t recv_with_fds(int sock, void* data, size_t len, int* fds, int* fd_count);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+/**
+ * @file shm_channel.h
+ * @brief Defines the memfd-backed shared-memory channel carrying protocol frames between co-located processes.
+ *
+ * A channel is one mapping holding two single-producer/single-consumer byte rings:
+ * requests (client -> server) and responses (server -> client). Each direction has an
+ * eventfd doorbell that the producer only rings when the consumer announced it is asleep.
+ */
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "protocol/protocol.h"
+
+#define SHM_CHANNEL_MAGIC 0x53484D31
+#define SHM_RING_CAPACITY (1u << 20)
+#define SHM_RING_CORRUPT UINT32_MAX
+
+/**
+ * @brief Shared ring control block. Producer and consumer indices live on separate cache lines.
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) _Atomic uint32_t consumer_sleeping;
+    _Alignas(64) uint8_t data[];
+} ShmRingControl;
+
+/**
+ * @brief Process-local ring handle. The capacity is kept outside shared memory so a
+ * misbehaving peer cannot redirect the index mask.
+ */
+typedef struct {
+    ShmRingControl* control;
+    uint32_t capacity;
+} ShmRing;
+
+/**
+ * @brief Local view of a mapped channel plus its doorbells.
+ */
+typedef struct {
+    void* base;
+    size_t size;
+    int memfd;
+    ShmRing requests;
+    ShmRing responses;
+    int server_doorbell;
+    int client_doorbell;
+} ShmChannel;
+
+/**
+ * @brief Creates the memfd, both rings and both eventfd doorbells (server side).
+ *
+ * @param channel Channel to initialize.
+ * @param ring_capacity Bytes per ring; must be a power of two.
+ * @return 0 on success, -1 on failure.
+ */
+int shm_channel_create(ShmChannel* channel, uint32_t ring_capacity);
+
+/**
+ * @brief Maps a channel received from the server (client side). Takes ownership of the descriptors.
+ *
+ * @return 0 on success, -1 if the mapping is invalid.
+ */
+int shm_channel_attach(ShmChannel* channel, int memfd, int server_doorbell, int client_doorbell);
+
+/**
+ * @brief Unmaps the channel and closes every descriptor it owns.
+ */
+void shm_channel_destroy(ShmChannel* channel);
+
+/**
+ * @brief Serializes a frame straight into the ring.
+ *
+ * @return 0 on success, -1 if there is not enough free space.
+ */
+int shm_ring_write(ShmRing* ring, const PacketHeader* header, const uint8_t* payload);
+
+/**
+ * @brief Copies the next frame (header and payload) out of the ring.
+ *
+ * @return Frame length, 0 if the ring is empty, or SHM_RING_CORRUPT on a malformed frame.
+ */
+uint32_t shm_ring_read(ShmRing* ring, uint8_t* out, uint32_t capacity);
+
+/**
+ * @brief Returns the number of bytes the producer can still write.
+ */
+uint32_t shm_ring_free_space(ShmRing* ring);
+
+/**
+ * @brief Returns non-zero if the ring holds at least one unread byte.
+ */
+int shm_ring_has_data(ShmRing* ring);
+
+/**
+ * @brief Producer side: returns non-zero if the consumer is asleep and must be woken.
+ */
+int shm_ring_needs_doorbell(ShmRing* ring);
+
+/**
+ * @brief Consumer side: announces sleep, then re-checks the ring to avoid a lost wakeup.
+ *
+ * @return 1 if the consumer may block on its doorbell, 0 if data arrived meanwhile.
+ */
+int shm_ring_prepare_sleep(ShmRing* ring);
+
+/**
+ * @brief Consumer side: withdraws the sleep announcement.
+ */
+void shm_ring_clear_sleep(ShmRing* ring);
+
+/**
+ * @brief Wakes the peer blocked on an eventfd doorbell.
+ */
+void shm_doorbell_ring(int doorbell_fd);
+
+/**
+ * @brief Consumes pending doorbell wakeups; blocks only if the eventfd is in blocking mode.
+ */
+void shm_doorbell_drain(int doorbell_fd);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * @file crc32c.h
+ * @brief Defines the CRC32C (Castagnoli) checksum used by integrity-protected frames.
+ *
+ * On x86-64 processors with SSE4.2 the checksum runs on the crc32 instruction, with three
+ * independent streams interleaved over large buffers to hide its latency. Elsewhere it falls
+ * back to slicing-by-8 tables. Both produce identical results.
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Extends a CRC32C over length bytes. Pass 0 to start a new checksum.
+ *
+ * Chaining is equivalent to one call over the concatenated data, so a checksum can be
+ * accumulated across partial reads.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+/**
+ * @brief Table-driven implementation, exposed so the hardware path can be measured against it.
+ */
+uint32_t crc32c_portable(uint32_t crc, const void* data, size_t length);
+
+/**
+ * @brief Returns non-zero if crc32c runs on the SSE4.2 crc32 instruction.
+ */
+int crc32c_accelerated(void);
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file lz.h
+ * @brief Defines the byte-oriented LZ77 codec used by compressed frames.
+ *
+ * The block format follows LZ4's: a sequence is a token byte whose high nibble counts literals
+ * and low nibble counts match bytes beyond the 4-byte minimum, with 15 meaning further length
+ * bytes follow (each 255 continues the run), then the literals, then a 2-byte little-endian
+ * match offset. The last sequence carries literals only. Matches are found through a single
+ * hash table probe per position and no entropy coding is done, so compression runs at a few
+ * hundred MB/s and decompression is little more than memcpy.
+ *
+ * The decoder checks every length and offset against both buffers, so malformed input from
+ * the network fails cleanly instead of reading or writing out of bounds.
+ */
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+
+// Largest input one block may hold; match offsets are 16 bits
+#define LZ_MAX_INPUT 65535
+
+// Below this, payloads rarely shrink by more than the compressed-payload prefix costs
+#define LZ_DEFAULT_THRESHOLD 128
+
+/**
+ * @brief Compresses length bytes into one block.
+ *
+ * @param capacity Output space; pass less than length to accept only a block that saves bytes.
+ * @return Block size, or 0 if it would not fit in capacity or length exceeds LZ_MAX_INPUT.
+ */
+uint32_t lz_compress(const uint8_t* input, uint32_t length, uint8_t* output, uint32_t capacity);
+
+/**
+ * @brief Decompresses one block.
+ *
+ * @return Decompressed size, or -1 if the block is malformed or does not fit in capacity.
+ */
+int32_t lz_decompress(const uint8_t* input, uint32_t length, uint8_t* output, uint32_t capacity);
+
+/**
+ * @brief Encodes a frame payload as [uint16 original length (network order)][block].
+ *
+ * @return Encoded size, or 0 unless it is smaller than payload_len and fits in capacity.
+ */
+uint32_t lz_compress_payload(const uint8_t* payload, uint32_t payload_len, uint8_t* output, uint32_t capacity);
+
+/**
+ * @brief Decodes a payload written by lz_compress_payload.
+ *
+ * @return Original payload size, or -1 if the encoding is malformed, does not fit in capacity
+ * or does not decode to exactly its announced length.
+ */
+int32_t lz_decompress_payload(const uint8_t* encoded, uint32_t encoded_len, uint8_t* output, uint32_t capacity);
+
+#endif
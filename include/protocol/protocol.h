@@ -8,8 +8,24 @@
 #include <stdint.h>
 
 #define PROTOCOL_VERSION_1 0x0001
+#define PROTOCOL_VERSION_2 0x0002
 #define MAX_PAYLOAD_SIZE 1024
 
+/*
+ * Version 2 frames carry flags in the upper byte of the type field; version 1 frames never do.
+ *  - CRC32C: the payload ends in a 4-byte CRC32C (network order) of the bytes before it. The
+ *    trailer counts toward payload_length, so frames stay self-delimiting for any parser, and
+ *    responses to a checksummed request are checksummed the same way.
+ *  - COMPRESSED: the payload is [uint16 original length (network order)][LZ block] (see lz.h).
+ *    Only valid on a connection that negotiated PROTOCOL_FEATURE_COMPRESSION, and never longer
+ *    than MAX_PAYLOAD_SIZE once decompressed. A CRC32C trailer covers the compressed bytes.
+ */
+#define PACKET_TYPE_MASK 0x00FF
+#define PACKET_FLAG_CRC32C 0x0100
+#define PACKET_FLAG_COMPRESSED 0x0200
+#define PACKET_CRC32C_SIZE 4
+#define PACKET_COMPRESSED_PREFIX_SIZE 2
+
  /**
   * @enum PacketType
   * @brief Enumeration of available packet types for the network protocol.
@@ -18,9 +34,67 @@ typedef enum {
     PACKET_TYPE_HEARTBEAT = 0x01,
     PACKET_TYPE_DATA = 0x02,
     PACKET_TYPE_ACK = 0x03,
+    PACKET_TYPE_KV_GET = 0x10,
+    PACKET_TYPE_KV_SET = 0x11,
+    PACKET_TYPE_KV_DEL = 0x12,
+    PACKET_TYPE_SUBSCRIBE = 0x20,
+    PACKET_TYPE_UNSUBSCRIBE = 0x21,
+    PACKET_TYPE_PUBLISH = 0x22,
+    PACKET_TYPE_BATCH = 0x30,
+    PACKET_TYPE_SHM_ATTACH = 0x40,
+    PACKET_TYPE_FEATURES = 0x41,
     PACKET_TYPE_ERROR = 0xFF
 } PacketType;
 
+/**
+ * @enum KvStatus
+ * @brief First payload byte of every KV response.
+ *
+ * Request layouts:
+ *  - KV_GET / KV_DEL: payload is the raw key.
+ *  - KV_SET: [uint16 key_length (network order)][key][value].
+ * Response layout: [status][value] where value is only present for a GET hit.
+ */
+typedef enum {
+    KV_STATUS_OK = 0x00,
+    KV_STATUS_NOT_FOUND = 0x01,
+    KV_STATUS_ERROR = 0x02
+} KvStatus;
+
+#define KV_KEY_LENGTH_SIZE 2
+#define KV_STATUS_SIZE 1
+
+/*
+ * Pub/sub layouts:
+ *  - SUBSCRIBE / UNSUBSCRIBE: payload is the raw topic, answered with an empty ACK or ERROR.
+ *  - PUBLISH: [uint16 topic_length (network order)][topic][message], answered with an ACK
+ *    carrying the uint32 receiver count. Subscribers receive the identical PUBLISH frame.
+ */
+#define PUBSUB_TOPIC_LENGTH_SIZE 2
+#define PUBSUB_MAX_TOPIC_LENGTH 128
+
+/*
+ * Datagram framing: each datagram carries exactly one frame, or one BATCH frame whose
+ * payload is a back-to-back sequence of complete frames. Responses to a BATCH come back
+ * as a single BATCH datagram echoing the envelope's sequence number.
+ */
+#define UDP_MAX_DATAGRAM_SIZE 65507
+
+/*
+ * Shared-memory negotiation: a header-only SHM_ATTACH frame sent over a Unix domain
+ * connection is answered with an ACK carrying the uint32 ring capacity, plus the memfd,
+ * the server doorbell and the client doorbell passed via SCM_RIGHTS in that order.
+ */
+#define SHM_ATTACH_FD_COUNT 3
+
+/*
+ * Feature negotiation: a FEATURES frame carries the uint32 PROTOCOL_FEATURE_* bits the sender
+ * wants (network order) and is answered with an ACK carrying the bits the server grants. The
+ * grant replaces any earlier one and holds until the connection closes. Either side compresses
+ * only payloads it finds worth it, so a granted peer still sends and receives plain frames.
+ */
+#define PROTOCOL_FEATURE_COMPRESSION 0x00000001
+
 /**
  * @struct PacketHeader
  * @brief Header for all protocol packets. Packed to prevent compiler padding.
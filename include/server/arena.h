@@ -0,0 +1,107 @@
+/**
+ * @file arena.h
+ * @brief Defines the prefaulted memory arena that backs the server's packet buffers and queues.
+ *
+ * The arena is one anonymous mapping made at startup. It is backed by explicit huge pages when
+ * the system has them reserved, otherwise it asks for transparent huge pages, and either way
+ * every page is faulted in before the first connection is accepted. Buffers handed out later
+ * therefore never fault and share a handful of TLB entries.
+ *
+ * Memory is handed out in two ways: long-lived structures reserve a slice once, and buffers
+ * that cycle per request come from fixed-size block pools carved out of it. Nothing is ever
+ * returned to the arena; when it or a pool runs out, callers fall back to the allocator.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_DEFAULT_MB 8
+#define ARENA_HUGE_PAGE_SIZE (2u * 1024 * 1024)
+#define ARENA_ALIGNMENT 64
+#define ARENA_MAX_POOLS 8
+
+/**
+ * @brief What the arena's pages turned out to be.
+ */
+typedef enum {
+    ARENA_BACKING_NONE,         // No arena; everything comes from the allocator
+    ARENA_BACKING_HUGETLB,      // Explicit huge pages from the reserved pool
+    ARENA_BACKING_THP,          // Transparent huge pages requested with MADV_HUGEPAGE
+    ARENA_BACKING_SMALL_PAGES   // Base pages, still prefaulted
+} ArenaBacking;
+
+/**
+ * @brief Fixed-size blocks carved from the arena, shared by every thread.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    void* free_list;
+    const char* name;
+    size_t block_size;
+    uint32_t blocks;
+    uint32_t available;
+    uint32_t low_water;         // Fewest blocks ever left, so pools can be sized from real load
+    uint64_t misses;            // Requests that found the pool empty and went to the allocator
+} ArenaPool;
+
+/**
+ * @brief Maps and prefaults the arena. Call once, before any thread that uses it starts.
+ *
+ * @param bytes Arena size, rounded up to a huge page; 0 leaves the arena disabled.
+ * @return 0 on success or when disabled, -1 if no mapping could be made (the server still runs).
+ */
+int arena_init(size_t bytes);
+
+/**
+ * @brief Returns how the arena is backed.
+ */
+ArenaBacking arena_backing(void);
+
+/**
+ * @brief Returns a human-readable name for a backing.
+ */
+const char* arena_backing_name(ArenaBacking backing);
+
+/**
+ * @brief Reserves a slice for the life of the process. Not thread-safe; call during startup.
+ *
+ * @return The slice, aligned to ARENA_ALIGNMENT, or NULL if the arena is disabled or exhausted.
+ */
+void* arena_reserve(size_t bytes);
+
+/**
+ * @brief Returns non-zero if the pointer lies inside the arena, i.e. must not be passed to free().
+ */
+int arena_contains(const void* pointer);
+
+/**
+ * @brief Carves up to count blocks of block_size bytes out of the arena. Call during startup.
+ *
+ * @return The number of blocks carved; 0 leaves the pool empty and every get misses.
+ */
+uint32_t arena_pool_init(ArenaPool* pool, const char* name, size_t block_size, uint32_t count);
+
+/**
+ * @brief Takes a block, or returns NULL when the pool is empty.
+ */
+void* arena_pool_get(ArenaPool* pool);
+
+/**
+ * @brief Returns a block taken from this pool.
+ */
+void arena_pool_put(ArenaPool* pool, void* block);
+
+/**
+ * @brief Logs the arena's size and backing and each pool's usage.
+ */
+void arena_log_stats(void);
+
+/**
+ * @brief Unmaps the arena. Nothing carved from it may be used afterwards.
+ */
+void arena_shutdown(void);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file capture.h
+ * @brief Defines the traffic capture file and the recorder that appends received frames to it.
+ *
+ * The reactor copies every completed stream frame, exactly as it arrived, into an in-memory
+ * batch. A writer thread appends full batches to a memory-mapped file that grows in large
+ * steps, so the reactor never touches the file, faults in pages or waits on the disk. If the
+ * writer falls behind, frames are dropped and counted rather than stalling the reactor.
+ *
+ * File layout, in host byte order: one CaptureFileHeader, then back-to-back records, each a
+ * CaptureRecord followed by frame_length bytes of wire frame padded to CAPTURE_ALIGNMENT.
+ * Only the first data_bytes after the header are valid; the rest of the file is preallocated.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC 0x50414343u  // "CCAP"
+#define CAPTURE_FORMAT_VERSION 1
+#define CAPTURE_ALIGNMENT 8
+
+// Reactor-side staging: batch size and how many may wait for the writer before frames drop
+#define CAPTURE_BATCH_BYTES (256 * 1024)
+#define CAPTURE_MAX_BATCHES 16
+
+// A partly filled batch is handed to the writer after this long
+#define CAPTURE_FLUSH_INTERVAL_MS 100
+
+// The file and its mapping grow by this much at a time
+#define CAPTURE_GROW_BYTES (64UL << 20)
+
+/**
+ * @brief Leading block of a capture file. Counters are updated after each batch is appended,
+ * so a file copied while the server runs is still consistent up to data_bytes.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_realtime_ns;  // Wall clock when the capture began
+    uint64_t data_bytes;         // Valid record bytes following this header
+    uint64_t record_count;
+    uint64_t dropped_records;    // Frames lost because the writer fell behind
+    uint8_t reserved[24];
+} CaptureFileHeader;
+
+/**
+ * @brief Per-frame record header.
+ */
+typedef struct {
+    uint64_t timestamp_ns;       // Arrival time relative to the start of the capture
+    uint64_t connection;         // Connection handle, unique per connection for the life of the server
+    uint32_t frame_length;       // Wire header plus payload, including any trailer
+    uint32_t reserved;
+} CaptureRecord;
+
+_Static_assert(sizeof(CaptureFileHeader) == 64, "CaptureFileHeader layout is part of the file format");
+_Static_assert(sizeof(CaptureRecord) == 24, "CaptureRecord layout is part of the file format");
+
+/**
+ * @brief Size of a record including its frame and padding.
+ */
+static inline uint64_t capture_record_size(uint32_t frame_length) {
+    return (sizeof(CaptureRecord) + (uint64_t)frame_length + CAPTURE_ALIGNMENT - 1) & ~(uint64_t)(CAPTURE_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Creates (or truncates) the capture file and starts the writer thread.
+ *
+ * @return 0 on success, -1 if the file cannot be created or mapped.
+ */
+int capture_open(const char* path);
+
+/**
+ * @brief Stages one received frame. Reactor thread only; a no-op while capture is closed.
+ *
+ * @param header The serialized 12-byte header as received.
+ * @param payload The payload as received, NULL if payload_len is 0.
+ */
+void capture_frame(uint64_t connection, const uint8_t* header, const uint8_t* payload, uint32_t payload_len);
+
+/**
+ * @brief Hands the staged batch to the writer once it is CAPTURE_FLUSH_INTERVAL_MS old.
+ *
+ * @return Milliseconds the reactor may sleep before calling again, -1 if nothing is staged.
+ */
+int capture_poll(void);
+
+/**
+ * @brief Writes out everything staged, trims the file to its valid length and stops the writer.
+ */
+void capture_close(void);
+
+#endif
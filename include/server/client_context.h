@@ -19,25 +19,71 @@ typedef enum {
 } ClientState;
 
 /**
- * @brief Holds the state and buffers for a specific client connection.
+ * @brief Identifies the listener a stream connection was accepted on.
  */
-typedef struct {
+typedef enum {
+    TRANSPORT_TCP,
+    TRANSPORT_UNIX
+} TransportKind;
+
+struct ShmSession;
+
+// ClientContext.flags
+#define CLIENT_FLAG_ZEROCOPY 0x01   // SO_ZEROCOPY is enabled and the transmit counter starts at 0
+#define CLIENT_FLAG_READY 0x02      // Queued on the reactor's ready list with input left unread
+#define CLIENT_FLAG_UPSTREAM 0x04   // Connection to a backend, owned by the forwarding module
+#define CLIENT_FLAG_PARKED 0x08     // Out of tokens; the reactor resumes reading once they refill
+#define CLIENT_FLAG_REJECTED 0x10   // The frame being read is over its limit and is answered with ERROR
+#define CLIENT_FLAG_COMPRESS 0x20   // Peer negotiated PROTOCOL_FEATURE_COMPRESSION
+
+// Idle pending-payload buffers kept for reuse; beyond this they go back to the allocator
+#define PENDING_PAYLOAD_POOL_RETAIN 256
+
+/**
+ * @brief Cold receive state for a frame whose payload has only partially arrived.
+ *
+ * Borrowed from a shared pool when the first payload bytes cannot complete the frame and
+ * returned as soon as it completes, so idle connections and frames that arrive in one read
+ * never hold one.
+ */
+typedef struct PendingPayload {
+    uint32_t bytes_read;
+    struct PendingPayload* next_free;
+    uint8_t data[MAX_PAYLOAD_SIZE];
+} PendingPayload;
+
+/**
+ * @brief Hot per-connection state, kept within one cache line.
+ *
+ * The frame's type, sequence number and payload length are not duplicated here: they are
+ * decoded from header_buffer, which stays intact until the frame has been submitted.
+ */
+typedef struct ClientContext {
     int fd;
-    ClientState state;
+    uint8_t state;              // ClientState
+    uint8_t transport;          // TransportKind
+    uint8_t header_bytes_read;
 
     // Buffer size must match PacketHeader size (12 bytes)
     uint8_t header_buffer[sizeof(PacketHeader)];
-    size_t header_bytes_read;
+    uint8_t flags;              // CLIENT_FLAG_*
+    uint32_t trace_id;          // Non-zero while the current request is sampled for tracing
+    uint32_t slot;              // Index in the connection table, fixed for the life of the process
 
-    uint8_t* payload_buffer;
-    uint32_t expected_payload_length;
-    size_t payload_bytes_read;
+    PendingPayload* pending;
 
-    uint16_t message_type;
+    // Shared-memory session negotiated over this Unix connection, if any
+    struct ShmSession* shm_session;
+
+    // Reactor-owned list of live stream connections, walked during a hot-restart handoff
+    struct ClientContext* prev;
+    struct ClientContext* next;
 } ClientContext;
 
+_Static_assert(sizeof(ClientContext) <= 64, "ClientContext must fit in one cache line");
+
 /**
- * @brief Initializes a new client context.
+ * @brief Initializes a client context; the connection table uses it when a slot is opened.
  *
  * @param ctx Pointer to the context to initialize.
  * @param fd The file descriptor associated with the client.
@@ -45,17 +91,44 @@ typedef struct {
 void init_client_context(ClientContext* ctx, int fd);
 
 /**
- * @brief Resets the client context for the next message, freeing payload memory.
+ * @brief Attaches a pending-payload buffer from the shared pool if none is attached.
+ * The pool is reactor-thread only.
  *
- * @param ctx Pointer to the context to reset.
+ * @return 0 on success, -1 if the pool is empty and allocation fails.
  */
-void reset_client_context(ClientContext* ctx);
+int reserve_client_payload(ClientContext* ctx);
 
 /**
- * @brief Frees all resources associated with the client context.
+ * @brief Takes a buffer from the same pool for a payload that belongs to no context, such as
+ * a decompressed frame. Reactor-thread only.
  *
- * @param ctx Pointer to the context to free.
+ * @return The buffer, or NULL if the pool is empty and allocation fails.
  */
-void free_client_context(ClientContext* ctx);
+PendingPayload* acquire_payload_buffer(void);
+
+/**
+ * @brief Returns a buffer to the pool, or to the allocator once the pool holds enough.
+ */
+void release_payload_buffer(PendingPayload* pending);
+
+/**
+ * @brief Seeds the pool with count buffers carved from the arena. Unlike heap buffers they
+ * stay in the pool however many sit idle. Call during startup, after arena_init.
+ *
+ * @return The number of buffers added, 0 if the arena has no room for them.
+ */
+uint32_t prefill_payload_pool(uint32_t count);
+
+/**
+ * @brief Empties the pool, freeing heap buffers. Call before the arena is unmapped.
+ */
+void drain_payload_pool(void);
+
+/**
+ * @brief Resets the client context for the next message, returning any pending payload to the pool.
+ *
+ * @param ctx Pointer to the context to reset.
+ */
+void reset_client_context(ClientContext* ctx);
 
-#endif
\ No newline at end of file
+#endif
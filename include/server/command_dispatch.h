@@ -0,0 +1,73 @@
+/**
+ * @file command_dispatch.h
+ * @brief Defines the transport-independent command dispatcher shared by every listener.
+ */
+#ifndef COMMAND_DISPATCH_H
+#define COMMAND_DISPATCH_H
+
+#include <stdint.h>
+#include "protocol/protocol.h"
+
+#define CMD_ECHO 0x02
+
+// Largest payload a writer can be handed: a GET hit carries a full value behind its status byte
+#define COMMAND_MAX_RESPONSE_PAYLOAD (MAX_PAYLOAD_SIZE + KV_STATUS_SIZE)
+
+/**
+ * @brief A fully received request frame, independent of the transport it arrived on.
+ */
+typedef struct {
+    int fd;                   // Originating stream connection, -1 for datagram sources
+    uint16_t type;
+    uint32_t sequence_number;
+    const uint8_t* payload;
+    uint32_t payload_len;
+} CommandRequest;
+
+/**
+ * @brief Transport callback that delivers one response frame for a request.
+ */
+typedef void (*response_writer_t)(void* context, const CommandRequest* request,
+    uint16_t type, const uint8_t* payload, uint32_t payload_len);
+
+/**
+ * @brief Creates the engines backing the command set (key-value store, pub/sub).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int command_dispatch_init(void);
+
+/**
+ * @brief Executes a request and emits its responses through the given writer.
+ */
+void dispatch_command(const CommandRequest* request, response_writer_t writer, void* context);
+
+/**
+ * @brief Hands a serialized stream frame to the connection's output queue if it owns one.
+ *
+ * @return 0 if the frame was queued, -1 if the caller should write it directly.
+ */
+int command_dispatch_route_stream(int fd, const uint8_t* frame, uint32_t frame_len);
+
+/**
+ * @brief Resumes queued output for a stream connection that became writable.
+ */
+void command_dispatch_flush_stream(int fd);
+
+/**
+ * @brief Returns non-zero if the connection holds command state (e.g. subscriptions)
+ * that cannot follow its descriptor to another process.
+ */
+int command_dispatch_stream_has_state(int fd);
+
+/**
+ * @brief Drops per-connection command state. Must run before the fd is closed.
+ */
+void command_dispatch_release_stream(int fd);
+
+/**
+ * @brief Destroys the engines created by command_dispatch_init.
+ */
+void command_dispatch_shutdown(void);
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file connection_table.h
+ * @brief Defines the slot-indexed table that owns every reactor context and hands out generation-checked handles.
+ *
+ * A handle packs a slot index with the slot's generation at open time. Closing a slot bumps
+ * its generation, so a handle held by a worker or left in an epoll event can never resolve to
+ * a later connection that reuses the slot or the fd number. Workers pin a handle for the
+ * duration of a task; a slot closed while pinned keeps its fd open until the last pin drops.
+ */
+#ifndef CONNECTION_TABLE_H
+#define CONNECTION_TABLE_H
+
+#include <stdint.h>
+#include "server/client_context.h"
+
+// Slots are added in chunks so contexts never move once handed out
+#define CONNECTION_TABLE_CHUNK_SIZE 4096
+#define CONNECTION_TABLE_MAX_CHUNKS 1024
+
+/**
+ * @brief (generation << 32) | slot. Live generations are odd, so 0 is never a valid handle.
+ */
+typedef uint64_t ConnectionHandle;
+
+#define CONNECTION_HANDLE_NONE 0
+
+/**
+ * @brief Called on the reactor thread right before a closed connection's fd is closed.
+ */
+typedef void (*connection_release_fn)(int fd);
+
+/**
+ * @brief Sets the hook that drops per-fd state owned by other modules.
+ */
+void connection_table_set_release_hook(connection_release_fn hook);
+
+/**
+ * @brief Takes a free slot and initializes its context. Reactor thread only.
+ *
+ * @return The context, or NULL if the table is full or a chunk cannot be allocated.
+ */
+ClientContext* connection_table_open(int fd, TransportKind transport);
+
+/**
+ * @brief Returns the handle of a live context.
+ */
+ConnectionHandle connection_table_handle(const ClientContext* ctx);
+
+/**
+ * @brief Resolves a handle to its context if the slot still holds that connection. Reactor thread only.
+ *
+ * @return The context, or NULL for a stale or malformed handle.
+ */
+ClientContext* connection_table_lookup(ConnectionHandle handle);
+
+/**
+ * @brief Keeps the handle's fd open and unreused until connection_table_unpin. Any thread.
+ *
+ * @return 0 if the handle is still live and is now pinned, -1 if the connection is gone.
+ */
+int connection_table_pin(ConnectionHandle handle);
+
+/**
+ * @brief Drops a pin taken by connection_table_pin.
+ */
+void connection_table_unpin(ConnectionHandle handle);
+
+/**
+ * @brief Invalidates the handle and closes the fd, deferring the close while workers hold pins.
+ * The caller must already have removed the fd from epoll. Reactor thread only.
+ */
+void connection_table_close(ClientContext* ctx);
+
+/**
+ * @brief Invalidates the handle and recycles the slot without touching the fd, for reactor
+ * sources that own their descriptor and are never pinned. Reactor thread only.
+ */
+void connection_table_discard(ClientContext* ctx);
+
+/**
+ * @brief Closes deferred connections whose last pin has dropped. Reactor thread only.
+ *
+ * @return The number of closes still waiting on pins.
+ */
+uint32_t connection_table_reap(void);
+
+#endif
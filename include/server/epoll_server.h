@@ -5,11 +5,40 @@
 #ifndef EPOLL_SERVER_H
 #define EPOLL_SERVER_H
 
+#include <stdint.h>
+#include "server/thread_pool.h"
+#include "server/upstream.h"
+#include "server/rate_limit.h"
+
  /**
-  * @brief Starts the asynchronous event loop for the server.
-  *
-  * @param port The port number to bind the server to.
+  * @brief Listener configuration for the event loop.
   */
-void start_epoll_server(const char* port);
+typedef struct {
+    const char* port;        // TCP and UDP port
+    const char* unix_path;   // Unix domain socket path, NULL to disable
+    const char* restart_path; // Hot-restart handoff socket path, NULL to disable
+    int migrate_connections; // Hand live connections to the successor instead of closing them
+    uint32_t trace_sample_every; // Trace one request in N, 0 to disable
+    const char* trace_path;  // Chrome trace JSON written on SIGUSR2 and at shutdown
+    ThreadPoolSchedule pool_schedule; // How workers pick between priority lanes
+    uint32_t pool_min_threads; // Workers always running, 0 for one per core
+    uint32_t pool_max_threads; // Elastic ceiling, 0 or pool_min_threads for a fixed-size pool
+    uint32_t zerocopy_threshold; // Smallest TCP response frame sent with MSG_ZEROCOPY, 0 to disable
+    uint32_t arena_mb;       // Buffer arena mapped and prefaulted at startup, 0 to allocate on demand
+    uint32_t compress_threshold; // Smallest response payload compressed for negotiated clients, 0 to refuse compression
+    const char* capture_path; // Every received stream frame is appended here, NULL to disable
+    const char* upstream_routes[UPSTREAM_MAX_ROUTES]; // "types@host:port[,host:port...]" forwarding rules
+    uint32_t upstream_route_count;
+    RateLimit connection_limit; // Per stream connection
+    RateLimit source_limit;  // Shared by all TCP connections from one address
+    RateLimitPolicy limit_policy; // Delay reads or reject frames over a limit
+} ServerConfig;
+
+/**
+ * @brief Starts the asynchronous event loop for the server.
+ *
+ * @param config The listeners to open.
+ */
+void start_epoll_server(const ServerConfig* config);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+/**
+ * @file hot_restart.h
+ * @brief Defines the hot-restart handoff that moves listeners and live connections to a successor process.
+ *
+ * Each process listens on a SOCK_SEQPACKET Unix socket. A new process connects to it
+ * before opening any listener, receives the predecessor's listening sockets first (so
+ * accepting never pauses), and then receives migrated connections with their
+ * partially parsed frames while the predecessor drains its thread pool.
+ */
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include "server/client_context.h"
+
+/**
+ * @brief Listening sockets shared between the two processes. Absent entries are -1.
+ */
+typedef struct {
+    int tcp_fd;
+    int udp_fd;
+    int unix_fd;
+} ListenerSet;
+
+/**
+ * @brief Binds the handoff socket that a successor will connect to.
+ *
+ * @param path The filesystem path of the handoff socket.
+ * @return The non-blocking listening descriptor.
+ */
+int hot_restart_listen(const char* path);
+
+/**
+ * @brief Connects to a running predecessor and receives its listening sockets.
+ *
+ * @param path The predecessor's handoff socket.
+ * @param listeners Receives the inherited listeners.
+ * @return The non-blocking handoff connection, or -1 if no predecessor is running.
+ */
+int hot_restart_connect(const char* path, ListenerSet* listeners);
+
+/**
+ * @brief Predecessor side: passes the listening sockets to the successor.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int hot_restart_send_listeners(int conn_fd, const ListenerSet* listeners);
+
+/**
+ * @brief Predecessor side: passes a connection and its parse state to the successor.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int hot_restart_send_connection(int conn_fd, const ClientContext* ctx);
+
+/**
+ * @brief Predecessor side: tells the successor that no more connections follow.
+ */
+void hot_restart_send_done(int conn_fd);
+
+/**
+ * @brief Successor side: receives the next migrated connection into a freshly opened context.
+ *
+ * Records are separate SOCK_SEQPACKET messages, so one that fails validation only costs its own
+ * connection: its descriptor is closed and the caller moves on to the next record.
+ *
+ * @return 1 if ctx was filled, 2 if a record was skipped, 0 if nothing is pending, -1 when the handoff is over.
+ */
+int hot_restart_receive_connection(int conn_fd, ClientContext* ctx);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file kv_store.h
+ * @brief Defines the sharded in-memory key-value engine backing the KV packet types.
+ */
+#ifndef KV_STORE_H
+#define KV_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Opaque handle to a sharded key-value store.
+ *
+ * Each shard owns an open-addressing hash table guarded by its own mutex
+ * (lock striping), and an arena from which keys and values are carved.
+ */
+typedef struct KvStore KvStore;
+
+/**
+ * @brief Allocates and initializes a new key-value store.
+ *
+ * @param shard_count Number of independently locked shards (rounded up to a power of two).
+ * @param memory_limit Arena byte cap across all shards. 0 disables the cap and CLOCK eviction.
+ * @return Pointer to the store, or NULL on allocation failure.
+ */
+KvStore* kv_store_create(uint32_t shard_count, size_t memory_limit);
+
+/**
+ * @brief Looks up a key and copies its value into the caller's buffer.
+ *
+ * @param store The store to query.
+ * @param key Pointer to the key bytes.
+ * @param key_len Length of the key in bytes.
+ * @param out Destination buffer for the value.
+ * @param out_capacity Size of the destination buffer; longer values are truncated.
+ * @param out_len Receives the number of bytes copied.
+ * @return 0 on hit, -1 on miss.
+ */
+int kv_store_get(KvStore* store, const uint8_t* key, uint32_t key_len,
+    uint8_t* out, uint32_t out_capacity, uint32_t* out_len);
+
+/**
+ * @brief Inserts or replaces a key, evicting cold entries if the memory cap is reached.
+ *
+ * @return 0 on success, -1 if the entry cannot be stored.
+ */
+int kv_store_set(KvStore* store, const uint8_t* key, uint32_t key_len,
+    const uint8_t* value, uint32_t value_len);
+
+/**
+ * @brief Removes a key from the store.
+ *
+ * @return 0 if the key was removed, -1 if it was not present.
+ */
+int kv_store_delete(KvStore* store, const uint8_t* key, uint32_t key_len);
+
+/**
+ * @brief Destroys the store and releases every arena chunk.
+ */
+void kv_store_destroy(KvStore* store);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file pubsub.h
+ * @brief Defines the topic-based publish/subscribe fan-out engine.
+ */
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include <stdint.h>
+
+/**
+ * @brief Behaviour applied when a subscriber's bounded output queue is full.
+ */
+typedef enum {
+    PUBSUB_POLICY_DROP,
+    PUBSUB_POLICY_DISCONNECT
+} PubSubSlowPolicy;
+
+/**
+ * @brief Opaque handle to the topic table and the per-subscriber output queues.
+ */
+typedef struct PubSub PubSub;
+
+/**
+ * @brief Allocates a new publish/subscribe engine.
+ *
+ * @param queue_depth Maximum number of frames queued per subscriber.
+ * @param policy Action taken when a subscriber's queue overflows.
+ * @return Pointer to the engine, or NULL on allocation failure.
+ */
+PubSub* pubsub_create(uint32_t queue_depth, PubSubSlowPolicy policy);
+
+/**
+ * @brief Subscribes a connection to a topic.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pubsub_subscribe(PubSub* pubsub, int fd, const uint8_t* topic, uint32_t topic_len);
+
+/**
+ * @brief Removes a connection from a topic.
+ *
+ * @return 0 if the subscription existed, -1 otherwise.
+ */
+int pubsub_unsubscribe(PubSub* pubsub, int fd, const uint8_t* topic, uint32_t topic_len);
+
+/**
+ * @brief Serializes a PUBLISH frame once and enqueues the shared buffer to every subscriber.
+ *
+ * @return Number of subscribers the frame was queued to, or -1 on failure.
+ */
+int pubsub_publish(PubSub* pubsub, const uint8_t* topic, uint32_t topic_len,
+    const uint8_t* message, uint32_t message_len);
+
+/**
+ * @brief Routes an already serialized frame through a subscriber's queue to preserve stream order.
+ *
+ * @return 0 if the frame was taken over by the queue, -1 if fd is not a subscriber.
+ */
+int pubsub_send(PubSub* pubsub, int fd, const uint8_t* frame, uint32_t frame_len);
+
+/**
+ * @brief Writes as much of a subscriber's pending queue as the socket accepts.
+ * Called by the reactor when the socket becomes writable.
+ */
+void pubsub_flush(PubSub* pubsub, int fd);
+
+/**
+ * @brief Returns non-zero if the connection holds subscriptions or queued frames.
+ */
+int pubsub_has_connection(PubSub* pubsub, int fd);
+
+/**
+ * @brief Drops every subscription and queued frame of a connection. Must run before close(fd).
+ */
+void pubsub_remove_connection(PubSub* pubsub, int fd);
+
+/**
+ * @brief Destroys the engine and releases all topics, subscribers and buffers.
+ */
+void pubsub_destroy(PubSub* pubsub);
+
+#endif
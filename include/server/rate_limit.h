@@ -0,0 +1,104 @@
+/**
+ * @file rate_limit.h
+ * @brief Defines the per-connection and per-source token buckets the reactor enforces on stream frames.
+ *
+ * Every frame costs one frame token and its wire size in byte tokens, from the connection's
+ * bucket and from the bucket shared by all connections of its source address. Buckets refill
+ * continuously at the configured rate and hold RATE_LIMIT_BURST_MS worth of tokens. Byte
+ * tokens may go into debt by one frame, so a frame larger than the burst still gets through
+ * and the debt is paid off before the next one.
+ *
+ * All state is reactor-owned. Refills use a clock read once per reactor turn, so admitting a
+ * frame costs a few multiplications and no system calls.
+ */
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Bucket depth, as time at the configured rate
+#define RATE_LIMIT_BURST_MS 250
+
+// Source addresses tracked at once (power of two); beyond this new sources are only limited per connection
+#define RATE_LIMIT_SOURCE_SLOTS 16384
+
+/**
+ * @brief Sustained rates; 0 leaves that dimension unlimited.
+ */
+typedef struct {
+    uint32_t frames_per_sec;
+    uint32_t bytes_per_sec;
+} RateLimit;
+
+/**
+ * @brief What the reactor does with a frame over its limit.
+ */
+typedef enum {
+    RATE_LIMIT_DELAY,   // Stop reading the connection until tokens are available; TCP pushes back on the peer
+    RATE_LIMIT_REJECT   // Read and discard the frame, answering PACKET_TYPE_ERROR
+} RateLimitPolicy;
+
+/**
+ * @brief Sets the limits. Call before any connection is attached.
+ *
+ * @return 0 on success, -1 if the source table cannot be allocated.
+ */
+int rate_limit_configure(RateLimit per_connection, RateLimit per_source);
+
+/**
+ * @brief Returns non-zero if any limit is configured.
+ */
+int rate_limit_enabled(void);
+
+/**
+ * @brief Refreshes the cached clock. Call once per reactor turn, after the wait returns.
+ */
+void rate_limit_tick(void);
+
+/**
+ * @brief Returns the cached clock in microseconds.
+ */
+uint64_t rate_limit_now_us(void);
+
+/**
+ * @brief Starts limiting a connection with full buckets.
+ *
+ * @param slot The connection's table slot.
+ * @param peer Source address, or NULL for local connections that only get a per-connection bucket.
+ */
+void rate_limit_attach(uint32_t slot, const struct sockaddr* peer);
+
+/**
+ * @brief Stops limiting a connection and drops its share of the source bucket.
+ */
+void rate_limit_detach(uint32_t slot);
+
+/**
+ * @brief Checks whether the connection and its source may send another frame.
+ *
+ * @return 0 if tokens are available, otherwise the microseconds until they will be.
+ */
+uint64_t rate_limit_check(uint32_t slot);
+
+/**
+ * @brief Takes one frame and frame_bytes from the connection's and its source's buckets.
+ */
+void rate_limit_charge(uint32_t slot, uint32_t frame_bytes);
+
+/**
+ * @brief Counts a frame the reactor delayed or rejected.
+ */
+void rate_limit_count(RateLimitPolicy policy);
+
+/**
+ * @brief Logs how many frames were delayed or rejected.
+ */
+void rate_limit_log_stats(void);
+
+/**
+ * @brief Releases the per-connection chunks and the source table.
+ */
+void rate_limit_shutdown(void);
+
+#endif
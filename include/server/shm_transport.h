@@ -0,0 +1,53 @@
+/**
+ * @file shm_transport.h
+ * @brief Defines the server side of the shared-memory ring transport for co-located clients.
+ */
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include "server/client_context.h"
+
+/**
+ * @brief A negotiated shared-memory channel bound to the Unix connection that requested it.
+ */
+typedef struct ShmSession ShmSession;
+
+/**
+ * @brief Creates a channel and hands its memfd and doorbells to the peer over the Unix connection.
+ *
+ * @param conn_fd The Unix domain connection that sent SHM_ATTACH.
+ * @return The session, or NULL if the channel could not be created or passed.
+ */
+ShmSession* shm_session_open(int conn_fd);
+
+/**
+ * @brief Returns the reactor context registered for the session's doorbell eventfd.
+ */
+ClientContext* shm_session_doorbell_context(ShmSession* session);
+
+/**
+ * @brief Executes every queued request on the calling (reactor) thread and rings the client if it sleeps.
+ *
+ * @return 0 when the ring is drained, 1 if requests remain because the response ring is full,
+ *         -1 if the peer corrupted the ring.
+ */
+int shm_session_drain(ShmSession* session);
+
+/**
+ * @brief Drains sessions with pending requests and re-arms every doorbell before the reactor blocks.
+ *
+ * @return The epoll timeout to use: -1 when all sessions sleep, otherwise a short poll interval.
+ */
+int shm_transport_prepare_wait(void);
+
+/**
+ * @brief Unregisters the doorbell and queues the session for release after the current event batch.
+ */
+void shm_session_retire(ShmSession* session, int epoll_fd);
+
+/**
+ * @brief Releases sessions retired during the last event batch.
+ */
+void shm_transport_reap(void);
+
+#endif
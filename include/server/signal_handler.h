@@ -8,9 +8,11 @@
 #include <signal.h>
 
 extern volatile sig_atomic_t server_running;
+extern volatile sig_atomic_t trace_dump_requested;
 
 /**
- * @brief Sets up handlers for SIGINT and SIGTERM to allow graceful shutdown.
+ * @brief Sets up handlers for SIGINT and SIGTERM to allow graceful shutdown,
+ * and SIGUSR2 to request a trace dump.
  */
 void setup_signal_handlers(void);
 
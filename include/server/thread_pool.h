@@ -8,35 +8,109 @@
 #include <pthread.h>
 #include <stdint.h>
 
+// Priority lanes, highest first
+#define THREAD_POOL_LANE_CONTROL 0
+#define THREAD_POOL_LANE_INTERACTIVE 1
+#define THREAD_POOL_LANE_BULK 2
+#define THREAD_POOL_LANE_COUNT 3
+
+// Dequeue share per lane under weighted scheduling
+#define THREAD_POOL_WEIGHT_CONTROL 16
+#define THREAD_POOL_WEIGHT_INTERACTIVE 4
+#define THREAD_POOL_WEIGHT_BULK 1
+
+// A non-empty lane passed over this many times in a row is served next, whatever the schedule
+#define THREAD_POOL_STARVATION_LIMIT 32
+
+// Elastic sizing. A worker is added when a queued task has waited longer than the grow threshold,
+// at most once per cooldown. A worker retires after idling for the retire period, and never within
+// one retire period of the last grow, so a bursty load does not spawn and reap threads in a loop
+#define THREAD_POOL_GROW_WAIT_US 2000
+#define THREAD_POOL_GROW_COOLDOWN_MS 100
+#define THREAD_POOL_IDLE_RETIRE_MS 10000
+
 typedef void (*task_func_t)(void* arg);
 
+/**
+ * @brief How workers choose the next lane to dequeue from.
+ */
+typedef enum {
+    THREAD_POOL_STRICT,     // Always the highest non-empty lane
+    THREAD_POOL_WEIGHTED    // Smooth weighted round robin across non-empty lanes
+} ThreadPoolSchedule;
+
 typedef struct {
     task_func_t function;
     void* argument;
+    uint32_t trace_id;
+    uint64_t enqueued_ns;       // Monotonic time the task was queued, drives elastic growth
 } Task;
 
+/**
+ * @brief One bounded circular queue and its scheduling state.
+ */
+typedef struct {
+    Task* queue;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+    int32_t weight;
+    int32_t current_weight;
+    uint32_t passed_over;
+} TaskLane;
+
+/**
+ * @brief Size and resize history of a pool.
+ */
+typedef struct {
+    uint32_t threads;           // Live workers
+    uint32_t min_threads;
+    uint32_t max_threads;
+    uint32_t peak_threads;
+    uint64_t grow_events;
+    uint64_t shrink_events;
+} ThreadPoolStats;
+
 typedef struct {
     pthread_mutex_t lock;
     pthread_cond_t notify;
-    pthread_t* threads;
-    Task* queue;
+    pthread_t* threads;         // max_threads slots; a slot is reused once its worker retires
+    uint8_t* slot_state;        // Lifecycle of the worker in each slot (free, running, retired)
+    TaskLane lanes[THREAD_POOL_LANE_COUNT];
+    ThreadPoolSchedule schedule;
     uint32_t thread_count;
+    uint32_t min_threads;
+    uint32_t max_threads;
     uint32_t queue_size;
-    uint32_t head;
-    uint32_t tail;
     uint32_t count;
+    uint64_t last_grow_ns;
+    ThreadPoolStats stats;
     int shutdown;
 } ThreadPool;
 
 /**
  * @brief Allocates and initializes a new thread pool.
+ *
+ * @param min_threads Workers started up front and never retired.
+ * @param max_threads Upper bound for elastic growth; equal to min_threads for a fixed-size pool.
+ * @param queue_size Capacity of each lane.
+ * @param schedule Lane selection policy for workers.
+ */
+ThreadPool* thread_pool_create(uint32_t min_threads, uint32_t max_threads, uint32_t queue_size, ThreadPoolSchedule schedule);
+
+/**
+ * @brief Adds a new task to one of the thread pool's lanes.
+ *
+ * @param lane THREAD_POOL_LANE_* the task is queued on.
+ * @param trace_id Trace id of the request the task serves, 0 if it is not sampled.
+ * @return 0 on success, -1 if the lane is full or the pool is shutting down.
  */
-ThreadPool* thread_pool_create(uint32_t thread_count, uint32_t queue_size);
+int thread_pool_add_task(ThreadPool* pool, uint32_t lane, task_func_t function, void* argument, uint32_t trace_id);
 
 /**
- * @brief Adds a new task to the thread pool queue.
+ * @brief Copies the current size and resize counters. Safe from any thread.
  */
-int thread_pool_add_task(ThreadPool* pool, task_func_t function, void* argument);
+void thread_pool_get_stats(ThreadPool* pool, ThreadPoolStats* stats);
 
 /**
  * @brief Destroys the thread pool and releases all resources.
@@ -0,0 +1,73 @@
+/**
+ * @file trace.h
+ * @brief Defines per-request tracing spans recorded into per-thread lock-free rings.
+ *
+ * One request in every N is assigned a non-zero trace id when its header completes.
+ * Each stage it passes through appends a timestamped event to the calling thread's ring;
+ * unsampled requests carry id 0 and cost a single branch per stage. Rings are dumped as
+ * Chrome trace-event JSON (chrome://tracing, Perfetto) on demand and at shutdown.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_CAPACITY (1u << 16)
+
+/**
+ * @brief Request lifecycle stages, in the order a stream request passes through them.
+ */
+typedef enum {
+    TRACE_HEADER_COMPLETE,
+    TRACE_PAYLOAD_COMPLETE,
+    TRACE_ENQUEUED,
+    TRACE_DEQUEUED,
+    TRACE_HANDLER_START,
+    TRACE_BYTES_WRITTEN,
+    TRACE_HANDLER_END,
+    TRACE_STAGE_COUNT
+} TraceStage;
+
+/**
+ * @brief Enables tracing.
+ *
+ * @param sample_every Trace one request in this many; 0 leaves tracing disabled.
+ */
+void trace_init(uint32_t sample_every);
+
+/**
+ * @brief Returns a fresh trace id if the next request is sampled, 0 otherwise.
+ */
+uint32_t trace_sample(void);
+
+/**
+ * @brief Appends an event to the calling thread's ring. Use trace_stamp instead.
+ */
+void trace_record(uint32_t trace_id, TraceStage stage, uint32_t value);
+
+/**
+ * @brief Sets or reads the trace id of the request the calling thread is executing,
+ * so code below the handler can stamp without threading the id through every call.
+ */
+void trace_set_current(uint32_t trace_id);
+uint32_t trace_current(void);
+
+/**
+ * @brief Writes every ring as Chrome trace-event JSON.
+ *
+ * @return 0 on success, -1 if tracing is disabled or the file cannot be written.
+ */
+int trace_dump(const char* path);
+
+/**
+ * @brief Records a stage for sampled requests; a no-op branch for everything else.
+ *
+ * @param value Stage-specific detail, e.g. bytes written.
+ */
+static inline void trace_stamp(uint32_t trace_id, TraceStage stage, uint32_t value) {
+    if (trace_id != 0) {
+        trace_record(trace_id, stage, value);
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file udp_server.h
+ * @brief Defines the batched UDP listener that carries the binary protocol over datagrams.
+ */
+#ifndef UDP_SERVER_H
+#define UDP_SERVER_H
+
+/**
+ * @brief Opaque handle to a UDP listener, its batch buffers and per-source statistics.
+ */
+typedef struct UdpServer UdpServer;
+
+/**
+ * @brief Binds a non-blocking UDP socket and allocates the recvmmsg/sendmmsg batch buffers.
+ * GRO and GSO (UDP_SEGMENT) are enabled when the kernel supports them.
+ *
+ * @param port The port number to bind the listener to.
+ * @param inherited_fd A socket already bound by a predecessor process, or -1 to bind a new one.
+ * @return Pointer to the listener, or NULL on allocation failure.
+ */
+UdpServer* udp_server_create(const char* port, int inherited_fd);
+
+/**
+ * @brief Returns the datagram socket so the reactor can register it.
+ */
+int udp_server_fd(const UdpServer* server);
+
+/**
+ * @brief Drains the socket in recvmmsg batches, dispatches every frame and flushes replies with sendmmsg.
+ * Must be called from the reactor thread when the socket is readable.
+ */
+void udp_server_handle_readable(UdpServer* server);
+
+/**
+ * @brief Logs aggregate and per-source datagram statistics.
+ */
+void udp_server_log_stats(const UdpServer* server);
+
+/**
+ * @brief Closes the socket and releases all buffers.
+ */
+void udp_server_destroy(UdpServer* server);
+
+#endif
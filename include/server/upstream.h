@@ -0,0 +1,97 @@
+/**
+ * @file upstream.h
+ * @brief Defines the forwarding mode that relays selected frame types to pools of backend servers.
+ *
+ * A route maps a range of packet types to a group of backends. Frames of a routed type that
+ * arrive on a stream connection are not executed locally: the reactor re-sequences them onto
+ * one of the backend's pooled connections and relays the backend's response to the client
+ * under the client's original sequence number. Requests that carry a key (KV commands, PUBLISH)
+ * always go to the same healthy backend of the group; everything else is spread round-robin.
+ *
+ * Upstream connections are non-blocking and owned by the reactor. Writes queued during one
+ * event batch go out together before the reactor blocks, so many requests share one send.
+ * Each connection is probed with PACKET_TYPE_HEARTBEAT; a backend only receives traffic once
+ * a probe has been answered, and is taken out of rotation when one goes unanswered.
+ */
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stdint.h>
+#include "server/client_context.h"
+#include "server/connection_table.h"
+
+#define UPSTREAM_MAX_ROUTES 16
+#define UPSTREAM_MAX_BACKENDS 16
+
+// Connections opened to every backend, and requests each may have outstanding (power of two)
+#define UPSTREAM_POOL_SIZE 4
+#define UPSTREAM_WINDOW 256
+
+// Queued output per connection before it counts as full
+#define UPSTREAM_OUTPUT_LIMIT (256 * 1024)
+#define UPSTREAM_INPUT_BUFFER (16 * 1024)
+
+// Probe cadence, how long a probe may stay unanswered, and when a request is given up on
+#define UPSTREAM_HEALTH_INTERVAL_MS 1000
+#define UPSTREAM_HEALTH_TIMEOUT_MS 500
+#define UPSTREAM_REQUEST_TIMEOUT_MS 5000
+
+// Reconnect backoff, doubled after every failed attempt
+#define UPSTREAM_RECONNECT_MIN_MS 100
+#define UPSTREAM_RECONNECT_MAX_MS 5000
+
+/**
+ * @brief Delivers a backend response (or an ERROR for a failed request) to the client that sent it.
+ *
+ * @param flags PACKET_FLAG_* the client's request carried.
+ */
+typedef void (*upstream_reply_fn)(ConnectionHandle client, uint16_t type, uint32_t sequence_number,
+    const uint8_t* payload, uint32_t payload_len, uint16_t flags);
+
+/**
+ * @brief Parses route specifications of the form "types@host:port[,host:port...]", where types
+ * is one packet type or an inclusive range such as 0x10-0x12, and resolves every backend.
+ *
+ * @return 0 on success, -1 if a route is malformed, overlaps another or names an unresolvable backend.
+ */
+int upstream_configure(const char* const* routes, uint32_t route_count);
+
+/**
+ * @brief Starts connecting every backend's pool and registers the connections with the reactor.
+ * A no-op when no route is configured.
+ */
+void upstream_start(int epoll_fd, upstream_reply_fn reply);
+
+/**
+ * @brief Returns non-zero if frames of this type are forwarded instead of executed locally.
+ */
+int upstream_routes_type(uint16_t type);
+
+/**
+ * @brief Queues a complete, verified request frame on a healthy backend. Reactor thread only.
+ *
+ * @param flags PACKET_FLAG_* mirrored onto the relayed response.
+ * @return 0 if queued, -1 if no backend of the route is healthy or every connection is full.
+ */
+int upstream_forward(ConnectionHandle client, uint16_t type, uint32_t sequence_number,
+    const uint8_t* payload, uint32_t payload_len, uint16_t flags);
+
+/**
+ * @brief Handles an epoll event for a context flagged CLIENT_FLAG_UPSTREAM.
+ */
+void upstream_handle_event(ClientContext* ctx, uint32_t events);
+
+/**
+ * @brief Sends queued requests, probes backends, reconnects and expires stale requests.
+ * Call once per reactor turn, right before blocking.
+ *
+ * @return Milliseconds until the next timer is due, -1 if forwarding is not configured.
+ */
+int upstream_poll(void);
+
+/**
+ * @brief Fails every outstanding request with an ERROR response and closes all upstream connections.
+ */
+void upstream_shutdown(void);
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file zerocopy.h
+ * @brief Defines the MSG_ZEROCOPY transmit path for large stream responses.
+ *
+ * A zerocopy send pins the frame's pages instead of copying them into the socket, so the
+ * frame must stay untouched until the kernel reports completion on the socket's error queue.
+ * Each connection keeps a FIFO of in-flight frames keyed by the kernel's per-socket send
+ * counter; the reactor harvests completions on EPOLLERR and frees the frames they cover.
+ */
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Buckets of the fd-keyed connection map
+#define ZEROCOPY_FD_BUCKETS 1024
+
+// Frames a connection may have in flight before further sends fall back to copying
+#define ZEROCOPY_MAX_PENDING 256
+
+/**
+ * @brief Enables SO_ZEROCOPY on a freshly accepted socket.
+ *
+ * @return 0 on success, -1 if the kernel or socket type does not support it.
+ */
+int zerocopy_enable(int fd);
+
+/**
+ * @brief Sends a complete frame with MSG_ZEROCOPY. Safe from any thread holding the connection's pin.
+ *
+ * @param frame Heap buffer; ownership passes to the transmit path when the call succeeds.
+ * @return Bytes sent, or -1 with the frame still owned by the caller (queue full or send failed).
+ */
+ssize_t zerocopy_send(int fd, uint8_t* frame, size_t len);
+
+/**
+ * @brief Drains the socket error queue and frees frames the kernel is done with. Reactor thread only.
+ */
+void zerocopy_harvest(int fd);
+
+/**
+ * @brief Stops tracking a connection that is about to be closed. Completed frames are freed;
+ * ones the kernel may still be sending are kept, never reused, until the process exits.
+ */
+void zerocopy_release(int fd);
+
+/**
+ * @brief Logs totals of zerocopy sends and of completions the kernel served by copying.
+ */
+void zerocopy_log_stats(void);
+
+#endif
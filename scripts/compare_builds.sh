@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs scripts/run_benchmarks.sh against several build directories and reports each metric's
+# median over REPEAT runs, with the change relative to the first directory.
+#
+# Usage: REPEAT=3 scripts/compare_builds.sh <baseline_dir> <variant_dir>...
+set -e
+
+[ $# -ge 2 ] || { echo "usage: $0 <baseline_dir> <variant_dir>..." >&2; exit 1; }
+REPEAT=${REPEAT:-3}
+PORT=${PORT:-9191}
+SCRIPT_DIR=$(dirname "$0")
+RESULTS=$(mktemp -d)
+trap 'rm -rf "$RESULTS"' EXIT
+
+index=0
+for dir in "$@"; do
+    echo "$index $dir" >> "$RESULTS/builds"
+    index=$((index + 1))
+done
+
+# Builds take turns run by run, so drift on the host affects all of them alike
+run=1
+while [ "$run" -le "$REPEAT" ]; do
+    build=0
+    for dir in "$@"; do
+        echo "[COMPARE] $dir run $run/$REPEAT" >&2
+        sh "$SCRIPT_DIR/run_benchmarks.sh" "$dir" "$PORT" | awk -v build="$build" '
+            /^== / { section = $2 }
+            /Throughput:/ { print build, section "_rps", $3 }
+            /Bulk:/ { print build, "prio_bulk_rps", $(NF - 1) }
+            / avg .* p50 / { print build, section "_" $2 "_p50_us", $7; print build, section "_" $2 "_p99_us", $10 }
+            section == "crc" && $2 == "1024" { print build, "crc_1KiB_GBps", $4; print build, "crc_1KiB_sliced_GBps", $5 }
+        ' >> "$RESULTS/samples"
+        build=$((build + 1))
+    done
+    run=$((run + 1))
+done
+
+sort -k2,2 -k1,1n -k3,3g "$RESULTS/samples" | awk -v builds="$index" '
+    FNR == NR { name[$1] = $2; next }
+    {
+        key = $2 SUBSEP $1
+        count[key]++
+        value[key, count[key]] = $3
+        if (!($2 in seen)) { seen[$2] = 1; order[++metrics] = $2 }
+    }
+    function median(key,    n) {
+        n = count[key]
+        return (n % 2) ? value[key, (n + 1) / 2] : (value[key, n / 2] + value[key, n / 2 + 1]) / 2
+    }
+    END {
+        printf "%-26s", "metric (median)"
+        for (b = 0; b < builds; b++) printf " %16s", name[b]
+        printf "\n"
+        for (m = 1; m <= metrics; m++) {
+            metric = order[m]
+            base = median(metric SUBSEP 0)
+            printf "%-26s", metric
+            for (b = 0; b < builds; b++) {
+                current = median(metric SUBSEP b)
+                if (b == 0 || base == 0) printf " %16.2f", current
+                else printf " %9.2f %+5.1f%%", current, 100.0 * (current - base) / base
+            }
+            printf "\n"
+        }
+        printf "Throughput and GB/s: higher is better. Latency (_us): lower is better.\n"
+    }
+' "$RESULTS/builds" -
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Measures latency from a fresh start with and without the prefaulted buffer arena.
+# Each run starts a new server so the first requests meet cold buffers and page tables.
+#
+# Usage: scripts/compare_warmup.sh <build_dir> [port] [runs]
+set -e
+
+BUILD_DIR=${1:?usage: $0 <build_dir> [port] [runs]}
+PORT=${2:-9191}
+RUNS=${3:-3}
+
+run_fresh() {
+    "$BUILD_DIR/network_server" "$@" "$PORT" > "$BUILD_DIR/warmup_server.log" 2>&1 &
+    SERVER_PID=$!
+    trap 'kill -INT $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null' EXIT
+    sleep 1
+    "$BUILD_DIR/benchmark" "$PORT" warmup "$SERVER_PID"
+    kill -INT $SERVER_PID
+    wait $SERVER_PID || true
+    trap - EXIT
+}
+
+i=1
+while [ "$i" -le "$RUNS" ]; do
+    echo "== run $i: allocator (-a 0)"
+    run_fresh -a 0
+    echo "== run $i: arena"
+    run_fresh
+    i=$((i + 1))
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Starts the server from one build directory and drives it with that directory's benchmark.
+# Used to train PGO builds and to compare build variants.
+#
+# Usage: scripts/run_benchmarks.sh <build_dir> [port]
+set -e
+
+BUILD_DIR=${1:?usage: $0 <build_dir> [port]}
+PORT=${2:-9190}
+UNIX_PATH=/tmp/network_server_bench_$PORT.sock
+
+"$BUILD_DIR/network_server" -u "$UNIX_PATH" "$PORT" > "$BUILD_DIR/bench_server.log" 2>&1 &
+SERVER_PID=$!
+trap 'kill -INT $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null' EXIT
+sleep 1
+
+echo "== echo"
+"$BUILD_DIR/benchmark" -d 32 "$PORT" echo
+echo "== echo-crc"
+"$BUILD_DIR/benchmark" -d 32 -k "$PORT" echo
+echo "== kv"
+"$BUILD_DIR/benchmark" -d 32 "$PORT" kv
+echo "== rtt"
+"$BUILD_DIR/benchmark" "$PORT" rtt "$UNIX_PATH"
+echo "== prio"
+"$BUILD_DIR/benchmark" "$PORT" prio
+echo "== crc"
+"$BUILD_DIR/benchmark" "$PORT" crc
+
+# SIGINT lets the server exit through main, which is when profile data is written
+kill -INT $SERVER_PID
+wait $SERVER_PID || true
+trap - EXIT
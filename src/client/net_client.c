@@ -0,0 +1,679 @@
+/**
+ * @file net_client.c
+ * @brief Implementation of the pooled, pipelined client on top of non-blocking sockets and poll().
+ */
+#include "client/net_client.h"
+#include "protocol/crc32c.h"
+#include "protocol/lz.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define NET_CLIENT_MAX_POOL 64
+#define NET_CLIENT_READ_CHUNK 65536
+#define NET_CLIENT_MAX_FRAME (16u << 20)
+#define NET_CLIENT_UNIX_PREFIX "unix:"
+
+typedef struct {
+    net_client_callback_t callback;
+    void* user_data;
+    uint32_t sequence_number;
+    int in_use;
+} PendingRequest;
+
+typedef struct {
+    int fd;
+    int connecting;
+    int failing;
+    uint32_t next_sequence;
+    uint32_t in_flight;
+    int compress;               // The server granted PROTOCOL_FEATURE_COMPRESSION on this connection
+    PendingRequest* pending;    // Indexed by sequence_number % NET_CLIENT_MAX_IN_FLIGHT
+
+    uint8_t* out_buf;           // Serialized requests not yet written
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+
+    uint8_t* in_buf;            // Bytes received but not yet parsed into frames
+    size_t in_len;
+    size_t in_cap;
+} NetConnection;
+
+struct NetClient {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    NetConnection* connections;
+    uint32_t connection_count;
+    uint32_t next_connection;
+    net_client_callback_t push_handler;
+    void* push_user_data;
+    int checksum;               // Requests go out as version 2 frames with a CRC32C trailer
+    uint32_t compress_threshold; // Smallest payload compressed once a connection negotiated it, 0 when off
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint8_t inflated[MAX_PAYLOAD_SIZE]; // Compressed responses are handed to callbacks from here
+};
+
+typedef struct {
+    int done;
+    int status;
+    PacketHeader* header;
+    uint8_t* payload;
+    uint32_t capacity;
+    uint32_t* length;
+} CallWaiter;
+
+static int reserve_buffer(uint8_t** buffer, size_t* capacity, size_t needed) {
+    if (*capacity >= needed) {
+        return 0;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity : 4096;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    uint8_t* grown = (uint8_t*)realloc(*buffer, new_capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static int resolve_endpoint(NetClient* client, const char* endpoint) {
+    size_t prefix_len = strlen(NET_CLIENT_UNIX_PREFIX);
+
+    if (strncmp(endpoint, NET_CLIENT_UNIX_PREFIX, prefix_len) == 0) {
+        const char* path = endpoint + prefix_len;
+        struct sockaddr_un* addr = (struct sockaddr_un*)&client->addr;
+        if (strlen(path) >= sizeof(addr->sun_path)) {
+            return -1;
+        }
+        addr->sun_family = AF_UNIX;
+        strcpy(addr->sun_path, path);
+        client->addr_len = sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    const char* colon = strrchr(endpoint, ':');
+    if (colon == NULL || colon == endpoint) {
+        return -1;
+    }
+
+    char host[256];
+    size_t host_len = (size_t)(colon - endpoint);
+    if (host_len >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, endpoint, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints;
+    struct addrinfo* result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host, colon + 1, &hints, &result) != 0) {
+        return -1;
+    }
+    memcpy(&client->addr, result->ai_addr, result->ai_addrlen);
+    client->addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return 0;
+}
+
+// Serializes one request into the connection's output buffer and registers its callback
+static int queue_request(NetClient* client, NetConnection* conn, uint16_t type, const uint8_t* payload,
+    uint32_t payload_len, net_client_callback_t callback, void* user_data) {
+    PendingRequest* request = &conn->pending[conn->next_sequence % NET_CLIENT_MAX_IN_FLIGHT];
+    if (request->in_use) {
+        return -1;
+    }
+
+    // Sized for the plain frame; a compressed payload only ever comes out smaller
+    uint32_t trailer_len = client->checksum ? PACKET_CRC32C_SIZE : 0;
+    size_t frame_len = sizeof(PacketHeader) + payload_len + trailer_len;
+    if (reserve_buffer(&conn->out_buf, &conn->out_cap, conn->out_len + frame_len) != 0) {
+        return -1;
+    }
+
+    uint8_t* frame = conn->out_buf + conn->out_len;
+    uint16_t flags = client->checksum ? PACKET_FLAG_CRC32C : 0;
+    uint32_t body_len = payload_len;
+    if (conn->compress && payload_len >= client->compress_threshold) {
+        uint32_t packed_len = lz_compress_payload(payload, payload_len, frame + sizeof(PacketHeader), payload_len);
+        if (packed_len > 0) {
+            flags |= PACKET_FLAG_COMPRESSED;
+            body_len = packed_len;
+        }
+    }
+    if (!(flags & PACKET_FLAG_COMPRESSED) && payload_len > 0) {
+        memcpy(frame + sizeof(PacketHeader), payload, payload_len);
+    }
+
+    PacketHeader header;
+    header.version = (flags != 0) ? PROTOCOL_VERSION_2 : PROTOCOL_VERSION_1;
+    header.type = type | flags;
+    header.sequence_number = conn->next_sequence;
+    header.payload_length = body_len + trailer_len;
+    serialize_header(&header, frame);
+
+    if (trailer_len > 0) {
+        uint32_t net_crc = htonl(crc32c(0, frame + sizeof(PacketHeader), body_len));
+        memcpy(frame + sizeof(PacketHeader) + body_len, &net_crc, sizeof(net_crc));
+    }
+    conn->out_len += sizeof(PacketHeader) + body_len + trailer_len;
+
+    request->callback = callback;
+    request->user_data = user_data;
+    request->sequence_number = header.sequence_number;
+    request->in_use = 1;
+    conn->in_flight++;
+
+    // Sequence 0 is left to server-initiated frames such as pub/sub deliveries
+    conn->next_sequence++;
+    if (conn->next_sequence == 0) {
+        conn->next_sequence = 1;
+    }
+    return 0;
+}
+
+// A refusal, or the ERROR of a server that predates negotiation, leaves the connection plain
+static void features_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    NetConnection* conn = (NetConnection*)user_data;
+    if (status != 0 || header->type != PACKET_TYPE_ACK || header->payload_length < sizeof(uint32_t)) {
+        return;
+    }
+
+    uint32_t granted;
+    memcpy(&granted, payload, sizeof(granted));
+    conn->compress = (ntohl(granted) & PROTOCOL_FEATURE_COMPRESSION) != 0;
+}
+
+// Queued ahead of anything else on a fresh connection; requests sent before the grant go out plain
+static void request_features(NetClient* client, NetConnection* conn) {
+    uint32_t requested = htonl(client->compress_threshold > 0 ? PROTOCOL_FEATURE_COMPRESSION : 0);
+    queue_request(client, conn, PACKET_TYPE_FEATURES, (const uint8_t*)&requested, sizeof(requested), features_done, conn);
+}
+
+static int connection_open(NetClient* client, NetConnection* conn) {
+    int fd = socket(client->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    if (client->addr.ss_family != AF_UNIX) {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    conn->connecting = 0;
+    if (connect(fd, (struct sockaddr*)&client->addr, client->addr_len) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+        }
+        conn->connecting = 1;
+    }
+
+    conn->fd = fd;
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    conn->in_len = 0;
+    if (client->compress_threshold > 0) {
+        request_features(client, conn);
+    }
+    return 0;
+}
+
+// Closes the socket and completes every pending request with status -1
+static int connection_fail(NetConnection* conn) {
+    int completions = 0;
+
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    conn->connecting = 0;
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    conn->in_len = 0;
+    conn->in_flight = 0;
+    conn->compress = 0;
+
+    // Callbacks may resubmit; keep them off this connection until every slot is drained
+    conn->failing = 1;
+    for (uint32_t i = 0; i < NET_CLIENT_MAX_IN_FLIGHT; i++) {
+        PendingRequest* request = &conn->pending[i];
+        if (!request->in_use) {
+            continue;
+        }
+        request->in_use = 0;
+        request->callback(request->user_data, -1, NULL, NULL);
+        completions++;
+    }
+    conn->failing = 0;
+
+    return completions;
+}
+
+// Least in-flight wins; rotating the start index spreads ties across the pool
+static NetConnection* select_connection(NetClient* client) {
+    NetConnection* best = NULL;
+    uint64_t best_cost = UINT64_MAX;
+
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        NetConnection* conn = &client->connections[(client->next_connection + i) % client->connection_count];
+        if (conn->failing) {
+            continue;
+        }
+        if (conn->pending[conn->next_sequence % NET_CLIENT_MAX_IN_FLIGHT].in_use) {
+            continue;
+        }
+
+        uint64_t cost = conn->in_flight + (conn->fd < 0 ? NET_CLIENT_MAX_IN_FLIGHT : 0);
+        if (cost < best_cost) {
+            best = conn;
+            best_cost = cost;
+        }
+    }
+    client->next_connection++;
+
+    if (best != NULL && best->fd < 0 && connection_open(client, best) != 0) {
+        return NULL;
+    }
+    return best;
+}
+
+// Strips version 2 flags, checks the CRC32C trailer and inflates compressed payloads, so
+// callbacks always see a plain frame
+static int unwrap_frame(NetClient* client, PacketHeader* header, const uint8_t** payload) {
+    if (header->version != PROTOCOL_VERSION_2) {
+        return 0;
+    }
+
+    uint16_t flags = header->type & ~PACKET_TYPE_MASK;
+    header->type &= PACKET_TYPE_MASK;
+    if ((flags & ~(PACKET_FLAG_CRC32C | PACKET_FLAG_COMPRESSED)) != 0) {
+        return -1;
+    }
+
+    if (flags & PACKET_FLAG_CRC32C) {
+        if (header->payload_length < PACKET_CRC32C_SIZE) {
+            return -1;
+        }
+        header->payload_length -= PACKET_CRC32C_SIZE;
+        uint32_t net_crc;
+        memcpy(&net_crc, *payload + header->payload_length, sizeof(net_crc));
+        if (crc32c(0, *payload, header->payload_length) != ntohl(net_crc)) {
+            return -1;
+        }
+    }
+
+    if (flags & PACKET_FLAG_COMPRESSED) {
+        int32_t inflated_len = lz_decompress_payload(*payload, header->payload_length, client->inflated,
+            sizeof(client->inflated));
+        if (inflated_len < 0) {
+            return -1;
+        }
+        header->payload_length = (uint32_t)inflated_len;
+        *payload = client->inflated;
+    }
+    return 0;
+}
+
+// A corrupt response fails only its own request; framing is intact, so the stream carries on
+static void complete_frame(NetClient* client, NetConnection* conn, PacketHeader* header, const uint8_t* payload) {
+    PendingRequest* request = &conn->pending[header->sequence_number % NET_CLIENT_MAX_IN_FLIGHT];
+    int status = unwrap_frame(client, header, &payload);
+
+    if (request->in_use && request->sequence_number == header->sequence_number) {
+        request->in_use = 0;
+        conn->in_flight--;
+        if (status == 0) {
+            request->callback(request->user_data, 0, header, payload);
+        }
+        else {
+            request->callback(request->user_data, -1, NULL, NULL);
+        }
+    }
+    else if (client->push_handler != NULL && status == 0) {
+        client->push_handler(client->push_user_data, 0, header, payload);
+    }
+}
+
+static int parse_frames(NetClient* client, NetConnection* conn, int* completions) {
+    size_t offset = 0;
+
+    while (conn->in_len - offset >= sizeof(PacketHeader)) {
+        PacketHeader header;
+        deserialize_header(conn->in_buf + offset, &header);
+        if (header.payload_length > NET_CLIENT_MAX_FRAME) {
+            return -1;
+        }
+
+        size_t frame_len = sizeof(PacketHeader) + header.payload_length;
+        if (conn->in_len - offset < frame_len) {
+            break;
+        }
+
+        complete_frame(client, conn, &header, conn->in_buf + offset + sizeof(PacketHeader));
+        (*completions)++;
+        offset += frame_len;
+    }
+
+    if (offset > 0) {
+        memmove(conn->in_buf, conn->in_buf + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+    return 0;
+}
+
+static int connection_read(NetClient* client, NetConnection* conn, int* completions) {
+    while (1) {
+        if (reserve_buffer(&conn->in_buf, &conn->in_cap, conn->in_len + NET_CLIENT_READ_CHUNK) != 0) {
+            return -1;
+        }
+
+        ssize_t bytes = recv(conn->fd, conn->in_buf + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (bytes > 0) {
+            conn->in_len += (size_t)bytes;
+            client->bytes_received += (uint64_t)bytes;
+            if (parse_frames(client, conn, completions) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (bytes == 0) {
+            return -1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+static int connection_flush(NetClient* client, NetConnection* conn) {
+    if (conn->fd < 0 || conn->connecting) {
+        return 0;
+    }
+
+    while (conn->out_sent < conn->out_len) {
+        ssize_t bytes = send(conn->fd, conn->out_buf + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (bytes > 0) {
+            conn->out_sent += (size_t)bytes;
+            client->bytes_sent += (uint64_t)bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return -1;
+    }
+
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    return 0;
+}
+
+static int flush_all(NetClient* client) {
+    int completions = 0;
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        NetConnection* conn = &client->connections[i];
+        if (connection_flush(client, conn) != 0) {
+            completions += connection_fail(conn);
+        }
+    }
+    return completions;
+}
+
+NetClient* net_client_create(const char* endpoint, uint32_t pool_size) {
+    if (pool_size == 0) {
+        pool_size = 1;
+    }
+    if (pool_size > NET_CLIENT_MAX_POOL) {
+        pool_size = NET_CLIENT_MAX_POOL;
+    }
+
+    NetClient* client = (NetClient*)calloc(1, sizeof(NetClient));
+    if (client == NULL) {
+        return NULL;
+    }
+    if (resolve_endpoint(client, endpoint) != 0) {
+        free(client);
+        return NULL;
+    }
+
+    client->connections = (NetConnection*)calloc(pool_size, sizeof(NetConnection));
+    if (client->connections == NULL) {
+        free(client);
+        return NULL;
+    }
+    client->connection_count = pool_size;
+
+    for (uint32_t i = 0; i < pool_size; i++) {
+        NetConnection* conn = &client->connections[i];
+        conn->fd = -1;
+        conn->next_sequence = 1;
+        conn->pending = (PendingRequest*)calloc(NET_CLIENT_MAX_IN_FLIGHT, sizeof(PendingRequest));
+        if (conn->pending == NULL) {
+            client->connection_count = i;
+            net_client_destroy(client);
+            return NULL;
+        }
+        // A refused connect is retried lazily on the next submit
+        connection_open(client, conn);
+    }
+
+    return client;
+}
+
+int net_client_submit(NetClient* client, uint16_t type, const uint8_t* payload, uint32_t payload_len,
+    net_client_callback_t callback, void* user_data) {
+    if ((payload_len == 0 && type != PACKET_TYPE_HEARTBEAT) || callback == NULL) {
+        return -1;
+    }
+
+    NetConnection* conn = select_connection(client);
+    if (conn == NULL) {
+        return -1;
+    }
+    return queue_request(client, conn, type, payload, payload_len, callback, user_data);
+}
+
+int net_client_flush(NetClient* client) {
+    flush_all(client);
+
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        if (client->connections[i].fd >= 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int net_client_poll(NetClient* client, int timeout_ms) {
+    struct pollfd fds[NET_CLIENT_MAX_POOL];
+    NetConnection* polled[NET_CLIENT_MAX_POOL];
+    int completions = flush_all(client);
+    nfds_t count = 0;
+
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        NetConnection* conn = &client->connections[i];
+        if (conn->fd < 0) {
+            continue;
+        }
+        fds[count].fd = conn->fd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        if (conn->connecting || conn->out_sent < conn->out_len) {
+            fds[count].events |= POLLOUT;
+        }
+        polled[count++] = conn;
+    }
+
+    if (count == 0) {
+        return completions;
+    }
+
+    if (poll(fds, count, completions > 0 ? 0 : timeout_ms) < 0) {
+        if (errno == EINTR) {
+            return completions;
+        }
+        // Fail everything so no caller is left waiting on a request that cannot progress
+        for (nfds_t i = 0; i < count; i++) {
+            connection_fail(polled[i]);
+        }
+        return -1;
+    }
+
+    for (nfds_t i = 0; i < count; i++) {
+        NetConnection* conn = polled[i];
+        short revents = fds[i].revents;
+        if (revents == 0) {
+            continue;
+        }
+
+        if (conn->connecting) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+                completions += connection_fail(conn);
+                continue;
+            }
+            if (!(revents & POLLOUT)) {
+                continue;
+            }
+            conn->connecting = 0;
+        }
+
+        if ((revents & (POLLIN | POLLHUP | POLLERR)) && connection_read(client, conn, &completions) != 0) {
+            completions += connection_fail(conn);
+            continue;
+        }
+        if (connection_flush(client, conn) != 0) {
+            completions += connection_fail(conn);
+        }
+    }
+
+    return completions;
+}
+
+int net_client_wait_all(NetClient* client) {
+    while (net_client_in_flight(client) > 0) {
+        if (net_client_poll(client, -1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void call_callback(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    CallWaiter* waiter = (CallWaiter*)user_data;
+    waiter->done = 1;
+    waiter->status = status;
+    if (status != 0) {
+        return;
+    }
+
+    uint32_t copy_len = header->payload_length < waiter->capacity ? header->payload_length : waiter->capacity;
+    *waiter->header = *header;
+    memcpy(waiter->payload, payload, copy_len);
+    *waiter->length = copy_len;
+}
+
+int net_client_call(NetClient* client, uint16_t type, const uint8_t* payload, uint32_t payload_len,
+    PacketHeader* resp_header, uint8_t* resp_payload, uint32_t resp_capacity, uint32_t* resp_len) {
+    CallWaiter waiter;
+    waiter.done = 0;
+    waiter.status = -1;
+    waiter.header = resp_header;
+    waiter.payload = resp_payload;
+    waiter.capacity = resp_capacity;
+    waiter.length = resp_len;
+
+    if (net_client_submit(client, type, payload, payload_len, call_callback, &waiter) != 0) {
+        return -1;
+    }
+
+    while (!waiter.done) {
+        if (net_client_poll(client, -1) < 0) {
+            return -1;
+        }
+    }
+    return waiter.status;
+}
+
+void net_client_set_push_handler(NetClient* client, net_client_callback_t handler, void* user_data) {
+    client->push_handler = handler;
+    client->push_user_data = user_data;
+}
+
+void net_client_set_checksum(NetClient* client, int enabled) {
+    client->checksum = enabled != 0;
+}
+
+void net_client_set_compression(NetClient* client, uint32_t threshold) {
+    client->compress_threshold = threshold;
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        NetConnection* conn = &client->connections[i];
+        if (conn->fd < 0 || conn->failing) {
+            continue;
+        }
+        // Requests stop compressing at once; responses still in flight are inflated regardless
+        if (threshold == 0) {
+            conn->compress = 0;
+        }
+        request_features(client, conn);
+    }
+}
+
+void net_client_wire_bytes(const NetClient* client, uint64_t* sent, uint64_t* received) {
+    *sent = client->bytes_sent;
+    *received = client->bytes_received;
+}
+
+uint32_t net_client_in_flight(const NetClient* client) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        total += client->connections[i].in_flight;
+    }
+    return total;
+}
+
+void net_client_destroy(NetClient* client) {
+    if (client == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < client->connection_count; i++) {
+        NetConnection* conn = &client->connections[i];
+        connection_fail(conn);
+        free(conn->pending);
+        free(conn->out_buf);
+        free(conn->in_buf);
+    }
+
+    free(client->connections);
+    free(client);
+}
@@ -2,12 +2,14 @@
  * @file net_utils.c
  * @brief Implementation of common network utilities.
  */
+#define _GNU_SOURCE
 #include "common/net_utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 
 void die_with_error(const char* error_message) {
@@ -15,7 +17,8 @@ void die_with_error(const char* error_message) {
     exit(EXIT_FAILURE);
 }
 
-int setup_tcp_server_socket(const char* service) {
+// Resolves the wildcard address for the service and binds the first usable socket of the given type
+static int bind_server_socket(const char* service, int socktype) {
     struct addrinfo hints;
     struct addrinfo* servinfo;
     struct addrinfo* p;
@@ -25,7 +28,7 @@ int setup_tcp_server_socket(const char* service) {
 
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_socktype = socktype;
     hints.ai_flags = AI_PASSIVE;
 
     if ((rv = getaddrinfo(NULL, service, &hints, &servinfo)) != 0) {
@@ -56,9 +59,128 @@ int setup_tcp_server_socket(const char* service) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(serv_sock, 10) == -1) {
+    return serv_sock;
+}
+
+int setup_tcp_server_socket(const char* service) {
+    int serv_sock = bind_server_socket(service, SOCK_STREAM);
+
+    // Reconnect storms from many idle clients overflow a short accept queue; the kernel caps SOMAXCONN
+    if (listen(serv_sock, SOMAXCONN) == -1) {
         die_with_error("listen");
     }
 
     return serv_sock;
+}
+
+int setup_udp_server_socket(const char* service) {
+    return bind_server_socket(service, SOCK_DGRAM);
+}
+
+static int bind_unix_socket(const char* path, int socktype) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "unix socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+
+    int serv_sock = socket(AF_UNIX, socktype, 0);
+    if (serv_sock == -1) {
+        die_with_error("socket AF_UNIX");
+    }
+
+    // A stale socket file from a previous run would make bind fail with EADDRINUSE
+    unlink(path);
+
+    if (bind(serv_sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        die_with_error("bind AF_UNIX");
+    }
+
+    if (listen(serv_sock, SOMAXCONN) == -1) {
+        die_with_error("listen AF_UNIX");
+    }
+
+    return serv_sock;
+}
+
+int setup_unix_server_socket(const char* path) {
+    return bind_unix_socket(path, SOCK_STREAM);
+}
+
+int setup_unix_seqpacket_socket(const char* path) {
+    return bind_unix_socket(path, SOCK_SEQPACKET);
+}
+
+ssize_t send_with_fds(int sock, const void* data, size_t len, const int* fds, int fd_count) {
+    char control[CMSG_SPACE(sizeof(int) * NET_MAX_PASSED_FDS)];
+    struct iovec iov;
+    struct msghdr msg;
+
+    if (fd_count < 0 || fd_count > NET_MAX_PASSED_FDS) {
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void*)data;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (fd_count > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)fd_count);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)fd_count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)fd_count);
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+ssize_t recv_with_fds(int sock, void* data, size_t len, int* fds, int* fd_count) {
+    char control[CMSG_SPACE(sizeof(int) * NET_MAX_PASSED_FDS)];
+    struct iovec iov;
+    struct msghdr msg;
+    int capacity = *fd_count;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = data;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    *fd_count = 0;
+    ssize_t received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (received <= 0) {
+        return received;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+        int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + sizeof(int) * (size_t)i, sizeof(int));
+            // Descriptors beyond the caller's capacity would leak, so close them here
+            if (*fd_count < capacity) {
+                fds[(*fd_count)++] = fd;
+            }
+            else {
+                close(fd);
+            }
+        }
+    }
+
+    return received;
 }
\ No newline at end of file
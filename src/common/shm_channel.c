@@ -0,0 +1,237 @@
+/**
+ * @file shm_channel.c
+ * @brief Implementation of the shared-memory SPSC frame rings and their eventfd doorbells.
+ */
+#define _GNU_SOURCE
+#include "common/shm_channel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ring_capacity;
+    uint8_t reserved[56];
+} ShmChannelHeader;
+
+static size_t ring_footprint(uint32_t capacity) {
+    return sizeof(ShmRingControl) + capacity;
+}
+
+static size_t channel_size(uint32_t capacity) {
+    return sizeof(ShmChannelHeader) + 2 * ring_footprint(capacity);
+}
+
+static void map_rings(ShmChannel* channel, uint32_t capacity) {
+    uint8_t* base = (uint8_t*)channel->base;
+    channel->requests.control = (ShmRingControl*)(base + sizeof(ShmChannelHeader));
+    channel->requests.capacity = capacity;
+    channel->responses.control = (ShmRingControl*)(base + sizeof(ShmChannelHeader) + ring_footprint(capacity));
+    channel->responses.capacity = capacity;
+}
+
+static void init_ring(ShmRing* ring) {
+    atomic_init(&ring->control->head, 0);
+    atomic_init(&ring->control->tail, 0);
+    atomic_init(&ring->control->consumer_sleeping, 0);
+}
+
+// Copies into the ring at a logical position, splitting the copy at the wrap point
+static void ring_copy_in(ShmRing* ring, uint64_t pos, const uint8_t* src, uint32_t len) {
+    uint32_t offset = (uint32_t)(pos & (ring->capacity - 1));
+    uint32_t first = ring->capacity - offset;
+    if (first > len) first = len;
+    memcpy(ring->control->data + offset, src, first);
+    memcpy(ring->control->data, src + first, len - first);
+}
+
+static void ring_copy_out(const ShmRing* ring, uint64_t pos, uint8_t* dst, uint32_t len) {
+    uint32_t offset = (uint32_t)(pos & (ring->capacity - 1));
+    uint32_t first = ring->capacity - offset;
+    if (first > len) first = len;
+    memcpy(dst, ring->control->data + offset, first);
+    memcpy(dst + first, ring->control->data, len - first);
+}
+
+int shm_channel_create(ShmChannel* channel, uint32_t ring_capacity) {
+    memset(channel, 0, sizeof(*channel));
+    channel->memfd = -1;
+    channel->server_doorbell = -1;
+    channel->client_doorbell = -1;
+
+    if (ring_capacity == 0 || (ring_capacity & (ring_capacity - 1)) != 0) {
+        return -1;
+    }
+
+    channel->size = channel_size(ring_capacity);
+    channel->memfd = memfd_create("network_server_shm", MFD_CLOEXEC);
+    if (channel->memfd == -1 || ftruncate(channel->memfd, (off_t)channel->size) == -1) {
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    channel->base = mmap(NULL, channel->size, PROT_READ | PROT_WRITE, MAP_SHARED, channel->memfd, 0);
+    if (channel->base == MAP_FAILED) {
+        channel->base = NULL;
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    ShmChannelHeader* header = (ShmChannelHeader*)channel->base;
+    header->magic = SHM_CHANNEL_MAGIC;
+    header->ring_capacity = ring_capacity;
+
+    map_rings(channel, ring_capacity);
+    init_ring(&channel->requests);
+    init_ring(&channel->responses);
+
+    // The server polls its doorbell from epoll; the client blocks on its own
+    channel->server_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    channel->client_doorbell = eventfd(0, EFD_CLOEXEC);
+    if (channel->server_doorbell == -1 || channel->client_doorbell == -1) {
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    return 0;
+}
+
+int shm_channel_attach(ShmChannel* channel, int memfd, int server_doorbell, int client_doorbell) {
+    memset(channel, 0, sizeof(*channel));
+    channel->memfd = memfd;
+    channel->server_doorbell = server_doorbell;
+    channel->client_doorbell = client_doorbell;
+
+    struct stat st;
+    if (fstat(memfd, &st) == -1 || (size_t)st.st_size < sizeof(ShmChannelHeader)) {
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    channel->size = (size_t)st.st_size;
+    channel->base = mmap(NULL, channel->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (channel->base == MAP_FAILED) {
+        channel->base = NULL;
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    const ShmChannelHeader* header = (const ShmChannelHeader*)channel->base;
+    uint32_t capacity = header->ring_capacity;
+    if (header->magic != SHM_CHANNEL_MAGIC || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        channel_size(capacity) != channel->size) {
+        shm_channel_destroy(channel);
+        return -1;
+    }
+
+    map_rings(channel, capacity);
+    return 0;
+}
+
+void shm_channel_destroy(ShmChannel* channel) {
+    if (channel->base != NULL) {
+        munmap(channel->base, channel->size);
+        channel->base = NULL;
+    }
+    if (channel->memfd != -1) close(channel->memfd);
+    if (channel->server_doorbell != -1) close(channel->server_doorbell);
+    if (channel->client_doorbell != -1) close(channel->client_doorbell);
+    channel->memfd = -1;
+    channel->server_doorbell = -1;
+    channel->client_doorbell = -1;
+}
+
+uint32_t shm_ring_free_space(ShmRing* ring) {
+    uint64_t head = atomic_load_explicit(&ring->control->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&ring->control->tail, memory_order_relaxed);
+    return ring->capacity - (uint32_t)(tail - head);
+}
+
+int shm_ring_has_data(ShmRing* ring) {
+    uint64_t tail = atomic_load_explicit(&ring->control->tail, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&ring->control->head, memory_order_relaxed);
+    return tail != head;
+}
+
+int shm_ring_write(ShmRing* ring, const PacketHeader* header, const uint8_t* payload) {
+    uint32_t frame_len = (uint32_t)sizeof(PacketHeader) + header->payload_length;
+    if (shm_ring_free_space(ring) < frame_len) {
+        return -1;
+    }
+
+    uint64_t tail = atomic_load_explicit(&ring->control->tail, memory_order_relaxed);
+    uint8_t header_buf[sizeof(PacketHeader)];
+    serialize_header(header, header_buf);
+
+    ring_copy_in(ring, tail, header_buf, sizeof(header_buf));
+    if (header->payload_length > 0 && payload != NULL) {
+        ring_copy_in(ring, tail + sizeof(header_buf), payload, header->payload_length);
+    }
+
+    atomic_store_explicit(&ring->control->tail, tail + frame_len, memory_order_release);
+    return 0;
+}
+
+uint32_t shm_ring_read(ShmRing* ring, uint8_t* out, uint32_t capacity) {
+    uint64_t head = atomic_load_explicit(&ring->control->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->control->tail, memory_order_acquire);
+    uint64_t available = tail - head;
+
+    if (available == 0) {
+        return 0;
+    }
+
+    // The peer controls this memory: validate every length before trusting it
+    if (available < sizeof(PacketHeader) || available > ring->capacity || capacity < sizeof(PacketHeader)) {
+        return SHM_RING_CORRUPT;
+    }
+
+    PacketHeader header;
+    ring_copy_out(ring, head, out, sizeof(PacketHeader));
+    deserialize_header(out, &header);
+
+    uint64_t frame_len = sizeof(PacketHeader) + (uint64_t)header.payload_length;
+    if (frame_len > available || frame_len > capacity) {
+        return SHM_RING_CORRUPT;
+    }
+
+    ring_copy_out(ring, head + sizeof(PacketHeader), out + sizeof(PacketHeader), header.payload_length);
+    atomic_store_explicit(&ring->control->head, head + frame_len, memory_order_release);
+    return (uint32_t)frame_len;
+}
+
+int shm_ring_needs_doorbell(ShmRing* ring) {
+    // Pairs with the fence in shm_ring_prepare_sleep so either side observes the other's store
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&ring->control->consumer_sleeping, memory_order_relaxed) != 0;
+}
+
+int shm_ring_prepare_sleep(ShmRing* ring) {
+    atomic_store_explicit(&ring->control->consumer_sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (shm_ring_has_data(ring)) {
+        atomic_store_explicit(&ring->control->consumer_sleeping, 0, memory_order_relaxed);
+        return 0;
+    }
+    return 1;
+}
+
+void shm_ring_clear_sleep(ShmRing* ring) {
+    atomic_store_explicit(&ring->control->consumer_sleeping, 0, memory_order_relaxed);
+}
+
+void shm_doorbell_ring(int doorbell_fd) {
+    uint64_t one = 1;
+    ssize_t rc = write(doorbell_fd, &one, sizeof(one));
+    (void)rc;
+}
+
+void shm_doorbell_drain(int doorbell_fd) {
+    uint64_t value;
+    ssize_t rc = read(doorbell_fd, &value, sizeof(value));
+    (void)rc;
+}
@@ -5,16 +5,151 @@
 #include "server/epoll_server.h"
 #include "common/logger.h"
 #include "server/signal_handler.h"
+#include "protocol/lz.h"
+#include "server/arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// "frames_per_sec:bytes_per_sec", either may be 0 for unlimited
+static int parse_rate_limit(const char* text, RateLimit* limit) {
+    char* end = NULL;
+    limit->frames_per_sec = (uint32_t)strtoul(text, &end, 10);
+    if (end == text || *end != ':') {
+        return -1;
+    }
+    const char* bytes = end + 1;
+    limit->bytes_per_sec = (uint32_t)strtoul(bytes, &end, 10);
+    return (end == bytes || *end != '\0') ? -1 : 0;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-u unix_socket_path] [-r restart_socket_path [-m]] "
+        "[-t trace_sample_every [-o trace_path]] [-s strict|weighted] [-e min_workers:max_workers] [-z zerocopy_threshold] [-x compress_threshold] [-a arena_mb] [-c capture_path] [-f types@host:port[,host:port...]]... "
+        "[-l conn_frames:conn_bytes] [-i source_frames:source_bytes] [-R delay|reject] [port]\n", program);
+}
 
 int main(int argc, char* argv[]) {
-    const char* port = "8080";
-    if (argc > 1) {
-        port = argv[1];
+    ServerConfig config;
+    config.port = "8080";
+    config.unix_path = NULL;
+    config.restart_path = NULL;
+    config.migrate_connections = 0;
+    config.trace_sample_every = 0;
+    config.trace_path = "network_server_trace.json";
+    config.pool_schedule = THREAD_POOL_WEIGHTED;
+    config.pool_min_threads = 0;
+    config.pool_max_threads = 0;
+    config.zerocopy_threshold = 0;
+    config.compress_threshold = LZ_DEFAULT_THRESHOLD;
+    config.arena_mb = ARENA_DEFAULT_MB;
+    config.capture_path = NULL;
+    config.upstream_route_count = 0;
+    memset(&config.connection_limit, 0, sizeof(config.connection_limit));
+    memset(&config.source_limit, 0, sizeof(config.source_limit));
+    config.limit_policy = RATE_LIMIT_DELAY;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:r:mt:o:s:e:z:x:a:c:f:l:i:R:")) != -1) {
+        switch (opt) {
+        case 'u':
+            config.unix_path = optarg;
+            break;
+        case 'r':
+            config.restart_path = optarg;
+            break;
+        case 'm':
+            config.migrate_connections = 1;
+            break;
+        case 't':
+            config.trace_sample_every = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            config.trace_path = optarg;
+            break;
+        case 's':
+            if (strcmp(optarg, "strict") == 0) {
+                config.pool_schedule = THREAD_POOL_STRICT;
+            }
+            else if (strcmp(optarg, "weighted") == 0) {
+                config.pool_schedule = THREAD_POOL_WEIGHTED;
+            }
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'e': {
+            char* end = NULL;
+            config.pool_min_threads = (uint32_t)strtoul(optarg, &end, 10);
+            if (end == optarg || *end != ':' || config.pool_min_threads == 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            config.pool_max_threads = (uint32_t)strtoul(end + 1, NULL, 10);
+            if (config.pool_max_threads < config.pool_min_threads) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case 'z':
+            config.zerocopy_threshold = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'x':
+            config.compress_threshold = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            config.arena_mb = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            config.capture_path = optarg;
+            break;
+        case 'f':
+            if (config.upstream_route_count == UPSTREAM_MAX_ROUTES) {
+                fprintf(stderr, "At most %d forwarding routes are supported.\n", UPSTREAM_MAX_ROUTES);
+                return 1;
+            }
+            config.upstream_routes[config.upstream_route_count++] = optarg;
+            break;
+        case 'l':
+            if (parse_rate_limit(optarg, &config.connection_limit) != 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'i':
+            if (parse_rate_limit(optarg, &config.source_limit) != 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'R':
+            if (strcmp(optarg, "delay") == 0) {
+                config.limit_policy = RATE_LIMIT_DELAY;
+            }
+            else if (strcmp(optarg, "reject") == 0) {
+                config.limit_policy = RATE_LIMIT_REJECT;
+            }
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        config.port = argv[optind];
     }
 
     logger_init(LOG_LEVEL_INFO);
     setup_signal_handlers();
-    start_epoll_server(port);
+    start_epoll_server(&config);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,222 @@
+/**
+ * @file lz.c
+ * @brief Implementation of the LZ77 block codec and the compressed-payload encoding.
+ */
+#include "protocol/lz.h"
+#include "protocol/protocol.h"
+#include <string.h>
+#include <arpa/inet.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+// Incompressible input is skipped faster the longer it has gone without a match
+#define LZ_SKIP_SHIFT 5
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* put_length(uint8_t* op, uint32_t remainder) {
+    while (remainder >= 255) {
+        *op++ = 255;
+        remainder -= 255;
+    }
+    *op++ = (uint8_t)remainder;
+    return op;
+}
+
+// match_len 0 writes the closing literal-only sequence
+static uint8_t* emit_sequence(uint8_t* op, const uint8_t* oend, const uint8_t* literals, uint32_t literal_len,
+    uint32_t offset, uint32_t match_len) {
+    uint32_t extra = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+    size_t worst = 1 + (size_t)literal_len + literal_len / 255 + 1 + (match_len > 0 ? 2 + extra / 255 + 1 : 0);
+    if ((size_t)(oend - op) < worst) {
+        return NULL;
+    }
+
+    uint8_t* token = op++;
+    *token = (uint8_t)(((literal_len < 15 ? literal_len : 15) << 4) | (extra < 15 ? extra : 15));
+    if (literal_len >= 15) {
+        op = put_length(op, literal_len - 15);
+    }
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len > 0) {
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        if (extra >= 15) {
+            op = put_length(op, extra - 15);
+        }
+    }
+    return op;
+}
+
+uint32_t lz_compress(const uint8_t* input, uint32_t length, uint8_t* output, uint32_t capacity) {
+    if (length > LZ_MAX_INPUT) {
+        return 0;
+    }
+
+    // Positions fit in 16 bits; stale or colliding entries are caught by the byte comparison
+    uint16_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t* ip = input;
+    const uint8_t* anchor = input;
+    const uint8_t* end = input + length;
+    uint8_t* op = output;
+    const uint8_t* oend = output + capacity;
+
+    while (end - ip >= LZ_MIN_MATCH) {
+        uint32_t sequence = read32(ip);
+        uint32_t h = hash32(sequence);
+        const uint8_t* candidate = input + table[h];
+        table[h] = (uint16_t)(ip - input);
+
+        if (candidate >= ip || read32(candidate) != sequence) {
+            ip += 1 + ((uint32_t)(ip - anchor) >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        const uint8_t* match_end = ip + LZ_MIN_MATCH;
+        const uint8_t* reference = candidate + LZ_MIN_MATCH;
+        while (match_end < end && *match_end == *reference) {
+            match_end++;
+            reference++;
+        }
+        while (ip > anchor && candidate > input && ip[-1] == candidate[-1]) {
+            ip--;
+            candidate--;
+        }
+
+        op = emit_sequence(op, oend, anchor, (uint32_t)(ip - anchor), (uint32_t)(ip - candidate),
+            (uint32_t)(match_end - ip));
+        if (op == NULL) {
+            return 0;
+        }
+        ip = match_end;
+        anchor = ip;
+    }
+
+    op = emit_sequence(op, oend, anchor, (uint32_t)(end - anchor), 0, 0);
+    return op != NULL ? (uint32_t)(op - output) : 0;
+}
+
+static int read_length(const uint8_t** ip, const uint8_t* iend, uint32_t* length) {
+    uint8_t byte;
+    do {
+        if (*ip == iend) {
+            return -1;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+        if (*length > LZ_MAX_INPUT) {
+            return -1;
+        }
+    } while (byte == 255);
+    return 0;
+}
+
+int32_t lz_decompress(const uint8_t* input, uint32_t length, uint8_t* output, uint32_t capacity) {
+    const uint8_t* ip = input;
+    const uint8_t* iend = input + length;
+    uint8_t* op = output;
+    uint8_t* oend = output + capacity;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+
+        uint32_t literal_len = token >> 4;
+        if (literal_len == 15 && read_length(&ip, iend, &literal_len) != 0) {
+            return -1;
+        }
+        if ((size_t)(iend - ip) < literal_len || (size_t)(oend - op) < literal_len) {
+            return -1;
+        }
+        memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        // Only the closing sequence ends right after its literals
+        if (ip == iend) {
+            break;
+        }
+        if (iend - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - output)) {
+            return -1;
+        }
+
+        uint32_t match_len = token & 15;
+        if (match_len == 15 && read_length(&ip, iend, &match_len) != 0) {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < match_len) {
+            return -1;
+        }
+
+        const uint8_t* reference = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, reference, match_len);
+        }
+        else {
+            // Overlapping copies repeat the last offset bytes, so they must go forward one at a time
+            for (uint32_t i = 0; i < match_len; i++) {
+                op[i] = reference[i];
+            }
+        }
+        op += match_len;
+    }
+
+    return (int32_t)(op - output);
+}
+
+uint32_t lz_compress_payload(const uint8_t* payload, uint32_t payload_len, uint8_t* output, uint32_t capacity) {
+    if (payload_len > LZ_MAX_INPUT || payload_len <= PACKET_COMPRESSED_PREFIX_SIZE + 1) {
+        return 0;
+    }
+
+    // Anything not smaller than the original would only cost the peer a decode
+    uint32_t limit = payload_len - 1 < capacity ? payload_len - 1 : capacity;
+    if (limit <= PACKET_COMPRESSED_PREFIX_SIZE) {
+        return 0;
+    }
+
+    uint32_t block_len = lz_compress(payload, payload_len, output + PACKET_COMPRESSED_PREFIX_SIZE,
+        limit - PACKET_COMPRESSED_PREFIX_SIZE);
+    if (block_len == 0) {
+        return 0;
+    }
+
+    uint16_t net_len = htons((uint16_t)payload_len);
+    memcpy(output, &net_len, sizeof(net_len));
+    return PACKET_COMPRESSED_PREFIX_SIZE + block_len;
+}
+
+int32_t lz_decompress_payload(const uint8_t* encoded, uint32_t encoded_len, uint8_t* output, uint32_t capacity) {
+    if (encoded_len < PACKET_COMPRESSED_PREFIX_SIZE) {
+        return -1;
+    }
+
+    uint16_t net_len;
+    memcpy(&net_len, encoded, sizeof(net_len));
+    uint32_t original_len = ntohs(net_len);
+    if (original_len > capacity) {
+        return -1;
+    }
+
+    int32_t decoded = lz_decompress(encoded + PACKET_COMPRESSED_PREFIX_SIZE, encoded_len - PACKET_COMPRESSED_PREFIX_SIZE,
+        output, original_len);
+    return decoded == (int32_t)original_len ? decoded : -1;
+}
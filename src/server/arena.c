@@ -0,0 +1,232 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the prefaulted arena with huge-page backing and its block pools.
+ */
+#define _GNU_SOURCE
+#include "server/arena.h"
+#include "common/logger.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static uint8_t* arena_base = NULL;
+static size_t arena_size = 0;
+static size_t arena_used = 0;
+static ArenaBacking backing = ARENA_BACKING_NONE;
+
+static ArenaPool* pools[ARENA_MAX_POOLS];
+static uint32_t pool_count = 0;
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Writing one byte per page faults it in; huge pages are faulted whole on the first write
+static void touch_pages(uint8_t* base, size_t length) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < length; offset += page) {
+        ((volatile uint8_t*)base)[offset] = 0;
+    }
+}
+
+// Explicit huge pages only exist if the administrator reserved them, so failure here is normal
+static int map_hugetlb(size_t length) {
+#ifdef MAP_HUGETLB
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (base != MAP_FAILED) {
+        arena_base = (uint8_t*)base;
+        backing = ARENA_BACKING_HUGETLB;
+        return 0;
+    }
+    LOG_DEBUG("MAP_HUGETLB arena unavailable: %s", strerror(errno));
+#else
+    (void)length;
+#endif
+    return -1;
+}
+
+// Transparent huge pages need a 2 MiB aligned range, so map one huge page extra and trim it
+static int map_transparent(size_t length) {
+    size_t span = length + ARENA_HUGE_PAGE_SIZE;
+    uint8_t* raw = (uint8_t*)mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return -1;
+    }
+
+    uint8_t* aligned = (uint8_t*)round_up((size_t)raw, ARENA_HUGE_PAGE_SIZE);
+    if (aligned > raw) {
+        munmap(raw, (size_t)(aligned - raw));
+    }
+    size_t tail = (size_t)(raw + span - (aligned + length));
+    if (tail > 0) {
+        munmap(aligned + length, tail);
+    }
+
+    backing = ARENA_BACKING_SMALL_PAGES;
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, length, MADV_HUGEPAGE) == 0) {
+        backing = ARENA_BACKING_THP;
+    }
+#endif
+
+    // MAP_POPULATE would fault before the hint applies, so the range is populated afterwards
+    int populated = 0;
+#ifdef MADV_POPULATE_WRITE
+    populated = madvise(aligned, length, MADV_POPULATE_WRITE) == 0;
+#endif
+    if (!populated) {
+        touch_pages(aligned, length);
+    }
+
+    arena_base = aligned;
+    return 0;
+}
+
+int arena_init(size_t bytes) {
+    if (bytes == 0) {
+        return 0;
+    }
+
+    size_t length = round_up(bytes, ARENA_HUGE_PAGE_SIZE);
+    if (map_hugetlb(length) != 0 && map_transparent(length) != 0) {
+        LOG_WARN("Failed to map a %zu KiB buffer arena: %s; using the allocator.", length / 1024, strerror(errno));
+        backing = ARENA_BACKING_NONE;
+        return -1;
+    }
+
+    arena_size = length;
+    arena_used = 0;
+    return 0;
+}
+
+ArenaBacking arena_backing(void) {
+    return backing;
+}
+
+const char* arena_backing_name(ArenaBacking kind) {
+    switch (kind) {
+    case ARENA_BACKING_HUGETLB:
+        return "explicit huge pages";
+    case ARENA_BACKING_THP:
+        return "transparent huge pages";
+    case ARENA_BACKING_SMALL_PAGES:
+        return "base pages";
+    default:
+        return "the allocator";
+    }
+}
+
+void* arena_reserve(size_t bytes) {
+    if (arena_base == NULL) {
+        return NULL;
+    }
+
+    size_t offset = round_up(arena_used, ARENA_ALIGNMENT);
+    if (offset > arena_size || bytes > arena_size - offset) {
+        return NULL;
+    }
+    arena_used = offset + bytes;
+    return arena_base + offset;
+}
+
+int arena_contains(const void* pointer) {
+    const uint8_t* p = (const uint8_t*)pointer;
+    return arena_base != NULL && p >= arena_base && p < arena_base + arena_size;
+}
+
+uint32_t arena_pool_init(ArenaPool* pool, const char* name, size_t block_size, uint32_t count) {
+    memset(pool, 0, sizeof(ArenaPool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->name = name;
+    pool->block_size = round_up(block_size < sizeof(void*) ? sizeof(void*) : block_size, ARENA_ALIGNMENT);
+
+    // Whatever is left decides how many blocks fit; later pools may get fewer than they asked for
+    size_t offset = round_up(arena_used, ARENA_ALIGNMENT);
+    size_t room = (arena_base != NULL && offset < arena_size) ? arena_size - offset : 0;
+    if ((size_t)count > room / pool->block_size) {
+        count = (uint32_t)(room / pool->block_size);
+    }
+
+    uint8_t* blocks = count > 0 ? (uint8_t*)arena_reserve(pool->block_size * count) : NULL;
+    if (blocks == NULL) {
+        count = 0;
+    }
+    // Threaded in reverse so the first blocks handed out are the lowest addresses
+    for (uint32_t i = count; i-- > 0;) {
+        void* block = blocks + (size_t)i * pool->block_size;
+        *(void**)block = pool->free_list;
+        pool->free_list = block;
+    }
+    pool->blocks = count;
+    pool->available = count;
+    pool->low_water = count;
+
+    if (pool_count < ARENA_MAX_POOLS) {
+        pools[pool_count++] = pool;
+    }
+    return count;
+}
+
+void* arena_pool_get(ArenaPool* pool) {
+    // Without an arena every caller uses the allocator, and nothing is worth taking a lock for
+    if (pool->blocks == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    void* block = pool->free_list;
+    if (block != NULL) {
+        pool->free_list = *(void**)block;
+        pool->available--;
+        if (pool->available < pool->low_water) {
+            pool->low_water = pool->available;
+        }
+    }
+    else {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+void arena_pool_put(ArenaPool* pool, void* block) {
+    pthread_mutex_lock(&pool->lock);
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+    pool->available++;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void arena_log_stats(void) {
+    if (arena_base == NULL) {
+        return;
+    }
+
+    LOG_INFO("Buffer arena: %zu of %zu KiB carved, on %s.", arena_used / 1024, arena_size / 1024,
+        arena_backing_name(backing));
+    for (uint32_t i = 0; i < pool_count; i++) {
+        ArenaPool* pool = pools[i];
+        pthread_mutex_lock(&pool->lock);
+        LOG_INFO("Arena pool %s: %u blocks of %zu bytes, at most %u in use, %llu fell back to the allocator.",
+            pool->name, pool->blocks, pool->block_size, pool->blocks - pool->low_water,
+            (unsigned long long)pool->misses);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void arena_shutdown(void) {
+    for (uint32_t i = 0; i < pool_count; i++) {
+        pthread_mutex_destroy(&pools[i]->lock);
+    }
+    pool_count = 0;
+
+    if (arena_base != NULL) {
+        munmap(arena_base, arena_size);
+    }
+    arena_base = NULL;
+    arena_size = 0;
+    arena_used = 0;
+    backing = ARENA_BACKING_NONE;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file capture.c
+ * @brief Implementation of the traffic recorder: reactor-side batching and a writer thread appending to a mapped file.
+ */
+#include "server/capture.h"
+#include "protocol/protocol.h"
+#include "common/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/mman.h>
+
+typedef struct CaptureBatch {
+    struct CaptureBatch* next;
+    uint32_t used;
+    uint32_t records;
+    uint8_t data[CAPTURE_BATCH_BYTES];
+} CaptureBatch;
+
+static const char* capture_path = NULL;
+static int capture_fd = -1;
+static uint64_t start_nanos = 0;
+static _Atomic uint64_t dropped_records = 0;
+
+// Writer-owned once the capture is open
+static uint8_t* mapping = NULL;
+static uint64_t mapped_bytes = 0;
+static int grow_failed = 0;
+
+// Reactor-owned
+static CaptureBatch* staging = NULL;
+static uint64_t staging_since = 0;
+
+// Batch handoff between the reactor and the writer
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static CaptureBatch* full_head = NULL;
+static CaptureBatch* full_tail = NULL;
+static CaptureBatch* free_batches = NULL;
+static uint32_t batch_count = 0;
+static int stopping = 0;
+static pthread_t writer_thread;
+
+static uint64_t monotonic_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t realtime_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Reuses a drained batch, or allocates one while fewer than CAPTURE_MAX_BATCHES exist
+static CaptureBatch* take_free_batch(void) {
+    int allocate = 0;
+    pthread_mutex_lock(&queue_lock);
+    CaptureBatch* batch = free_batches;
+    if (batch != NULL) {
+        free_batches = batch->next;
+    }
+    else if (batch_count < CAPTURE_MAX_BATCHES) {
+        batch_count++;
+        allocate = 1;
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    // At the cap the caller drops the frame rather than letting capture memory grow
+    if (!allocate) {
+        return batch;
+    }
+
+    batch = (CaptureBatch*)malloc(sizeof(CaptureBatch));
+    if (batch == NULL) {
+        pthread_mutex_lock(&queue_lock);
+        batch_count--;
+        pthread_mutex_unlock(&queue_lock);
+    }
+    return batch;
+}
+
+static void submit_staging(void) {
+    staging->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (full_tail != NULL) {
+        full_tail->next = staging;
+    }
+    else {
+        full_head = staging;
+    }
+    full_tail = staging;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+
+    staging = NULL;
+}
+
+// Extends the file with real blocks before mapping it, so a full disk fails here instead of raising SIGBUS
+static int grow_mapping(uint64_t needed) {
+    uint64_t new_size = mapped_bytes;
+    while (new_size < needed) {
+        new_size += CAPTURE_GROW_BYTES;
+    }
+
+    int rc = posix_fallocate(capture_fd, (off_t)mapped_bytes, (off_t)(new_size - mapped_bytes));
+    if (rc != 0) {
+        LOG_ERROR("Capture file cannot grow to %llu bytes: %s", (unsigned long long)new_size, strerror(rc));
+        return -1;
+    }
+
+    uint8_t* grown = (uint8_t*)mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, capture_fd, 0);
+    if (grown == MAP_FAILED) {
+        LOG_ERROR("Capture file remap failed: %s", strerror(errno));
+        return -1;
+    }
+
+    munmap(mapping, mapped_bytes);
+    mapping = grown;
+    mapped_bytes = new_size;
+    return 0;
+}
+
+static void append_batch(const CaptureBatch* batch) {
+    CaptureFileHeader* header = (CaptureFileHeader*)mapping;
+    uint64_t offset = sizeof(CaptureFileHeader) + header->data_bytes;
+
+    if (grow_failed || (offset + batch->used > mapped_bytes && grow_mapping(offset + batch->used) != 0)) {
+        // Keep the file consistent up to what was written and count the rest as dropped
+        grow_failed = 1;
+        atomic_fetch_add(&dropped_records, batch->records);
+        return;
+    }
+
+    memcpy(mapping + offset, batch->data, batch->used);
+
+    header = (CaptureFileHeader*)mapping;
+    header->record_count += batch->records;
+    header->dropped_records = atomic_load(&dropped_records);
+    __atomic_store_n(&header->data_bytes, header->data_bytes + batch->used, __ATOMIC_RELEASE);
+}
+
+static void* capture_writer(void* arg) {
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (full_head == NULL && !stopping) {
+            pthread_cond_wait(&queue_ready, &queue_lock);
+        }
+
+        CaptureBatch* batch = full_head;
+        if (batch == NULL) {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+        full_head = batch->next;
+        if (full_head == NULL) {
+            full_tail = NULL;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        append_batch(batch);
+
+        pthread_mutex_lock(&queue_lock);
+        batch->next = free_batches;
+        free_batches = batch;
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    return NULL;
+}
+
+int capture_open(const char* path) {
+    capture_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (capture_fd == -1) {
+        LOG_ERROR("Failed to create capture file %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    mapped_bytes = 0;
+    if (grow_mapping(CAPTURE_GROW_BYTES) != 0) {
+        close(capture_fd);
+        capture_fd = -1;
+        return -1;
+    }
+
+    CaptureFileHeader* header = (CaptureFileHeader*)mapping;
+    memset(header, 0, sizeof(*header));
+    header->magic = CAPTURE_MAGIC;
+    header->version = CAPTURE_FORMAT_VERSION;
+    header->start_realtime_ns = realtime_nanos();
+    start_nanos = monotonic_nanos();
+    capture_path = path;
+
+    // Like the pool workers, the writer must never be the thread a process signal lands on
+    sigset_t blocked;
+    sigset_t previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int rc = pthread_create(&writer_thread, NULL, capture_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (rc != 0) {
+        munmap(mapping, mapped_bytes);
+        mapping = NULL;
+        close(capture_fd);
+        capture_fd = -1;
+        return -1;
+    }
+
+    LOG_INFO("Capturing received stream frames to %s.", path);
+    return 0;
+}
+
+void capture_frame(uint64_t connection, const uint8_t* header, const uint8_t* payload, uint32_t payload_len) {
+    if (capture_fd == -1) {
+        return;
+    }
+
+    uint32_t frame_length = (uint32_t)sizeof(PacketHeader) + payload_len;
+    uint64_t record_size = capture_record_size(frame_length);
+    uint64_t now = monotonic_nanos();
+
+    if (staging != NULL && staging->used + record_size > CAPTURE_BATCH_BYTES) {
+        submit_staging();
+    }
+    if (staging == NULL) {
+        staging = take_free_batch();
+        if (staging == NULL) {
+            atomic_fetch_add(&dropped_records, 1);
+            return;
+        }
+        staging->used = 0;
+        staging->records = 0;
+        staging_since = now;
+    }
+
+    uint8_t* cursor = staging->data + staging->used;
+    CaptureRecord record;
+    record.timestamp_ns = now - start_nanos;
+    record.connection = connection;
+    record.frame_length = frame_length;
+    record.reserved = 0;
+
+    memcpy(cursor, &record, sizeof(record));
+    memcpy(cursor + sizeof(record), header, sizeof(PacketHeader));
+    if (payload_len > 0) {
+        memcpy(cursor + sizeof(record) + sizeof(PacketHeader), payload, payload_len);
+    }
+    memset(cursor + sizeof(record) + frame_length, 0, record_size - sizeof(record) - frame_length);
+
+    staging->used += (uint32_t)record_size;
+    staging->records++;
+}
+
+int capture_poll(void) {
+    if (staging == NULL || staging->records == 0) {
+        return -1;
+    }
+
+    uint64_t waited_ms = (monotonic_nanos() - staging_since) / 1000000ull;
+    if (waited_ms >= CAPTURE_FLUSH_INTERVAL_MS) {
+        submit_staging();
+        return -1;
+    }
+    return (int)(CAPTURE_FLUSH_INTERVAL_MS - waited_ms);
+}
+
+void capture_close(void) {
+    if (capture_fd == -1) {
+        return;
+    }
+
+    if (staging != NULL && staging->records > 0) {
+        submit_staging();
+    }
+    else if (staging != NULL) {
+        free(staging);
+        staging = NULL;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_thread, NULL);
+
+    CaptureFileHeader* header = (CaptureFileHeader*)mapping;
+    header->dropped_records = atomic_load(&dropped_records);
+    uint64_t records = header->record_count;
+    uint64_t valid_bytes = sizeof(CaptureFileHeader) + header->data_bytes;
+
+    munmap(mapping, mapped_bytes);
+    mapping = NULL;
+    if (ftruncate(capture_fd, (off_t)valid_bytes) != 0) {
+        LOG_WARN("Failed to trim capture file: %s", strerror(errno));
+    }
+    close(capture_fd);
+    capture_fd = -1;
+
+    while (free_batches != NULL) {
+        CaptureBatch* next = free_batches->next;
+        free(free_batches);
+        free_batches = next;
+    }
+
+    LOG_INFO("Capture: %llu frames (%llu bytes) written to %s, %llu dropped.",
+        (unsigned long long)records, (unsigned long long)valid_bytes, capture_path,
+        (unsigned long long)atomic_load(&dropped_records));
+}
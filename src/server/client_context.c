@@ -1,31 +1,95 @@
 /**
  * @file client_context.c
- * @brief Implementation of client context lifecycle management.
+ * @brief Implementation of client context lifecycle management and the pending-payload pool.
  */
 #include "server/client_context.h"
+#include "server/arena.h"
 #include <stdlib.h>
 #include <string.h>
 
+// Arena buffers always return to the list; only heap buffers count toward the retain limit
+static PendingPayload* free_payloads = NULL;
+static uint32_t free_payload_count = 0;
+
+PendingPayload* acquire_payload_buffer(void) {
+    PendingPayload* pending = free_payloads;
+    if (pending != NULL) {
+        free_payloads = pending->next_free;
+        if (!arena_contains(pending)) {
+            free_payload_count--;
+        }
+    }
+    else {
+        pending = (PendingPayload*)malloc(sizeof(PendingPayload));
+        if (pending == NULL) {
+            return NULL;
+        }
+    }
+
+    pending->bytes_read = 0;
+    return pending;
+}
+
+void release_payload_buffer(PendingPayload* pending) {
+    int in_arena = arena_contains(pending);
+    if (!in_arena && free_payload_count >= PENDING_PAYLOAD_POOL_RETAIN) {
+        free(pending);
+        return;
+    }
+    pending->next_free = free_payloads;
+    free_payloads = pending;
+    if (!in_arena) {
+        free_payload_count++;
+    }
+}
+
+uint32_t prefill_payload_pool(uint32_t count) {
+    // Halved until it fits, so a small arena still gets some
+    PendingPayload* buffers = NULL;
+    while (count > 0 && (buffers = (PendingPayload*)arena_reserve(sizeof(PendingPayload) * count)) == NULL) {
+        count /= 2;
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        buffers[i].next_free = free_payloads;
+        free_payloads = &buffers[i];
+    }
+    return count;
+}
+
+void drain_payload_pool(void) {
+    while (free_payloads != NULL) {
+        PendingPayload* pending = free_payloads;
+        free_payloads = pending->next_free;
+        if (!arena_contains(pending)) {
+            free(pending);
+        }
+    }
+    free_payload_count = 0;
+}
+
 void init_client_context(ClientContext* ctx, int fd) {
     memset(ctx, 0, sizeof(ClientContext));
     ctx->fd = fd;
     ctx->state = STATE_READING_HEADER;
 }
 
+int reserve_client_payload(ClientContext* ctx) {
+    if (ctx->pending != NULL) {
+        return 0;
+    }
+
+    ctx->pending = acquire_payload_buffer();
+    return ctx->pending != NULL ? 0 : -1;
+}
+
 void reset_client_context(ClientContext* ctx) {
-    if (ctx->payload_buffer != NULL) {
-        free(ctx->payload_buffer);
-        ctx->payload_buffer = NULL;
+    if (ctx->pending != NULL) {
+        release_payload_buffer(ctx->pending);
+        ctx->pending = NULL;
     }
 
     ctx->state = STATE_READING_HEADER;
     ctx->header_bytes_read = 0;
-    ctx->payload_bytes_read = 0;
-    ctx->expected_payload_length = 0;
     // We do not reset fd, as the connection is still active
     memset(ctx->header_buffer, 0, sizeof(ctx->header_buffer));
 }
-
-void free_client_context(ClientContext* ctx) {
-    reset_client_context(ctx);
-}
\ No newline at end of file
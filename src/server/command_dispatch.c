@@ -0,0 +1,171 @@
+/**
+ * @file command_dispatch.c
+ * @brief Implementation of the command set (ECHO, key-value, pub/sub) on top of pluggable response writers.
+ */
+#include "server/command_dispatch.h"
+#include "server/kv_store.h"
+#include "server/pubsub.h"
+#include "protocol/protocol.h"
+#include "common/logger.h"
+#include <stddef.h>
+#include <arpa/inet.h>
+
+#define KV_SHARD_COUNT 64
+#define KV_MEMORY_LIMIT (256UL * 1024 * 1024)
+#define PUBSUB_QUEUE_DEPTH 256
+#define PUBSUB_SLOW_POLICY PUBSUB_POLICY_DROP
+
+static KvStore* global_kv = NULL;
+static PubSub* global_pubsub = NULL;
+
+static void execute_kv_command(const CommandRequest* request, response_writer_t writer, void* context) {
+    uint8_t response[COMMAND_MAX_RESPONSE_PAYLOAD];
+    uint32_t response_len = KV_STATUS_SIZE;
+    int rc = -1;
+
+    switch (request->type) {
+    case PACKET_TYPE_KV_GET: {
+        uint32_t value_len = 0;
+        rc = kv_store_get(global_kv, request->payload, request->payload_len, response + KV_STATUS_SIZE, MAX_PAYLOAD_SIZE, &value_len);
+        response_len += value_len;
+        response[0] = (rc == 0) ? KV_STATUS_OK : KV_STATUS_NOT_FOUND;
+        break;
+    }
+    case PACKET_TYPE_KV_SET: {
+        if (request->payload_len < KV_KEY_LENGTH_SIZE) {
+            response[0] = KV_STATUS_ERROR;
+            break;
+        }
+
+        uint32_t key_len = ((uint32_t)request->payload[0] << 8) | request->payload[1];
+        if (key_len > request->payload_len - KV_KEY_LENGTH_SIZE) {
+            response[0] = KV_STATUS_ERROR;
+            break;
+        }
+
+        const uint8_t* key = request->payload + KV_KEY_LENGTH_SIZE;
+        rc = kv_store_set(global_kv, key, key_len, key + key_len, request->payload_len - KV_KEY_LENGTH_SIZE - key_len);
+        response[0] = (rc == 0) ? KV_STATUS_OK : KV_STATUS_ERROR;
+        break;
+    }
+    case PACKET_TYPE_KV_DEL:
+        rc = kv_store_delete(global_kv, request->payload, request->payload_len);
+        response[0] = (rc == 0) ? KV_STATUS_OK : KV_STATUS_NOT_FOUND;
+        break;
+    default:
+        response[0] = KV_STATUS_ERROR;
+        break;
+    }
+
+    writer(context, request, request->type, response, response_len);
+}
+
+static void execute_pubsub_command(const CommandRequest* request, response_writer_t writer, void* context) {
+    switch (request->type) {
+    case PACKET_TYPE_SUBSCRIBE:
+        // Subscriptions need a stream to push to; datagram sources cannot subscribe
+        if (request->fd >= 0 &&
+            pubsub_subscribe(global_pubsub, request->fd, request->payload, request->payload_len) == 0) {
+            writer(context, request, PACKET_TYPE_ACK, NULL, 0);
+        }
+        else {
+            writer(context, request, PACKET_TYPE_ERROR, NULL, 0);
+        }
+        break;
+    case PACKET_TYPE_UNSUBSCRIBE:
+        if (request->fd >= 0 &&
+            pubsub_unsubscribe(global_pubsub, request->fd, request->payload, request->payload_len) == 0) {
+            writer(context, request, PACKET_TYPE_ACK, NULL, 0);
+        }
+        else {
+            writer(context, request, PACKET_TYPE_ERROR, NULL, 0);
+        }
+        break;
+    case PACKET_TYPE_PUBLISH: {
+        int delivered = -1;
+        if (request->payload_len >= PUBSUB_TOPIC_LENGTH_SIZE) {
+            uint32_t topic_len = ((uint32_t)request->payload[0] << 8) | request->payload[1];
+            if (topic_len <= request->payload_len - PUBSUB_TOPIC_LENGTH_SIZE) {
+                const uint8_t* topic = request->payload + PUBSUB_TOPIC_LENGTH_SIZE;
+                delivered = pubsub_publish(global_pubsub, topic, topic_len, topic + topic_len,
+                    request->payload_len - PUBSUB_TOPIC_LENGTH_SIZE - topic_len);
+            }
+        }
+
+        if (delivered < 0) {
+            writer(context, request, PACKET_TYPE_ERROR, NULL, 0);
+        }
+        else {
+            uint32_t net_delivered = htonl((uint32_t)delivered);
+            writer(context, request, PACKET_TYPE_ACK, (const uint8_t*)&net_delivered, sizeof(net_delivered));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int command_dispatch_init(void) {
+    global_kv = kv_store_create(KV_SHARD_COUNT, KV_MEMORY_LIMIT);
+    if (global_kv == NULL) {
+        return -1;
+    }
+
+    global_pubsub = pubsub_create(PUBSUB_QUEUE_DEPTH, PUBSUB_SLOW_POLICY);
+    if (global_pubsub == NULL) {
+        kv_store_destroy(global_kv);
+        global_kv = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void dispatch_command(const CommandRequest* request, response_writer_t writer, void* context) {
+    switch (request->type) {
+    case PACKET_TYPE_HEARTBEAT:
+        writer(context, request, PACKET_TYPE_HEARTBEAT, request->payload, request->payload_len);
+        break;
+    case CMD_ECHO:
+        LOG_DEBUG("Executing ECHO command.");
+        writer(context, request, CMD_ECHO, request->payload, request->payload_len);
+        break;
+    case PACKET_TYPE_KV_GET:
+    case PACKET_TYPE_KV_SET:
+    case PACKET_TYPE_KV_DEL:
+        execute_kv_command(request, writer, context);
+        break;
+    case PACKET_TYPE_SUBSCRIBE:
+    case PACKET_TYPE_UNSUBSCRIBE:
+    case PACKET_TYPE_PUBLISH:
+        execute_pubsub_command(request, writer, context);
+        break;
+    default:
+        LOG_WARN("Unknown command type dispatched: %d", request->type);
+        break;
+    }
+}
+
+int command_dispatch_route_stream(int fd, const uint8_t* frame, uint32_t frame_len) {
+    return pubsub_send(global_pubsub, fd, frame, frame_len);
+}
+
+void command_dispatch_flush_stream(int fd) {
+    pubsub_flush(global_pubsub, fd);
+}
+
+int command_dispatch_stream_has_state(int fd) {
+    return pubsub_has_connection(global_pubsub, fd);
+}
+
+void command_dispatch_release_stream(int fd) {
+    pubsub_remove_connection(global_pubsub, fd);
+}
+
+void command_dispatch_shutdown(void) {
+    kv_store_destroy(global_kv);
+    pubsub_destroy(global_pubsub);
+    global_kv = NULL;
+    global_pubsub = NULL;
+}
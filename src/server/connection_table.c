@@ -0,0 +1,171 @@
+/**
+ * @file connection_table.c
+ * @brief Implementation of the chunked connection table with generation-checked, pinnable handles.
+ */
+#include "server/connection_table.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/**
+ * @brief Per-slot validation state, kept apart from the contexts so a worker's check
+ * touches an 8-byte entry rather than the connection's cache line.
+ */
+typedef struct {
+    _Atomic uint32_t generation;
+    _Atomic uint32_t pins;
+} ConnectionSlot;
+
+// Chunk pointers are published before any handle into them, and never change afterwards
+static ClientContext* context_chunks[CONNECTION_TABLE_MAX_CHUNKS];
+static ConnectionSlot* slot_chunks[CONNECTION_TABLE_MAX_CHUNKS];
+static _Atomic uint32_t slot_capacity = 0;
+
+// Reactor-only free list and deferred closes, both chained through ClientContext.next
+static ClientContext* free_contexts = NULL;
+static ClientContext* closing_contexts = NULL;
+static connection_release_fn release_hook = NULL;
+
+static inline ConnectionSlot* slot_at(uint32_t index) {
+    return &slot_chunks[index / CONNECTION_TABLE_CHUNK_SIZE][index % CONNECTION_TABLE_CHUNK_SIZE];
+}
+
+static int grow_table(void) {
+    uint32_t capacity = atomic_load_explicit(&slot_capacity, memory_order_relaxed);
+    uint32_t chunk = capacity / CONNECTION_TABLE_CHUNK_SIZE;
+    if (chunk >= CONNECTION_TABLE_MAX_CHUNKS) {
+        return -1;
+    }
+
+    // One context per cache line, as the static assert on ClientContext promises
+    ClientContext* contexts = (ClientContext*)aligned_alloc(64, sizeof(ClientContext) * CONNECTION_TABLE_CHUNK_SIZE);
+    ConnectionSlot* slots = (ConnectionSlot*)calloc(CONNECTION_TABLE_CHUNK_SIZE, sizeof(ConnectionSlot));
+    if (contexts == NULL || slots == NULL) {
+        free(contexts);
+        free(slots);
+        return -1;
+    }
+
+    context_chunks[chunk] = contexts;
+    slot_chunks[chunk] = slots;
+    for (uint32_t i = CONNECTION_TABLE_CHUNK_SIZE; i-- > 0; ) {
+        contexts[i].slot = capacity + i;
+        contexts[i].next = free_contexts;
+        free_contexts = &contexts[i];
+    }
+
+    atomic_store_explicit(&slot_capacity, capacity + CONNECTION_TABLE_CHUNK_SIZE, memory_order_release);
+    return 0;
+}
+
+static void recycle(ClientContext* ctx) {
+    reset_client_context(ctx);
+    ctx->fd = -1;
+    ctx->next = free_contexts;
+    free_contexts = ctx;
+}
+
+// The generation moves to an even value before the pin count is read; a worker pins before
+// reading the generation, so one of the two always observes the other
+static int invalidate(ClientContext* ctx) {
+    ConnectionSlot* slot = slot_at(ctx->slot);
+    atomic_fetch_add(&slot->generation, 1);
+    return atomic_load(&slot->pins) != 0;
+}
+
+static void release_fd(ClientContext* ctx) {
+    if (release_hook != NULL) {
+        release_hook(ctx->fd);
+    }
+    close(ctx->fd);
+}
+
+void connection_table_set_release_hook(connection_release_fn hook) {
+    release_hook = hook;
+}
+
+ClientContext* connection_table_open(int fd, TransportKind transport) {
+    if (free_contexts == NULL && grow_table() != 0) {
+        return NULL;
+    }
+
+    ClientContext* ctx = free_contexts;
+    free_contexts = ctx->next;
+
+    uint32_t slot = ctx->slot;
+    init_client_context(ctx, fd);
+    ctx->slot = slot;
+    ctx->transport = (uint8_t)transport;
+
+    atomic_fetch_add_explicit(&slot_at(slot)->generation, 1, memory_order_release);
+    return ctx;
+}
+
+ConnectionHandle connection_table_handle(const ClientContext* ctx) {
+    uint32_t generation = atomic_load_explicit(&slot_at(ctx->slot)->generation, memory_order_relaxed);
+    return ((uint64_t)generation << 32) | ctx->slot;
+}
+
+ClientContext* connection_table_lookup(ConnectionHandle handle) {
+    uint32_t index = (uint32_t)handle;
+    if (index >= atomic_load_explicit(&slot_capacity, memory_order_relaxed)) {
+        return NULL;
+    }
+    if (atomic_load_explicit(&slot_at(index)->generation, memory_order_relaxed) != (uint32_t)(handle >> 32)) {
+        return NULL;
+    }
+    return &context_chunks[index / CONNECTION_TABLE_CHUNK_SIZE][index % CONNECTION_TABLE_CHUNK_SIZE];
+}
+
+int connection_table_pin(ConnectionHandle handle) {
+    uint32_t index = (uint32_t)handle;
+    if (index >= atomic_load_explicit(&slot_capacity, memory_order_acquire)) {
+        return -1;
+    }
+
+    ConnectionSlot* slot = slot_at(index);
+    atomic_fetch_add(&slot->pins, 1);
+    if (atomic_load(&slot->generation) != (uint32_t)(handle >> 32)) {
+        atomic_fetch_sub(&slot->pins, 1);
+        return -1;
+    }
+    return 0;
+}
+
+void connection_table_unpin(ConnectionHandle handle) {
+    atomic_fetch_sub_explicit(&slot_at((uint32_t)handle)->pins, 1, memory_order_release);
+}
+
+void connection_table_close(ClientContext* ctx) {
+    if (invalidate(ctx)) {
+        // The slot and its fd stay reserved; reap finishes the close once the workers let go
+        reset_client_context(ctx);
+        ctx->next = closing_contexts;
+        closing_contexts = ctx;
+        return;
+    }
+    release_fd(ctx);
+    recycle(ctx);
+}
+
+void connection_table_discard(ClientContext* ctx) {
+    invalidate(ctx);
+    recycle(ctx);
+}
+
+uint32_t connection_table_reap(void) {
+    uint32_t waiting = 0;
+    ClientContext** link = &closing_contexts;
+    while (*link != NULL) {
+        ClientContext* ctx = *link;
+        if (atomic_load_explicit(&slot_at(ctx->slot)->pins, memory_order_acquire) != 0) {
+            link = &ctx->next;
+            waiting++;
+            continue;
+        }
+        *link = ctx->next;
+        release_fd(ctx);
+        recycle(ctx);
+    }
+    return waiting;
+}
@@ -4,36 +4,103 @@
  */
 #include "server/epoll_server.h"
 #include "server/client_context.h"
+#include "server/connection_table.h"
 #include "common/net_utils.h"
 #include "protocol/protocol.h"
+#include "protocol/crc32c.h"
+#include "protocol/lz.h"
 #include "common/logger.h"
 #include "server/signal_handler.h"
 #include "server/thread_pool.h"
+#include "server/command_dispatch.h"
+#include "server/udp_server.h"
+#include "server/shm_transport.h"
+#include "server/hot_restart.h"
+#include "server/trace.h"
+#include "server/zerocopy.h"
+#include "server/capture.h"
+#include "server/upstream.h"
+#include "server/rate_limit.h"
+#include "server/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #define MAX_EVENTS 64
-#define CMD_ECHO 0x02
 #define QUEUE_SIZE 1024
+#define DEFERRED_CLOSE_POLL_MS 1
+
+// Input one connection may consume per turn before yielding to the rest of the batch
+#define READ_BUDGET_BYTES (64 * 1024)
+#define READ_BUDGET_FRAMES 32
+#define READY_LIST_INITIAL_CAPACITY 64
+#define PARKED_LIST_INITIAL_CAPACITY 64
+
+// Arena blocks, in carving order: a task for every queue slot, receive buffers, then send buffers
+#define TASK_POOL_BLOCKS (QUEUE_SIZE * THREAD_POOL_LANE_COUNT)
+#define PAYLOAD_PREFILL_BUFFERS 1024
+#define SEND_POOL_BLOCKS 256
+#define SEND_BUFFER_SIZE (sizeof(PacketHeader) + MAX_PAYLOAD_SIZE + PACKET_CRC32C_SIZE)
 
 static ThreadPool* global_pool = NULL;
+static int global_epoll_fd = -1;
+static ClientContext* client_list = NULL;
+static uint32_t zerocopy_threshold = 0;
+
+// Smallest response payload compressed for a peer that negotiated it, 0 when compression is off
+static uint32_t compress_threshold = 0;
+static uint64_t inflated_frames = 0;
+static atomic_ullong compressed_responses;
+static atomic_ullong compressed_bytes_saved;
 
+// Payload bytes land here first; only a frame left incomplete borrows a pooled buffer
+static uint8_t payload_scratch[MAX_PAYLOAD_SIZE];
+
+// Connections that ran out of budget before EAGAIN. Edge-triggered epoll will not report them
+// again until more data arrives, so the reactor revisits them round-robin from this ring
+static ConnectionHandle* ready_ring = NULL;
+static uint32_t ready_capacity = 0;
+static uint32_t ready_head = 0;
+static uint32_t ready_count = 0;
+
+// Connections out of tokens under the delay policy, with the time their buckets allow the next frame
 typedef struct {
+    ConnectionHandle handle;
+    uint64_t resume_us;
+} ParkedConnection;
+
+static ParkedConnection* parked = NULL;
+static uint32_t parked_capacity = 0;
+static uint32_t parked_count = 0;
+static int rate_limited = 0;
+static RateLimitPolicy limit_policy = RATE_LIMIT_DELAY;
+
+typedef struct {
+    ConnectionHandle handle;
     int fd;
-    uint8_t type;
+    uint16_t type;
+    uint32_t sequence_number;
     uint8_t* payload;
     uint32_t payload_len;
+    uint32_t trace_id;
+    uint16_t flags;             // PACKET_FLAG_* mirrored onto every response
+    int zerocopy;
 } CommandTask;
 
+// Pooled tasks carry their payload inline, right behind the task
+static ArenaPool task_pool;
+static ArenaPool send_pool;
+
 static void set_non_blocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -45,20 +112,82 @@ static void set_non_blocking(int fd) {
     }
 }
 
-// Optimized send_response with Buffer Coalescing and Small Buffer Optimization (SBO)
-static void send_response(int fd, uint8_t type, const uint8_t* payload, uint32_t payload_len) {
+static void track_client(ClientContext* ctx) {
+    ctx->prev = NULL;
+    ctx->next = client_list;
+    if (client_list != NULL) {
+        client_list->prev = ctx;
+    }
+    client_list = ctx;
+}
+
+static void untrack_client(ClientContext* ctx) {
+    if (ctx->prev != NULL) {
+        ctx->prev->next = ctx->next;
+    }
+    else {
+        client_list = ctx->next;
+    }
+    if (ctx->next != NULL) {
+        ctx->next->prev = ctx->prev;
+    }
+}
+
+// Subscriptions must be dropped before the fd number can be reused by a new connection
+static void release_stream_fd(int fd) {
+    command_dispatch_release_stream(fd);
+    zerocopy_release(fd);
+}
+
+// A worker may still be answering on this fd; the table closes it once the last task unpins
+static void close_client(ClientContext* ctx) {
+    untrack_client(ctx);
+    rate_limit_detach(ctx->slot);
+    if (ctx->shm_session != NULL) {
+        shm_session_retire(ctx->shm_session, global_epoll_fd);
+    }
+    epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, ctx->fd, NULL);
+    connection_table_close(ctx);
+}
+
+// Optimized send_response with Buffer Coalescing and Small Buffer Optimization (SBO);
+// frames at or above the zerocopy threshold are handed to the kernel without a socket copy.
+// PACKET_FLAG_COMPRESSED in flags only permits compression; the frame carries it if it paid off
+static void send_response(int fd, uint16_t type, uint32_t sequence_number, const uint8_t* payload, uint32_t payload_len,
+    uint16_t flags, int zerocopy) {
+    uint8_t packed[MAX_PAYLOAD_SIZE];
+    uint16_t wire_flags = flags & ~PACKET_FLAG_COMPRESSED;
+    if ((flags & PACKET_FLAG_COMPRESSED) && compress_threshold > 0 && payload_len >= compress_threshold &&
+        payload_len <= MAX_PAYLOAD_SIZE) {
+        uint32_t packed_len = lz_compress_payload(payload, payload_len, packed, sizeof(packed));
+        if (packed_len > 0) {
+            atomic_fetch_add_explicit(&compressed_responses, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&compressed_bytes_saved, payload_len - packed_len, memory_order_relaxed);
+            payload = packed;
+            payload_len = packed_len;
+            wire_flags |= PACKET_FLAG_COMPRESSED;
+        }
+    }
+    uint32_t trailer_len = (wire_flags & PACKET_FLAG_CRC32C) ? PACKET_CRC32C_SIZE : 0;
+
     PacketHeader header;
-    header.type = type;
-    header.sequence_number = 0;
-    header.payload_length = payload_len;
+    header.version = (wire_flags != 0) ? PROTOCOL_VERSION_2 : PROTOCOL_VERSION_1;
+    header.type = type | wire_flags;
+    header.sequence_number = sequence_number;
+    header.payload_length = payload_len + trailer_len;
 
-    size_t total_len = sizeof(PacketHeader) + payload_len;
+    size_t total_len = sizeof(PacketHeader) + payload_len + trailer_len;
     uint8_t stack_buf[512];
     uint8_t* full_buffer = stack_buf;
+    zerocopy = zerocopy && zerocopy_threshold > 0 && total_len >= zerocopy_threshold;
 
-    // Fallback to heap only if the payload is unusually large
-    if (total_len > sizeof(stack_buf)) {
-        full_buffer = (uint8_t*)malloc(total_len);
+    // Larger frames take a prefaulted send buffer; zerocopy frames outlive this call and are
+    // freed by the completion path, so they always come from the heap
+    if (total_len > sizeof(stack_buf) || zerocopy) {
+        full_buffer = (!zerocopy && total_len <= SEND_BUFFER_SIZE) ? (uint8_t*)arena_pool_get(&send_pool) : NULL;
+        if (full_buffer == NULL) {
+            full_buffer = (uint8_t*)malloc(total_len);
+        }
         if (!full_buffer) return;
     }
 
@@ -66,40 +195,388 @@ static void send_response(int fd, uint8_t type, const uint8_t* payload, uint32_t
     if (payload_len > 0 && payload != NULL) {
         memcpy(full_buffer + sizeof(PacketHeader), payload, payload_len);
     }
+    if (trailer_len > 0) {
+        // Checksummed straight after the copy, while the payload is still in L1
+        uint32_t net_crc = htonl(crc32c(0, full_buffer + sizeof(PacketHeader), payload_len));
+        memcpy(full_buffer + sizeof(PacketHeader) + payload_len, &net_crc, sizeof(net_crc));
+    }
 
-    ssize_t sent = send(fd, full_buffer, total_len, 0);
-    if (sent == -1) {
-        LOG_ERROR("Failed to send coalesced response: %s", strerror(errno));
+    // Subscriber connections own an output queue; replies must not overtake queued broadcasts
+    if (command_dispatch_route_stream(fd, full_buffer, (uint32_t)total_len) != 0) {
+        ssize_t sent = -1;
+        if (zerocopy) {
+            // On success the frame belongs to the transmit path until the kernel completes it
+            sent = zerocopy_send(fd, full_buffer, total_len);
+            if (sent != -1) {
+                full_buffer = stack_buf;
+            }
+        }
+        if (sent == -1) {
+            sent = send(fd, full_buffer, total_len, 0);
+        }
+        if (sent == -1) {
+            LOG_ERROR("Failed to send coalesced response: %s", strerror(errno));
+        }
+        else {
+            trace_stamp(trace_current(), TRACE_BYTES_WRITTEN, (uint32_t)sent);
+        }
+    }
+    else {
+        trace_stamp(trace_current(), TRACE_BYTES_WRITTEN, (uint32_t)total_len);
     }
 
-    if (full_buffer != stack_buf) {
+    if (arena_contains(full_buffer)) {
+        arena_pool_put(&send_pool, full_buffer);
+    }
+    else if (full_buffer != stack_buf) {
         free(full_buffer);
     }
 }
 
+static void stream_response_writer(void* context, const CommandRequest* request,
+    uint16_t type, const uint8_t* payload, uint32_t payload_len) {
+    const CommandTask* task = (const CommandTask*)context;
+    send_response(request->fd, type, request->sequence_number, payload, payload_len, task->flags, task->zerocopy);
+}
+
+static void release_command_task(CommandTask* task) {
+    if (arena_contains(task)) {
+        arena_pool_put(&task_pool, task);
+        return;
+    }
+    if (task->payload != NULL) {
+        free(task->payload);
+    }
+    free(task);
+}
+
 static void execute_command_task(void* arg) {
     CommandTask* task = (CommandTask*)arg;
 
-    switch (task->type) {
-    case CMD_ECHO:
-        LOG_DEBUG("Executing ECHO command in worker thread.");
-        send_response(task->fd, CMD_ECHO, task->payload, task->payload_len);
-        break;
+    CommandRequest request;
+    request.fd = task->fd;
+    request.type = task->type;
+    request.sequence_number = task->sequence_number;
+    request.payload = task->payload;
+    request.payload_len = task->payload_len;
+
+    // The pin keeps task->fd bound to the connection that sent the request until the response is written
+    if (connection_table_pin(task->handle) == 0) {
+        trace_stamp(task->trace_id, TRACE_HANDLER_START, 0);
+        trace_set_current(task->trace_id);
+        dispatch_command(&request, stream_response_writer, task);
+        trace_set_current(0);
+        trace_stamp(task->trace_id, TRACE_HANDLER_END, 0);
+        connection_table_unpin(task->handle);
+    }
+    else {
+        LOG_DEBUG("Dropping command type %d for closed connection (fd %d).", task->type, task->fd);
+    }
+
+    release_command_task(task);
+}
+
+// Negotiates a shared-memory channel; only Unix connections can receive the descriptors
+static void attach_shm_session(ClientContext* ctx, const PacketHeader* header, uint16_t flags) {
+    if (ctx->transport != TRANSPORT_UNIX || ctx->shm_session != NULL) {
+        send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
+        return;
+    }
+
+    ShmSession* session = shm_session_open(ctx->fd);
+    if (session == NULL) {
+        send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
+        return;
+    }
+
+    ClientContext* doorbell_ctx = shm_session_doorbell_context(session);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.u64 = connection_table_handle(doorbell_ctx);
+    event.events = EPOLLIN | EPOLLET;
+
+    if (epoll_ctl(global_epoll_fd, EPOLL_CTL_ADD, doorbell_ctx->fd, &event) == -1) {
+        LOG_ERROR("epoll_ctl EPOLL_CTL_ADD doorbell failed: %s", strerror(errno));
+        shm_session_retire(session, global_epoll_fd);
+        shutdown(ctx->fd, SHUT_RDWR);
+        return;
+    }
+
+    ctx->shm_session = session;
+}
+
+// Liveness and small point operations must not wait behind bulk payloads
+static uint32_t lane_for_command(uint16_t type) {
+    switch (type) {
+    case PACKET_TYPE_HEARTBEAT:
+        return THREAD_POOL_LANE_CONTROL;
+    case PACKET_TYPE_KV_GET:
+    case PACKET_TYPE_KV_SET:
+    case PACKET_TYPE_KV_DEL:
+    case PACKET_TYPE_SUBSCRIBE:
+    case PACKET_TYPE_UNSUBSCRIBE:
+        return THREAD_POOL_LANE_INTERACTIVE;
     default:
-        LOG_WARN("Unknown command type dispatched: %d", task->type);
-        break;
+        return THREAD_POOL_LANE_BULK;
     }
+}
 
-    if (task->payload != NULL) {
-        free(task->payload);
+// Copies the completed frame into a task and queues it on the lane of its command type
+static void submit_command(ClientContext* ctx, const PacketHeader* header, const uint8_t* payload, uint16_t flags) {
+    LOG_DEBUG("Dispatching command type: %d to thread pool", header->type);
+
+    CommandTask* task = (CommandTask*)arena_pool_get(&task_pool);
+    int pooled = task != NULL;
+    if (!pooled) {
+        task = (CommandTask*)malloc(sizeof(CommandTask));
+        if (task == NULL) {
+            return;
+        }
     }
-    free(task);
+
+    task->handle = connection_table_handle(ctx);
+    task->fd = ctx->fd;
+    task->type = header->type;
+    task->sequence_number = header->sequence_number;
+    task->payload_len = header->payload_length;
+    task->payload = NULL;
+    task->trace_id = ctx->trace_id;
+    task->flags = flags;
+    task->zerocopy = (ctx->flags & CLIENT_FLAG_ZEROCOPY) != 0;
+
+    if (task->payload_len > 0) {
+        task->payload = pooled ? (uint8_t*)(task + 1) : (uint8_t*)malloc(task->payload_len);
+        if (task->payload == NULL) {
+            free(task);
+            return;
+        }
+        memcpy(task->payload, payload, task->payload_len);
+    }
+
+    uint32_t lane = lane_for_command(task->type);
+    if (thread_pool_add_task(global_pool, lane, execute_command_task, task, task->trace_id) != 0) {
+        LOG_ERROR("Failed to add task to thread pool lane %u.", lane);
+        release_command_task(task);
+    }
+}
+
+// Relays a backend response to the client that sent the request, if it is still connected
+static void relay_upstream_response(ConnectionHandle client, uint16_t type, uint32_t sequence_number,
+    const uint8_t* payload, uint32_t payload_len, uint16_t flags) {
+    ClientContext* ctx = connection_table_lookup(client);
+    if (ctx == NULL) {
+        return;
+    }
+    send_response(ctx->fd, type, sequence_number, payload, payload_len, flags, (ctx->flags & CLIENT_FLAG_ZEROCOPY) != 0);
+}
+
+// Grants the requested features this server supports, answering with the granted bits
+static void negotiate_features(ClientContext* ctx, const PacketHeader* header, const uint8_t* payload, uint16_t flags) {
+    if (header->payload_length != sizeof(uint32_t)) {
+        send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
+        return;
+    }
+
+    uint32_t requested;
+    memcpy(&requested, payload, sizeof(requested));
+    requested = ntohl(requested);
+
+    uint32_t granted = 0;
+    ctx->flags &= ~CLIENT_FLAG_COMPRESS;
+    if ((requested & PROTOCOL_FEATURE_COMPRESSION) && compress_threshold > 0) {
+        granted |= PROTOCOL_FEATURE_COMPRESSION;
+        ctx->flags |= CLIENT_FLAG_COMPRESS;
+    }
+
+    uint32_t net_granted = htonl(granted);
+    send_response(ctx->fd, PACKET_TYPE_ACK, header->sequence_number, (const uint8_t*)&net_granted,
+        sizeof(net_granted), flags, 0);
+}
+
+// Executes a verified, decompressed frame: forwarded, queued on the pool or handled in the reactor
+static void dispatch_frame(ClientContext* ctx, PacketHeader* header, const uint8_t* payload, uint16_t flags) {
+    // Negotiated peers may get compressed responses whatever their request looked like
+    flags &= ~PACKET_FLAG_COMPRESSED;
+    if (ctx->flags & CLIENT_FLAG_COMPRESS) {
+        flags |= PACKET_FLAG_COMPRESSED;
+    }
+
+    // Negotiation changes connection state, so it is never queued or forwarded; routed types
+    // skip the pool and the reactor queues them straight onto a backend connection
+    if (header->type == PACKET_TYPE_FEATURES) {
+        negotiate_features(ctx, header, payload, flags & PACKET_FLAG_CRC32C);
+    }
+    else if (upstream_routes_type(header->type)) {
+        if (upstream_forward(connection_table_handle(ctx), header->type, header->sequence_number,
+            payload, header->payload_length, flags) != 0) {
+            send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
+        }
+    }
+    else if (header->payload_length > 0) {
+        submit_command(ctx, header, payload, flags);
+    }
+    else {
+        LOG_DEBUG("Received header-only message. Type: %d", header->type);
+        if (header->type == PACKET_TYPE_SHM_ATTACH) {
+            attach_shm_session(ctx, header, flags);
+        }
+        else if (header->type == PACKET_TYPE_HEARTBEAT) {
+            submit_command(ctx, header, NULL, flags);
+        }
+    }
+}
+
+// Strips the version 2 flags of a complete frame, verifies its trailer and inflates its payload before acting on it
+static void complete_frame(ClientContext* ctx, PacketHeader* header, const uint8_t* payload) {
+    capture_frame(connection_table_handle(ctx), ctx->header_buffer, payload, header->payload_length);
+
+    uint16_t flags = 0;
+    if (header->version == PROTOCOL_VERSION_2) {
+        flags = header->type & ~PACKET_TYPE_MASK;
+        header->type &= PACKET_TYPE_MASK;
+    }
+
+    if (flags & PACKET_FLAG_CRC32C) {
+        int intact = header->payload_length >= PACKET_CRC32C_SIZE;
+        if (intact) {
+            header->payload_length -= PACKET_CRC32C_SIZE;
+
+            uint32_t net_crc;
+            memcpy(&net_crc, payload + header->payload_length, sizeof(net_crc));
+            intact = crc32c(0, payload, header->payload_length) == ntohl(net_crc);
+        }
+        if (!intact) {
+            LOG_WARN("CRC32C mismatch on fd %d (sequence %u); frame dropped.", ctx->fd, header->sequence_number);
+            send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
+            return;
+        }
+    }
+
+    uint16_t supported = PACKET_FLAG_CRC32C | ((ctx->flags & CLIENT_FLAG_COMPRESS) ? PACKET_FLAG_COMPRESSED : 0);
+    if ((flags & ~supported) != 0) {
+        LOG_WARN("Unsupported frame flags 0x%04x on fd %d.", flags, ctx->fd);
+        send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags & PACKET_FLAG_CRC32C, 0);
+        return;
+    }
+
+    if (!(flags & PACKET_FLAG_COMPRESSED)) {
+        dispatch_frame(ctx, header, payload, flags);
+        return;
+    }
+
+    // Inflated into a pooled buffer, so the handlers and the forwarder only ever see plain payloads
+    PendingPayload* inflated = acquire_payload_buffer();
+    int32_t inflated_len = -1;
+    if (inflated != NULL && payload != NULL) {
+        inflated_len = lz_decompress_payload(payload, header->payload_length, inflated->data, sizeof(inflated->data));
+    }
+    if (inflated_len < 0) {
+        LOG_WARN("Malformed compressed payload on fd %d (sequence %u); frame dropped.", ctx->fd, header->sequence_number);
+        send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags & PACKET_FLAG_CRC32C, 0);
+    }
+    else {
+        inflated_frames++;
+        header->payload_length = (uint32_t)inflated_len;
+        dispatch_frame(ctx, header, inflated->data, flags);
+    }
+    if (inflated != NULL) {
+        release_payload_buffer(inflated);
+    }
+}
+
+static int grow_ready_ring(void) {
+    uint32_t capacity = ready_capacity > 0 ? ready_capacity * 2 : READY_LIST_INITIAL_CAPACITY;
+    ConnectionHandle* ring = (ConnectionHandle*)malloc(sizeof(ConnectionHandle) * capacity);
+    if (ring == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < ready_count; i++) {
+        ring[i] = ready_ring[(ready_head + i) % ready_capacity];
+    }
+    free(ready_ring);
+    ready_ring = ring;
+    ready_capacity = capacity;
+    ready_head = 0;
+    return 0;
+}
+
+static void mark_ready(ClientContext* ctx) {
+    if (ctx->flags & CLIENT_FLAG_READY) {
+        return;
+    }
+    if (ready_count == ready_capacity && grow_ready_ring() != 0) {
+        LOG_ERROR("Ready list full; fd %d resumes on its next edge.", ctx->fd);
+        return;
+    }
+
+    ready_ring[(ready_head + ready_count) % ready_capacity] = connection_table_handle(ctx);
+    ready_count++;
+    ctx->flags |= CLIENT_FLAG_READY;
+}
+
+static void park_connection(ClientContext* ctx, uint64_t wait_us) {
+    if (ctx->flags & CLIENT_FLAG_PARKED) {
+        return;
+    }
+    if (parked_count == parked_capacity) {
+        uint32_t capacity = parked_capacity > 0 ? parked_capacity * 2 : PARKED_LIST_INITIAL_CAPACITY;
+        ParkedConnection* grown = (ParkedConnection*)realloc(parked, sizeof(ParkedConnection) * capacity);
+        if (grown == NULL) {
+            LOG_ERROR("Parked list full; fd %d resumes on its next edge.", ctx->fd);
+            return;
+        }
+        parked = grown;
+        parked_capacity = capacity;
+    }
+
+    parked[parked_count].handle = connection_table_handle(ctx);
+    parked[parked_count].resume_us = rate_limit_now_us() + wait_us;
+    parked_count++;
+    ctx->flags |= CLIENT_FLAG_PARKED;
+    rate_limit_count(RATE_LIMIT_DELAY);
+}
+
+// Admission happens once the header says how large the frame is, before any payload is buffered
+static void admit_frame(ClientContext* ctx, const PacketHeader* header) {
+    uint32_t frame_bytes = (uint32_t)sizeof(PacketHeader) + header->payload_length;
+    if (limit_policy == RATE_LIMIT_REJECT && rate_limit_check(ctx->slot) > 0) {
+        ctx->flags |= CLIENT_FLAG_REJECTED;
+        rate_limit_count(RATE_LIMIT_REJECT);
+        return;
+    }
+    rate_limit_charge(ctx->slot, frame_bytes);
+}
+
+// Answers an over-limit frame once its payload has been discarded; nothing is captured, verified or queued
+static void reject_frame(ClientContext* ctx, const PacketHeader* header) {
+    uint16_t flags = (header->version == PROTOCOL_VERSION_2) ? (header->type & PACKET_FLAG_CRC32C) : 0;
+    ctx->flags &= ~CLIENT_FLAG_REJECTED;
+    send_response(ctx->fd, PACKET_TYPE_ERROR, header->sequence_number, NULL, 0, flags, 0);
 }
 
 static void handle_client_data(ClientContext* ctx) {
     ssize_t bytes_read;
+    size_t budget_bytes = 0;
+    uint32_t budget_frames = 0;
 
     while (1) {
+        // A streaming peer yields once it has had its share; the ready list brings it back
+        if (budget_bytes >= READ_BUDGET_BYTES || budget_frames >= READ_BUDGET_FRAMES) {
+            mark_ready(ctx);
+            return;
+        }
+
+        // Under the delay policy unread frames stay in the socket, so TCP slows the sender down
+        if (rate_limited && limit_policy == RATE_LIMIT_DELAY && ctx->state == STATE_READING_HEADER &&
+            ctx->header_bytes_read == 0) {
+            uint64_t wait_us = rate_limit_check(ctx->slot);
+            if (wait_us > 0) {
+                park_connection(ctx, wait_us);
+                return;
+            }
+        }
+
         if (ctx->state == STATE_READING_HEADER) {
             size_t remaining = sizeof(ctx->header_buffer) - ctx->header_bytes_read;
             bytes_read = recv(ctx->fd, ctx->header_buffer + ctx->header_bytes_read, remaining, 0);
@@ -107,202 +584,674 @@ static void handle_client_data(ClientContext* ctx) {
             if (bytes_read == -1) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 LOG_ERROR("recv header failed: %s", strerror(errno));
-                close(ctx->fd);
-                free_client_context(ctx);
-                free(ctx);
+                close_client(ctx);
                 return;
             }
             else if (bytes_read == 0) {
                 LOG_DEBUG("Client fd %d disconnected during header read.", ctx->fd);
-                close(ctx->fd);
-                free_client_context(ctx);
-                free(ctx);
+                close_client(ctx);
                 return;
             }
 
             ctx->header_bytes_read += bytes_read;
+            budget_bytes += (size_t)bytes_read;
 
             if (ctx->header_bytes_read == sizeof(ctx->header_buffer)) {
                 PacketHeader header;
                 deserialize_header(ctx->header_buffer, &header);
 
-                ctx->expected_payload_length = header.payload_length;
-                ctx->message_type = header.type;
+                ctx->trace_id = trace_sample();
+                trace_stamp(ctx->trace_id, TRACE_HEADER_COMPLETE, header.payload_length);
+                if (rate_limited) {
+                    admit_frame(ctx, &header);
+                }
 
-                if (ctx->expected_payload_length > 0) {
-                    if (ctx->expected_payload_length > MAX_PAYLOAD_SIZE) {
-                        LOG_WARN("Payload too large: %d", ctx->expected_payload_length);
-                        close(ctx->fd);
-                        free_client_context(ctx);
-                        free(ctx);
+                if (header.payload_length > 0) {
+                    if (header.payload_length > MAX_PAYLOAD_SIZE) {
+                        LOG_WARN("Payload too large: %d", header.payload_length);
+                        close_client(ctx);
                         return;
                     }
 
-                    ctx->payload_buffer = (uint8_t*)malloc(ctx->expected_payload_length);
-                    if (!ctx->payload_buffer) {
-                        LOG_ERROR("malloc payload failed: %s", strerror(errno));
-                        close(ctx->fd);
-                        free(ctx);
-                        return;
-                    }
+                    // No buffer yet: the payload may already be queued, or the peer may go idle here
                     ctx->state = STATE_READING_PAYLOAD;
                 }
                 else {
-                    LOG_DEBUG("Received header-only message. Type: %d", header.type);
+                    if (ctx->flags & CLIENT_FLAG_REJECTED) {
+                        reject_frame(ctx, &header);
+                    }
+                    else {
+                        complete_frame(ctx, &header, NULL);
+                    }
                     reset_client_context(ctx);
+                    budget_frames++;
                 }
             }
         }
         else if (ctx->state == STATE_READING_PAYLOAD) {
-            size_t remaining = ctx->expected_payload_length - ctx->payload_bytes_read;
-            bytes_read = recv(ctx->fd, ctx->payload_buffer + ctx->payload_bytes_read, remaining, 0);
+            PacketHeader header;
+            deserialize_header(ctx->header_buffer, &header);
+
+            uint32_t already_read = (ctx->pending != NULL) ? ctx->pending->bytes_read : 0;
+            uint8_t* destination = (ctx->pending != NULL) ? ctx->pending->data + already_read : payload_scratch;
+            size_t remaining = header.payload_length - already_read;
+            bytes_read = recv(ctx->fd, destination, remaining, 0);
 
             if (bytes_read == -1) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 LOG_ERROR("recv payload failed: %s", strerror(errno));
-                close(ctx->fd);
-                free_client_context(ctx);
-                free(ctx);
+                close_client(ctx);
                 return;
             }
             else if (bytes_read == 0) {
                 LOG_DEBUG("Client fd %d disconnected during payload read.", ctx->fd);
-                close(ctx->fd);
-                free_client_context(ctx);
-                free(ctx);
+                close_client(ctx);
                 return;
             }
 
-            ctx->payload_bytes_read += bytes_read;
-
-            if (ctx->payload_bytes_read == ctx->expected_payload_length) {
-                LOG_DEBUG("Dispatching command type: %d to thread pool", ctx->message_type);
+            budget_bytes += (size_t)bytes_read;
 
-                CommandTask* task = (CommandTask*)malloc(sizeof(CommandTask));
-                if (task != NULL) {
-                    task->fd = ctx->fd;
-                    task->type = ctx->message_type;
-                    task->payload_len = ctx->expected_payload_length;
-                    task->payload = NULL;
+            // A rejected payload never gets a buffer: it lands in scratch and the header counts down what is left
+            if (ctx->flags & CLIENT_FLAG_REJECTED) {
+                header.payload_length -= (uint32_t)bytes_read;
+                if (header.payload_length > 0) {
+                    serialize_header(&header, ctx->header_buffer);
+                    continue;
+                }
+                reject_frame(ctx, &header);
+                reset_client_context(ctx);
+                budget_frames++;
+                continue;
+            }
 
-                    if (task->payload_len > 0) {
-                        task->payload = (uint8_t*)malloc(task->payload_len);
-                        memcpy(task->payload, ctx->payload_buffer, task->payload_len);
-                    }
+            if (ctx->pending == NULL && (size_t)bytes_read < remaining) {
+                if (reserve_client_payload(ctx) != 0) {
+                    LOG_ERROR("Failed to reserve payload buffer for fd %d.", ctx->fd);
+                    close_client(ctx);
+                    return;
+                }
+                memcpy(ctx->pending->data, payload_scratch, (size_t)bytes_read);
+                ctx->pending->bytes_read = (uint32_t)bytes_read;
+                continue;
+            }
 
-                    if (thread_pool_add_task(global_pool, execute_command_task, task) != 0) {
-                        LOG_ERROR("Failed to add task to thread pool queue.");
-                        if (task->payload != NULL) free(task->payload);
-                        free(task);
-                    }
+            if (ctx->pending != NULL) {
+                ctx->pending->bytes_read += (uint32_t)bytes_read;
+                if (ctx->pending->bytes_read < header.payload_length) {
+                    continue;
                 }
+            }
 
-                reset_client_context(ctx);
+            trace_stamp(ctx->trace_id, TRACE_PAYLOAD_COMPLETE, header.payload_length);
+            complete_frame(ctx, &header, (ctx->pending != NULL) ? ctx->pending->data : payload_scratch);
+            reset_client_context(ctx);
+            budget_frames++;
+        }
+    }
+}
+
+// One turn for every connection queued before this pass; ones that yield again wait for the next
+static void service_ready_connections(void) {
+    uint32_t turns = ready_count;
+    while (turns-- > 0) {
+        ConnectionHandle handle = ready_ring[ready_head];
+        ready_head = (ready_head + 1) % ready_capacity;
+        ready_count--;
+
+        ClientContext* ctx = connection_table_lookup(handle);
+        if (ctx == NULL) {
+            continue;
+        }
+        ctx->flags &= ~CLIENT_FLAG_READY;
+        handle_client_data(ctx);
+    }
+}
+
+// Parked connections whose buckets have refilled get their turn; ones still short park again
+static void service_parked_connections(void) {
+    uint64_t now = rate_limit_now_us();
+    uint32_t i = 0;
+    while (i < parked_count) {
+        if (parked[i].resume_us > now) {
+            i++;
+            continue;
+        }
+
+        ConnectionHandle handle = parked[i].handle;
+        parked[i] = parked[--parked_count];
+
+        ClientContext* ctx = connection_table_lookup(handle);
+        if (ctx == NULL) {
+            continue;
+        }
+        ctx->flags &= ~CLIENT_FLAG_PARKED;
+        handle_client_data(ctx);
+    }
+}
+
+static int parked_timeout_ms(void) {
+    if (parked_count == 0) {
+        return -1;
+    }
+
+    uint64_t now = rate_limit_now_us();
+    uint64_t earliest = parked[0].resume_us;
+    for (uint32_t i = 1; i < parked_count; i++) {
+        if (parked[i].resume_us < earliest) {
+            earliest = parked[i].resume_us;
+        }
+    }
+    return earliest > now ? (int)((earliest - now + 999) / 1000) : 0;
+}
+
+static void register_client(ClientContext* ctx) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+
+    // EPOLLOUT edges resume subscriber queues that hit a full socket buffer
+    event.data.u64 = connection_table_handle(ctx);
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+
+    if (epoll_ctl(global_epoll_fd, EPOLL_CTL_ADD, ctx->fd, &event) == -1) {
+        LOG_ERROR("epoll_ctl EPOLL_CTL_ADD client failed: %s", strerror(errno));
+        close(ctx->fd);
+        connection_table_discard(ctx);
+        return;
+    }
+    track_client(ctx);
+
+    if (rate_limited) {
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        int has_peer = ctx->transport == TRANSPORT_TCP &&
+            getpeername(ctx->fd, (struct sockaddr*)&peer, &peer_len) == 0;
+        rate_limit_attach(ctx->slot, has_peer ? (const struct sockaddr*)&peer : NULL);
+    }
+}
+
+static void accept_connections(int listen_fd, TransportKind transport) {
+    while (1) {
+        struct sockaddr_storage client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
+
+        if (client_fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            else {
+                LOG_ERROR("accept failed: %s", strerror(errno));
+                break;
+            }
+        }
+
+        if (transport == TRANSPORT_TCP) {
+            // Disable Nagle's algorithm for low latency
+            int flag = 1;
+            if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int)) == -1) {
+                LOG_WARN("Failed to set TCP_NODELAY on client socket.");
+            }
+
+            if (client_addr.ss_family == AF_INET) {
+                struct sockaddr_in* in = (struct sockaddr_in*)&client_addr;
+                char client_ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &in->sin_addr, client_ip, INET_ADDRSTRLEN);
+                LOG_DEBUG("Accepted connection from %s:%d (fd: %d).", client_ip, ntohs(in->sin_port), client_fd);
             }
         }
+        else {
+            LOG_DEBUG("Accepted local connection (fd: %d).", client_fd);
+        }
+
+        set_non_blocking(client_fd);
+
+        ClientContext* new_client_ctx = connection_table_open(client_fd, transport);
+        if (new_client_ctx == NULL) {
+            LOG_ERROR("Failed to allocate context for fd %d.", client_fd);
+            close(client_fd);
+            continue;
+        }
+        // Migrated sockets are never flagged: their transmit counter did not start in this process
+        if (transport == TRANSPORT_TCP && zerocopy_threshold > 0 && zerocopy_enable(client_fd) == 0) {
+            new_client_ctx->flags |= CLIENT_FLAG_ZEROCOPY;
+        }
+        register_client(new_client_ctx);
     }
 }
 
-void start_epoll_server(const char* port) {
+// Connections inherited from a predecessor resume exactly where its parser stopped
+static int receive_migrated_connections(int predecessor_fd) {
+    while (1) {
+        ClientContext* ctx = connection_table_open(-1, TRANSPORT_TCP);
+        if (ctx == NULL) {
+            return 0;
+        }
+
+        int rc = hot_restart_receive_connection(predecessor_fd, ctx);
+        if (rc != 1) {
+            connection_table_discard(ctx);
+            if (rc == 2) {
+                continue;
+            }
+            return rc;
+        }
+
+        set_non_blocking(ctx->fd);
+        register_client(ctx);
+    }
+}
+
+static void log_compression_stats(void) {
+    if (compress_threshold == 0) {
+        return;
+    }
+    LOG_INFO("Compression: %llu frames inflated, %llu responses compressed saving %llu bytes.",
+        (unsigned long long)inflated_frames,
+        (unsigned long long)atomic_load(&compressed_responses),
+        (unsigned long long)atomic_load(&compressed_bytes_saved));
+}
+
+static void log_pool_stats(void) {
+    if (global_pool == NULL) {
+        return;
+    }
+
+    ThreadPoolStats stats;
+    thread_pool_get_stats(global_pool, &stats);
+    LOG_INFO("Thread pool: %u workers (min %u, max %u, peak %u), %llu grown, %llu retired.",
+        stats.threads, stats.min_threads, stats.max_threads, stats.peak_threads,
+        (unsigned long long)stats.grow_events, (unsigned long long)stats.shrink_events);
+}
+
+// Listeners go first so the successor accepts while this process drains and migrates
+static void hand_off_to_successor(int successor_fd, const ListenerSet* listeners, int migrate_connections) {
+    LOG_INFO("Successor connected; handing off listeners.");
+
+    if (listeners->tcp_fd != -1) epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, listeners->tcp_fd, NULL);
+    if (listeners->udp_fd != -1) epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, listeners->udp_fd, NULL);
+    if (listeners->unix_fd != -1) epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, listeners->unix_fd, NULL);
+
+    if (hot_restart_send_listeners(successor_fd, listeners) != 0) {
+        LOG_ERROR("Failed to pass listeners to successor: %s", strerror(errno));
+    }
+
+    // Every queued task and forwarded request is answered before any connection changes hands
+    log_pool_stats();
+    thread_pool_destroy(global_pool);
+    upstream_shutdown();
+    global_pool = NULL;
+    connection_table_reap();
+
+    uint32_t migrated = 0;
+    uint32_t closed = 0;
+    while (client_list != NULL) {
+        ClientContext* ctx = client_list;
+        // Subscriptions, shared-memory channels and zerocopy frames the kernel may still read
+        // live in this process and cannot follow the fd
+        int portable = migrate_connections && ctx->shm_session == NULL &&
+            !(ctx->flags & CLIENT_FLAG_ZEROCOPY) && !command_dispatch_stream_has_state(ctx->fd);
+
+        if (portable && hot_restart_send_connection(successor_fd, ctx) == 0) {
+            migrated++;
+        }
+        else {
+            closed++;
+        }
+        close_client(ctx);
+    }
+
+    hot_restart_send_done(successor_fd);
+    close(successor_fd);
+    LOG_INFO("Hot restart complete: %u connections migrated, %u closed.", migrated, closed);
+}
+
+// Each connection holds a descriptor, so the soft limit is usually what caps connection count
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return;
+    }
+
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            LOG_WARN("Failed to raise descriptor limit: %s", strerror(errno));
+            return;
+        }
+    }
+    LOG_INFO("Descriptor limit: %llu.", (unsigned long long)limit.rlim_cur);
+}
+
+void start_epoll_server(const ServerConfig* config) {
+    const char* port = config->port;
     long core_count = sysconf(_SC_NPROCESSORS_ONLN);
     if (core_count < 1) {
         LOG_WARN("Failed to detect CPU cores. Defaulting to 4 workers.");
         core_count = 4;
     }
 
-    global_pool = thread_pool_create((uint32_t)core_count, QUEUE_SIZE);
+    raise_fd_limit();
+
+    // Mapped before the pool exists, so its queues and every later buffer land in prefaulted memory
+    if (arena_init((size_t)config->arena_mb * 1024 * 1024) == 0 && arena_backing() != ARENA_BACKING_NONE) {
+        LOG_INFO("Prefaulted a %u MiB buffer arena on %s.", config->arena_mb, arena_backing_name(arena_backing()));
+    }
+
+    uint32_t min_workers = config->pool_min_threads != 0 ? config->pool_min_threads : (uint32_t)core_count;
+    uint32_t max_workers = config->pool_max_threads > min_workers ? config->pool_max_threads : min_workers;
+    global_pool = thread_pool_create(min_workers, max_workers, QUEUE_SIZE, config->pool_schedule);
     if (global_pool == NULL) {
         die_with_error("Failed to initialize thread pool");
     }
 
-    int server_fd = setup_tcp_server_socket(port);
+    arena_pool_init(&task_pool, "tasks", sizeof(CommandTask) + MAX_PAYLOAD_SIZE, TASK_POOL_BLOCKS);
+    prefill_payload_pool(PAYLOAD_PREFILL_BUFFERS);
+    arena_pool_init(&send_pool, "send buffers", SEND_BUFFER_SIZE, SEND_POOL_BLOCKS);
+
+    if (command_dispatch_init() != 0) {
+        die_with_error("Failed to initialize command engines");
+    }
+
+    trace_init(config->trace_sample_every);
+    if (config->capture_path != NULL && capture_open(config->capture_path) != 0) {
+        die_with_error("Failed to open capture file");
+    }
+    zerocopy_threshold = config->zerocopy_threshold;
+    compress_threshold = config->compress_threshold;
+    if (upstream_configure(config->upstream_routes, config->upstream_route_count) != 0) {
+        die_with_error("Invalid forwarding route");
+    }
+    if (rate_limit_configure(config->connection_limit, config->source_limit) != 0) {
+        die_with_error("Failed to initialize rate limits");
+    }
+    rate_limited = rate_limit_enabled();
+    limit_policy = config->limit_policy;
+    connection_table_set_release_hook(release_stream_fd);
+
+    // A running predecessor hands over its bound sockets, so there is no window without a listener
+    ListenerSet inherited = { -1, -1, -1 };
+    int predecessor_fd = -1;
+    if (config->restart_path != NULL) {
+        predecessor_fd = hot_restart_connect(config->restart_path, &inherited);
+        if (predecessor_fd != -1) {
+            LOG_INFO("Inherited listeners from predecessor on %s.", config->restart_path);
+        }
+    }
+
+    int server_fd = (inherited.tcp_fd != -1) ? inherited.tcp_fd : setup_tcp_server_socket(port);
     set_non_blocking(server_fd);
 
+    UdpServer* udp_server = udp_server_create(port, inherited.udp_fd);
+    if (udp_server == NULL) {
+        die_with_error("Failed to initialize UDP listener");
+    }
+    int udp_fd = udp_server_fd(udp_server);
+
+    int unix_fd = -1;
+    if (config->unix_path != NULL) {
+        unix_fd = (inherited.unix_fd != -1) ? inherited.unix_fd : setup_unix_server_socket(config->unix_path);
+        set_non_blocking(unix_fd);
+    }
+    else if (inherited.unix_fd != -1) {
+        close(inherited.unix_fd);
+    }
+
+    int restart_fd = -1;
+    if (config->restart_path != NULL) {
+        restart_fd = hot_restart_listen(config->restart_path);
+    }
+    int handed_off = 0;
+    uint32_t deferred_closes = 0;
+
     int epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
         die_with_error("epoll_create1 failed");
     }
+    global_epoll_fd = epoll_fd;
 
-    ClientContext* server_ctx = (ClientContext*)malloc(sizeof(ClientContext));
-    init_client_context(server_ctx, server_fd);
+    upstream_start(epoll_fd, relay_upstream_response);
+
+    ClientContext* server_ctx = connection_table_open(server_fd, TRANSPORT_TCP);
+    if (server_ctx == NULL) {
+        die_with_error("Failed to allocate reactor context");
+    }
 
     struct epoll_event event;
     struct epoll_event events[MAX_EVENTS];
 
     memset(&event, 0, sizeof(struct epoll_event));
-    event.data.ptr = server_ctx;
+    event.data.u64 = connection_table_handle(server_ctx);
     event.events = EPOLLIN | EPOLLET;
 
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event) == -1) {
         die_with_error("epoll_ctl EPOLL_CTL_ADD failed");
     }
 
+    ClientContext* udp_ctx = connection_table_open(udp_fd, TRANSPORT_TCP);
+    if (udp_ctx == NULL) {
+        die_with_error("Failed to allocate reactor context");
+    }
+
+    event.data.u64 = connection_table_handle(udp_ctx);
+    event.events = EPOLLIN | EPOLLET;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, udp_fd, &event) == -1) {
+        die_with_error("epoll_ctl EPOLL_CTL_ADD udp failed");
+    }
+
+    ClientContext* unix_ctx = NULL;
+    if (unix_fd != -1) {
+        unix_ctx = connection_table_open(unix_fd, TRANSPORT_UNIX);
+        if (unix_ctx == NULL) {
+            die_with_error("Failed to allocate reactor context");
+        }
+
+        event.data.u64 = connection_table_handle(unix_ctx);
+        event.events = EPOLLIN | EPOLLET;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, unix_fd, &event) == -1) {
+            die_with_error("epoll_ctl EPOLL_CTL_ADD unix failed");
+        }
+        LOG_INFO("Local clients accepted on unix socket %s (shared-memory rings available).", config->unix_path);
+    }
+
+    ClientContext* restart_ctx = NULL;
+    if (restart_fd != -1) {
+        restart_ctx = connection_table_open(restart_fd, TRANSPORT_TCP);
+        if (restart_ctx == NULL) {
+            die_with_error("Failed to allocate reactor context");
+        }
+
+        event.data.u64 = connection_table_handle(restart_ctx);
+        event.events = EPOLLIN | EPOLLET;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, restart_fd, &event) == -1) {
+            die_with_error("epoll_ctl EPOLL_CTL_ADD restart failed");
+        }
+        LOG_INFO("Hot restart handoff available on %s.", config->restart_path);
+    }
+
+    ClientContext* predecessor_ctx = NULL;
+    if (predecessor_fd != -1) {
+        predecessor_ctx = connection_table_open(predecessor_fd, TRANSPORT_TCP);
+        if (predecessor_ctx == NULL) {
+            die_with_error("Failed to allocate reactor context");
+        }
+
+        event.data.u64 = connection_table_handle(predecessor_ctx);
+        event.events = EPOLLIN | EPOLLET;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, predecessor_fd, &event) == -1) {
+            die_with_error("epoll_ctl EPOLL_CTL_ADD predecessor failed");
+        }
+    }
+
     LOG_INFO("Server listening on port %s (Binary Protocol V1)...", port);
-    LOG_INFO("Thread pool initialized with %ld workers.", core_count);
+    if (max_workers > min_workers) {
+        LOG_INFO("Thread pool initialized with %u workers, elastic up to %u.", min_workers, max_workers);
+    }
+    else {
+        LOG_INFO("Thread pool initialized with %u workers.", min_workers);
+    }
+    if (rate_limited) {
+        LOG_INFO("Rate limits: %u frames/s and %u bytes/s per connection, %u frames/s and %u bytes/s per source (0 = unlimited); %s over-limit frames.",
+            config->connection_limit.frames_per_sec, config->connection_limit.bytes_per_sec,
+            config->source_limit.frames_per_sec, config->source_limit.bytes_per_sec,
+            limit_policy == RATE_LIMIT_DELAY ? "delaying" : "rejecting");
+    }
+    if (zerocopy_threshold > 0) {
+        LOG_INFO("MSG_ZEROCOPY enabled for TCP responses of %u bytes or more.", zerocopy_threshold);
+    }
+    if (compress_threshold > 0) {
+        LOG_INFO("Compression offered to stream clients for payloads of %u bytes or more.", compress_threshold);
+    }
+
+    while (server_running && !handed_off) {
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            trace_dump(config->trace_path);
+        }
 
-    while (server_running) {
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        // Shared-memory sessions only get a doorbell once they announced they are asleep
+        int timeout = shm_transport_prepare_wait();
+        if (deferred_closes > 0 && (timeout < 0 || timeout > DEFERRED_CLOSE_POLL_MS)) {
+            timeout = DEFERRED_CLOSE_POLL_MS;
+        }
+        // Staged capture records must reach the writer even if the traffic stops
+        int capture_timeout = capture_poll();
+        if (capture_timeout >= 0 && (timeout < 0 || timeout > capture_timeout)) {
+            timeout = capture_timeout;
+        }
+        // Also sends every request forwarded during the last batch, before the reactor blocks
+        int upstream_timeout = upstream_poll();
+        if (upstream_timeout >= 0 && (timeout < 0 || timeout > upstream_timeout)) {
+            timeout = upstream_timeout;
+        }
+        int parked_timeout = parked_timeout_ms();
+        if (parked_timeout >= 0 && (timeout < 0 || timeout > parked_timeout)) {
+            timeout = parked_timeout;
+        }
+        if (ready_count > 0) {
+            timeout = 0;
+        }
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
         if (num_events == -1) {
             if (errno == EINTR) {
                 continue;
             }
             die_with_error("epoll_wait failed");
         }
+        // Every bucket refill in this turn uses this one clock read
+        if (rate_limited) {
+            rate_limit_tick();
+        }
 
         for (int i = 0; i < num_events; i++) {
-            ClientContext* ctx = (ClientContext*)events[i].data.ptr;
+            // Sources closed earlier in this batch fail the generation check
+            ClientContext* ctx = connection_table_lookup(events[i].data.u64);
+            if (ctx == NULL) {
+                continue;
+            }
 
             if (ctx->fd == server_fd) {
-                while (1) {
-                    struct sockaddr_in client_addr;
-                    socklen_t client_len = sizeof(client_addr);
-                    int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-
-                    if (client_fd == -1) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                            break;
-                        }
-                        else {
-                            LOG_ERROR("accept failed: %s", strerror(errno));
-                            break;
-                        }
-                    }
-
-                    // Disable Nagle's algorithm for low latency
-                    int flag = 1;
-                    if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int)) == -1) {
-                        LOG_WARN("Failed to set TCP_NODELAY on client socket.");
-                    }
-
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-                    LOG_DEBUG("Accepted connection from %s:%d (fd: %d).", client_ip, ntohs(client_addr.sin_port), client_fd);
-
-                    set_non_blocking(client_fd);
-
-                    ClientContext* new_client_ctx = (ClientContext*)malloc(sizeof(ClientContext));
-                    init_client_context(new_client_ctx, client_fd);
-
-                    event.data.ptr = new_client_ctx;
-                    event.events = EPOLLIN | EPOLLET;
-
-                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1) {
-                        LOG_ERROR("epoll_ctl EPOLL_CTL_ADD client failed: %s", strerror(errno));
-                        close(client_fd);
-                        free(new_client_ctx);
-                    }
+                accept_connections(server_fd, TRANSPORT_TCP);
+            }
+            else if (ctx->fd == unix_fd) {
+                accept_connections(unix_fd, TRANSPORT_UNIX);
+            }
+            else if (ctx->fd == restart_fd) {
+                int successor_fd = accept(restart_fd, NULL, NULL);
+                if (successor_fd != -1) {
+                    ListenerSet listeners = { server_fd, udp_fd, unix_fd };
+                    hand_off_to_successor(successor_fd, &listeners, config->migrate_connections);
+                    // Every client context was released; the rest of this batch is stale
+                    handed_off = 1;
+                    break;
+                }
+            }
+            else if (ctx->fd == predecessor_fd) {
+                if (receive_migrated_connections(predecessor_fd) < 0) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, predecessor_fd, NULL);
+                    close(predecessor_fd);
+                    predecessor_fd = -1;
+                    connection_table_discard(predecessor_ctx);
+                    predecessor_ctx = NULL;
+                    LOG_INFO("Predecessor handoff finished.");
+                }
+            }
+            else if (ctx->shm_session != NULL && ctx == shm_session_doorbell_context(ctx->shm_session)) {
+                if (shm_session_drain(ctx->shm_session) < 0) {
+                    LOG_WARN("Shared-memory session failed; waiting for the connection to close.");
                 }
             }
+            else if (ctx->fd == udp_fd) {
+                udp_server_handle_readable(udp_server);
+            }
+            else if (ctx->flags & CLIENT_FLAG_UPSTREAM) {
+                upstream_handle_event(ctx, events[i].events);
+            }
             else {
-                handle_client_data(ctx);
+                // Zerocopy completions arrive on the error queue and surface as EPOLLERR
+                if ((events[i].events & EPOLLERR) && (ctx->flags & CLIENT_FLAG_ZEROCOPY)) {
+                    zerocopy_harvest(ctx->fd);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    command_dispatch_flush_stream(ctx->fd);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    handle_client_data(ctx);
+                }
             }
         }
+
+        if (!handed_off) {
+            service_ready_connections();
+            service_parked_connections();
+        }
+
+        shm_transport_reap();
+        deferred_closes = connection_table_reap();
     }
 
     LOG_INFO("Initiating graceful shutdown sequence...");
+    upstream_shutdown();
+    log_pool_stats();
     thread_pool_destroy(global_pool);
-    free(server_ctx);
+    connection_table_reap();
+    capture_close();
+    trace_dump(config->trace_path);
+    command_dispatch_shutdown();
+    udp_server_log_stats(udp_server);
+    zerocopy_log_stats();
+    log_compression_stats();
+    rate_limit_log_stats();
+    rate_limit_shutdown();
+    udp_server_destroy(udp_server);
+    connection_table_discard(udp_ctx);
+    // After a handoff both paths belong to the successor and must stay in place
+    if (unix_fd != -1) {
+        close(unix_fd);
+        if (!handed_off) unlink(config->unix_path);
+        connection_table_discard(unix_ctx);
+    }
+    if (restart_fd != -1) {
+        close(restart_fd);
+        if (!handed_off) unlink(config->restart_path);
+        connection_table_discard(restart_ctx);
+    }
+    if (predecessor_fd != -1) {
+        close(predecessor_fd);
+    }
+    if (predecessor_ctx != NULL) {
+        connection_table_discard(predecessor_ctx);
+    }
+    connection_table_discard(server_ctx);
+    free(ready_ring);
+    free(parked);
     close(server_fd);
     close(epoll_fd);
+    drain_payload_pool();
+    arena_log_stats();
+    arena_shutdown();
     LOG_INFO("Server resources released cleanly.");
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+/**
+ * @file hot_restart.c
+ * @brief Implementation of the SCM_RIGHTS handoff between a running server and its successor.
+ */
+#include "server/hot_restart.h"
+#include "common/net_utils.h"
+#include "common/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define HOT_RESTART_MAGIC 0x48524631
+#define HOT_RESTART_CONNECT_TIMEOUT_SEC 5
+
+#define HANDOFF_HAS_TCP  (1u << 0)
+#define HANDOFF_HAS_UDP  (1u << 1)
+#define HANDOFF_HAS_UNIX (1u << 2)
+
+// Carried in HandoffRecord.features above every protocol feature: the frame being read is over its limit
+#define HANDOFF_DISCARDING (1u << 31)
+
+typedef enum {
+    HANDOFF_LISTENERS = 1,
+    HANDOFF_CONNECTION = 2,
+    HANDOFF_DONE = 3
+} HandoffKind;
+
+/**
+ * @brief One SOCK_SEQPACKET message. Connection records are followed by the payload bytes
+ * read so far; both processes run the same binary, so the layout is host-native.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t listener_mask;
+    uint32_t state;
+    uint32_t transport;
+    uint32_t header_bytes_read;
+    uint32_t expected_payload_length;
+    uint32_t payload_bytes_read;
+    uint32_t sequence_number;
+    uint16_t message_type;
+    uint8_t header_buffer[sizeof(PacketHeader)];
+    uint32_t features;          // PROTOCOL_FEATURE_* the peer negotiated, plus HANDOFF_DISCARDING
+} HandoffRecord;
+
+static void init_record(HandoffRecord* record, HandoffKind kind) {
+    memset(record, 0, sizeof(HandoffRecord));
+    record->magic = HOT_RESTART_MAGIC;
+    record->kind = kind;
+}
+
+int hot_restart_listen(const char* path) {
+    int fd = setup_unix_seqpacket_socket(path);
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    return fd;
+}
+
+int hot_restart_connect(const char* path, ListenerSet* listeners) {
+    listeners->tcp_fd = -1;
+    listeners->udp_fd = -1;
+    listeners->unix_fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // No socket file or a stale one: this is a cold start
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    // A wedged predecessor must not block startup forever
+    struct timeval timeout = { HOT_RESTART_CONNECT_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    HandoffRecord record;
+    int fds[3];
+    int fd_count = 3;
+    ssize_t received = recv_with_fds(fd, &record, sizeof(record), fds, &fd_count);
+
+    if (received != (ssize_t)sizeof(record) || record.magic != HOT_RESTART_MAGIC ||
+        record.kind != HANDOFF_LISTENERS) {
+        LOG_WARN("Predecessor on %s did not hand off its listeners; starting cold.", path);
+        for (int i = 0; i < fd_count; i++) {
+            close(fds[i]);
+        }
+        close(fd);
+        return -1;
+    }
+
+    int next = 0;
+    if ((record.listener_mask & HANDOFF_HAS_TCP) && next < fd_count) listeners->tcp_fd = fds[next++];
+    if ((record.listener_mask & HANDOFF_HAS_UDP) && next < fd_count) listeners->udp_fd = fds[next++];
+    if ((record.listener_mask & HANDOFF_HAS_UNIX) && next < fd_count) listeners->unix_fd = fds[next++];
+    while (next < fd_count) {
+        close(fds[next++]);
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    return fd;
+}
+
+int hot_restart_send_listeners(int conn_fd, const ListenerSet* listeners) {
+    HandoffRecord record;
+    int fds[3];
+    int fd_count = 0;
+
+    init_record(&record, HANDOFF_LISTENERS);
+    if (listeners->tcp_fd != -1) {
+        record.listener_mask |= HANDOFF_HAS_TCP;
+        fds[fd_count++] = listeners->tcp_fd;
+    }
+    if (listeners->udp_fd != -1) {
+        record.listener_mask |= HANDOFF_HAS_UDP;
+        fds[fd_count++] = listeners->udp_fd;
+    }
+    if (listeners->unix_fd != -1) {
+        record.listener_mask |= HANDOFF_HAS_UNIX;
+        fds[fd_count++] = listeners->unix_fd;
+    }
+
+    return send_with_fds(conn_fd, &record, sizeof(record), fds, fd_count) == (ssize_t)sizeof(record) ? 0 : -1;
+}
+
+int hot_restart_send_connection(int conn_fd, const ClientContext* ctx) {
+    uint8_t message[sizeof(HandoffRecord) + MAX_PAYLOAD_SIZE];
+    HandoffRecord record;
+
+    init_record(&record, HANDOFF_CONNECTION);
+    record.state = (uint32_t)ctx->state;
+    record.transport = (uint32_t)ctx->transport;
+    record.header_bytes_read = (uint32_t)ctx->header_bytes_read;
+    memcpy(record.header_buffer, ctx->header_buffer, sizeof(record.header_buffer));
+    record.features = (ctx->flags & CLIENT_FLAG_COMPRESS) ? PROTOCOL_FEATURE_COMPRESSION : 0;
+    if (ctx->flags & CLIENT_FLAG_REJECTED) {
+        record.features |= HANDOFF_DISCARDING;
+    }
+
+    if (ctx->state == STATE_READING_PAYLOAD) {
+        PacketHeader header;
+        deserialize_header(ctx->header_buffer, &header);
+        record.expected_payload_length = header.payload_length;
+        record.sequence_number = header.sequence_number;
+        record.message_type = header.type;
+        record.payload_bytes_read = (ctx->pending != NULL) ? ctx->pending->bytes_read : 0;
+    }
+
+    memcpy(message, &record, sizeof(record));
+    if (record.payload_bytes_read > 0) {
+        memcpy(message + sizeof(record), ctx->pending->data, record.payload_bytes_read);
+    }
+
+    size_t len = sizeof(record) + record.payload_bytes_read;
+    return send_with_fds(conn_fd, message, len, &ctx->fd, 1) == (ssize_t)len ? 0 : -1;
+}
+
+void hot_restart_send_done(int conn_fd) {
+    HandoffRecord record;
+    init_record(&record, HANDOFF_DONE);
+    send_with_fds(conn_fd, &record, sizeof(record), NULL, 0);
+}
+
+int hot_restart_receive_connection(int conn_fd, ClientContext* ctx) {
+    uint8_t message[sizeof(HandoffRecord) + MAX_PAYLOAD_SIZE];
+    HandoffRecord record;
+    int fd = -1;
+    int fd_count = 1;
+
+    ssize_t received = recv_with_fds(conn_fd, message, sizeof(message), &fd, &fd_count);
+    if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (received < (ssize_t)sizeof(record)) {
+        if (fd_count > 0) close(fd);
+        return -1;
+    }
+
+    memcpy(&record, message, sizeof(record));
+    if (record.magic != HOT_RESTART_MAGIC || record.kind != HANDOFF_CONNECTION) {
+        if (fd_count > 0) close(fd);
+        return -1;
+    }
+
+    // Reject state the reactor could not have produced rather than trusting it blindly
+    if (fd_count != 1 || record.header_bytes_read > sizeof(PacketHeader) ||
+        record.expected_payload_length > MAX_PAYLOAD_SIZE ||
+        record.payload_bytes_read > record.expected_payload_length ||
+        (record.features & ~(PROTOCOL_FEATURE_COMPRESSION | HANDOFF_DISCARDING)) != 0 ||
+        (size_t)received != sizeof(record) + record.payload_bytes_read ||
+        (record.transport != TRANSPORT_TCP && record.transport != TRANSPORT_UNIX) ||
+        (record.state != STATE_READING_HEADER && record.state != STATE_READING_PAYLOAD) ||
+        (record.state == STATE_READING_PAYLOAD && record.expected_payload_length == 0)) {
+        LOG_WARN("Discarding malformed hot-restart connection record.");
+        if (fd_count > 0) close(fd);
+        return 2;
+    }
+
+    PacketHeader header;
+    deserialize_header(record.header_buffer, &header);
+    if (record.state == STATE_READING_PAYLOAD && header.payload_length != record.expected_payload_length) {
+        LOG_WARN("Discarding hot-restart connection record with inconsistent header.");
+        close(fd);
+        return 2;
+    }
+
+    ctx->fd = fd;
+    ctx->state = (uint8_t)record.state;
+    ctx->transport = (uint8_t)record.transport;
+    ctx->header_bytes_read = (uint8_t)record.header_bytes_read;
+    memcpy(ctx->header_buffer, record.header_buffer, sizeof(ctx->header_buffer));
+    // The peer keeps sending compressed frames whether or not the successor would have granted it
+    if (record.features & PROTOCOL_FEATURE_COMPRESSION) {
+        ctx->flags |= CLIENT_FLAG_COMPRESS;
+    }
+    if (record.features & HANDOFF_DISCARDING) {
+        ctx->flags |= CLIENT_FLAG_REJECTED;
+    }
+
+    // A frame caught mid-payload resumes in a pooled buffer; one caught before its payload needs none yet
+    if (record.payload_bytes_read > 0) {
+        if (reserve_client_payload(ctx) != 0) {
+            LOG_ERROR("Failed to reserve payload buffer for a migrated connection; closing it.");
+            ctx->fd = -1;
+            close(fd);
+            return 2;
+        }
+        memcpy(ctx->pending->data, message + sizeof(record), record.payload_bytes_read);
+        ctx->pending->bytes_read = record.payload_bytes_read;
+    }
+
+    return 1;
+}
@@ -0,0 +1,474 @@
+/**
+ * @file kv_store.c
+ * @brief Implementation of the sharded key-value engine using open addressing, arena allocation and CLOCK eviction.
+ */
+#include "server/kv_store.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#define KV_INITIAL_CAPACITY 64
+#define KV_ARENA_CHUNK_SIZE (64 * 1024)
+#define KV_MIN_CLASS_SHIFT 5
+#define KV_CLASS_COUNT 8
+#define KV_CACHE_LINE 64
+
+// Most items one SET may evict while draining a chunk for another size class
+#define KV_MAX_CHUNK_EVICTIONS 64
+
+/**
+ * @brief Arena-resident entry. Key bytes are immediately followed by value bytes.
+ * While on a free list the hash field is reused as the next-free link.
+ */
+typedef struct KvItem {
+    union {
+        uint64_t hash;
+        struct KvItem* next_free;
+    };
+    uint32_t key_len;
+    uint32_t value_len;
+    uint8_t size_class;
+    uint8_t referenced;
+    uint8_t data[];
+} KvItem;
+
+// Slots carry the full hash so probing rarely has to touch the item itself
+typedef struct {
+    uint64_t hash;
+    KvItem* item;
+} KvSlot;
+
+// Chunks are aligned to their size, so an item finds its chunk by masking its address
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    uint32_t used;
+    uint32_t live;              // Items handed out and not yet freed; 0 means the chunk can be recycled
+    uint8_t data[];
+} ArenaChunk;
+
+#define KV_CHUNK_CAPACITY (KV_ARENA_CHUNK_SIZE - offsetof(ArenaChunk, data))
+
+typedef struct {
+    pthread_mutex_t lock;
+    KvSlot* slots;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t clock_hand;
+    ArenaChunk* chunks;
+    size_t arena_bytes;
+    size_t arena_limit;
+    KvItem* free_lists[KV_CLASS_COUNT];
+} __attribute__((aligned(KV_CACHE_LINE))) KvShard;
+
+struct KvStore {
+    KvShard* shards;
+    uint32_t shard_count;
+    uint32_t shard_mask;
+};
+
+// FNV-1a: cheap, branch-free and good enough for short cache keys
+static uint64_t hash_key(const uint8_t* key, uint32_t key_len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < key_len; i++) {
+        hash ^= key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int size_class_for(size_t size) {
+    for (int cls = 0; cls < KV_CLASS_COUNT; cls++) {
+        if (((size_t)1 << (cls + KV_MIN_CLASS_SHIFT)) >= size) {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+static ArenaChunk* chunk_of(const KvItem* item) {
+    return (ArenaChunk*)((uintptr_t)item & ~(uintptr_t)(KV_ARENA_CHUNK_SIZE - 1));
+}
+
+/*
+ * Under the cap, a chunk whose items have all been freed is taken back for whichever class
+ * needs space. Its blocks are unlinked from every free list and it becomes the bump chunk,
+ * so eviction in one size class can make room for another.
+ */
+static ArenaChunk* recycle_empty_chunk(KvShard* shard) {
+    ArenaChunk** link = &shard->chunks;
+    while (*link != NULL && (*link)->live != 0) {
+        link = &(*link)->next;
+    }
+    ArenaChunk* chunk = *link;
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    for (int cls = 0; cls < KV_CLASS_COUNT; cls++) {
+        KvItem** free_link = &shard->free_lists[cls];
+        while (*free_link != NULL) {
+            if (chunk_of(*free_link) == chunk) {
+                *free_link = (*free_link)->next_free;
+            }
+            else {
+                free_link = &(*free_link)->next_free;
+            }
+        }
+    }
+
+    *link = chunk->next;
+    chunk->next = shard->chunks;
+    shard->chunks = chunk;
+    chunk->used = 0;
+    return chunk;
+}
+
+static KvItem* arena_alloc(KvShard* shard, int cls) {
+    KvItem* item = shard->free_lists[cls];
+    if (item != NULL) {
+        shard->free_lists[cls] = item->next_free;
+        chunk_of(item)->live++;
+        return item;
+    }
+
+    size_t class_size = (size_t)1 << (cls + KV_MIN_CLASS_SHIFT);
+    ArenaChunk* chunk = shard->chunks;
+
+    if (chunk == NULL || chunk->used + class_size > KV_CHUNK_CAPACITY) {
+        if (shard->arena_limit != 0 && shard->arena_bytes + KV_ARENA_CHUNK_SIZE > shard->arena_limit) {
+            chunk = recycle_empty_chunk(shard);
+            if (chunk == NULL) {
+                return NULL;
+            }
+        }
+        else {
+            void* memory = NULL;
+            if (posix_memalign(&memory, KV_ARENA_CHUNK_SIZE, KV_ARENA_CHUNK_SIZE) != 0) {
+                return NULL;
+            }
+            chunk = (ArenaChunk*)memory;
+            chunk->used = 0;
+            chunk->live = 0;
+            chunk->next = shard->chunks;
+            shard->chunks = chunk;
+            shard->arena_bytes += KV_ARENA_CHUNK_SIZE;
+        }
+    }
+
+    item = (KvItem*)(chunk->data + chunk->used);
+    chunk->used += (uint32_t)class_size;
+    chunk->live++;
+    return item;
+}
+
+static void arena_free(KvShard* shard, KvItem* item) {
+    chunk_of(item)->live--;
+    item->next_free = shard->free_lists[item->size_class];
+    shard->free_lists[item->size_class] = item;
+}
+
+static int64_t table_find(const KvShard* shard, uint64_t hash, const uint8_t* key, uint32_t key_len) {
+    uint32_t mask = shard->capacity - 1;
+    uint32_t idx = (uint32_t)hash & mask;
+
+    while (shard->slots[idx].item != NULL) {
+        const KvSlot* slot = &shard->slots[idx];
+        if (slot->hash == hash && slot->item->key_len == key_len &&
+            memcmp(slot->item->data, key, key_len) == 0) {
+            return idx;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return -1;
+}
+
+static void table_place(KvSlot* slots, uint32_t capacity, uint64_t hash, KvItem* item) {
+    uint32_t mask = capacity - 1;
+    uint32_t idx = (uint32_t)hash & mask;
+    while (slots[idx].item != NULL) {
+        idx = (idx + 1) & mask;
+    }
+    slots[idx].hash = hash;
+    slots[idx].item = item;
+}
+
+static int table_grow(KvShard* shard) {
+    uint32_t new_capacity = shard->capacity * 2;
+    KvSlot* new_slots = (KvSlot*)calloc(new_capacity, sizeof(KvSlot));
+    if (new_slots == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < shard->capacity; i++) {
+        if (shard->slots[i].item != NULL) {
+            table_place(new_slots, new_capacity, shard->slots[i].hash, shard->slots[i].item);
+        }
+    }
+
+    free(shard->slots);
+    shard->slots = new_slots;
+    shard->capacity = new_capacity;
+    shard->clock_hand = 0;
+    return 0;
+}
+
+// Backward-shift deletion keeps linear probe chains intact without tombstones
+static void table_remove_at(KvShard* shard, uint32_t idx) {
+    uint32_t mask = shard->capacity - 1;
+    uint32_t hole = idx;
+    uint32_t next = (idx + 1) & mask;
+
+    while (shard->slots[next].item != NULL) {
+        uint32_t home = (uint32_t)shard->slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            shard->slots[hole] = shard->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    shard->slots[hole].item = NULL;
+    shard->slots[hole].hash = 0;
+    shard->count--;
+}
+
+// CLOCK sweep: clears reference bits on the first pass, evicts a cold entry of the requested class
+static int evict_one(KvShard* shard, int cls, const KvItem* keep) {
+    uint32_t budget = shard->capacity * 2;
+    uint32_t mask = shard->capacity - 1;
+
+    while (budget-- > 0 && shard->count > 0) {
+        uint32_t idx = shard->clock_hand;
+        shard->clock_hand = (idx + 1) & mask;
+
+        KvItem* item = shard->slots[idx].item;
+        if (item == NULL || item == keep) continue;
+
+        if (item->referenced) {
+            item->referenced = 0;
+            continue;
+        }
+
+        if (item->size_class != cls) continue;
+
+        table_remove_at(shard, idx);
+        arena_free(shard, item);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * When the class has nothing to evict, the chunk with the fewest live items is drained so
+ * recycle_empty_chunk can hand it to any class. The shard lock is held throughout, so one
+ * call evicts at most KV_MAX_CHUNK_EVICTIONS items; a fuller chunk makes this SET fail and
+ * the next ones continue draining it.
+ */
+static int evict_sparsest_chunk(KvShard* shard, const KvItem* keep) {
+    ArenaChunk* keep_chunk = (keep != NULL) ? chunk_of(keep) : NULL;
+    ArenaChunk* target = NULL;
+    for (ArenaChunk* chunk = shard->chunks; chunk != NULL; chunk = chunk->next) {
+        if (chunk != keep_chunk && chunk->live > 0 && (target == NULL || chunk->live < target->live)) {
+            target = chunk;
+        }
+    }
+    if (target == NULL) {
+        return -1;
+    }
+
+    uint32_t evicted = 0;
+    uint32_t idx = 0;
+    while (target->live > 0 && evicted < KV_MAX_CHUNK_EVICTIONS && idx < shard->capacity) {
+        KvItem* item = shard->slots[idx].item;
+        if (item != NULL && chunk_of(item) == target) {
+            // Backward shift may move another entry into idx, so it is checked again
+            table_remove_at(shard, idx);
+            arena_free(shard, item);
+            evicted++;
+            continue;
+        }
+        idx++;
+    }
+    return target->live == 0 ? 0 : -1;
+}
+
+static KvShard* shard_for(KvStore* store, uint64_t hash) {
+    return &store->shards[(uint32_t)(hash >> 32) & store->shard_mask];
+}
+
+KvStore* kv_store_create(uint32_t shard_count, size_t memory_limit) {
+    KvStore* store = (KvStore*)malloc(sizeof(KvStore));
+    if (store == NULL) {
+        return NULL;
+    }
+
+    uint32_t count = 1;
+    while (count < shard_count) {
+        count <<= 1;
+    }
+
+    void* shards = NULL;
+    if (posix_memalign(&shards, KV_CACHE_LINE, sizeof(KvShard) * count) != 0) {
+        free(store);
+        return NULL;
+    }
+    memset(shards, 0, sizeof(KvShard) * count);
+
+    store->shards = (KvShard*)shards;
+    store->shard_count = count;
+    store->shard_mask = count - 1;
+
+    // Every shard is allowed at least one chunk so small caps still accept writes
+    size_t shard_limit = 0;
+    if (memory_limit != 0) {
+        shard_limit = memory_limit / count;
+        if (shard_limit < KV_ARENA_CHUNK_SIZE) {
+            shard_limit = KV_ARENA_CHUNK_SIZE;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        KvShard* shard = &store->shards[i];
+        shard->arena_limit = shard_limit;
+        shard->capacity = KV_INITIAL_CAPACITY;
+        shard->slots = (KvSlot*)calloc(KV_INITIAL_CAPACITY, sizeof(KvSlot));
+
+        if (shard->slots == NULL || pthread_mutex_init(&shard->lock, NULL) != 0) {
+            store->shard_count = i;
+            free(shard->slots);
+            kv_store_destroy(store);
+            return NULL;
+        }
+    }
+
+    return store;
+}
+
+int kv_store_get(KvStore* store, const uint8_t* key, uint32_t key_len,
+    uint8_t* out, uint32_t out_capacity, uint32_t* out_len) {
+    uint64_t hash = hash_key(key, key_len);
+    KvShard* shard = shard_for(store, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    int64_t idx = table_find(shard, hash, key, key_len);
+    if (idx < 0) {
+        pthread_mutex_unlock(&shard->lock);
+        *out_len = 0;
+        return -1;
+    }
+
+    KvItem* item = shard->slots[idx].item;
+    item->referenced = 1;
+
+    uint32_t copy_len = item->value_len < out_capacity ? item->value_len : out_capacity;
+    memcpy(out, item->data + item->key_len, copy_len);
+    *out_len = copy_len;
+
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+int kv_store_set(KvStore* store, const uint8_t* key, uint32_t key_len,
+    const uint8_t* value, uint32_t value_len) {
+    int cls = size_class_for(sizeof(KvItem) + (size_t)key_len + value_len);
+    if (cls < 0) {
+        return -1;
+    }
+
+    uint64_t hash = hash_key(key, key_len);
+    KvShard* shard = shard_for(store, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    int64_t idx = table_find(shard, hash, key, key_len);
+    KvItem* existing = idx >= 0 ? shard->slots[idx].item : NULL;
+
+    // Same size class: overwrite the value in place without touching the table
+    if (existing != NULL && existing->size_class == cls) {
+        memcpy(existing->data + key_len, value, value_len);
+        existing->value_len = value_len;
+        existing->referenced = 1;
+        pthread_mutex_unlock(&shard->lock);
+        return 0;
+    }
+
+    // The old entry stays in place until the new one has memory, so a failed SET loses nothing
+    KvItem* item = arena_alloc(shard, cls);
+    if (item == NULL && shard->arena_limit != 0 &&
+        (evict_one(shard, cls, existing) == 0 || evict_sparsest_chunk(shard, existing) == 0)) {
+        item = arena_alloc(shard, cls);
+    }
+
+    if (item == NULL) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    if (existing != NULL) {
+        // Evictions shift slots, so the old entry is looked up again
+        table_remove_at(shard, (uint32_t)table_find(shard, hash, key, key_len));
+        arena_free(shard, existing);
+    }
+    else if ((shard->count + 1) * 4 > shard->capacity * 3 && table_grow(shard) != 0) {
+        item->size_class = (uint8_t)cls;
+        arena_free(shard, item);
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    item->key_len = key_len;
+    item->value_len = value_len;
+    item->size_class = (uint8_t)cls;
+    item->referenced = 0;
+    memcpy(item->data, key, key_len);
+    memcpy(item->data + key_len, value, value_len);
+
+    table_place(shard->slots, shard->capacity, hash, item);
+    shard->count++;
+
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+int kv_store_delete(KvStore* store, const uint8_t* key, uint32_t key_len) {
+    uint64_t hash = hash_key(key, key_len);
+    KvShard* shard = shard_for(store, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    int64_t idx = table_find(shard, hash, key, key_len);
+    if (idx < 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    KvItem* item = shard->slots[idx].item;
+    table_remove_at(shard, (uint32_t)idx);
+    arena_free(shard, item);
+
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+void kv_store_destroy(KvStore* store) {
+    if (store == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < store->shard_count; i++) {
+        KvShard* shard = &store->shards[i];
+        ArenaChunk* chunk = shard->chunks;
+        while (chunk != NULL) {
+            ArenaChunk* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(shard->slots);
+        pthread_mutex_destroy(&shard->lock);
+    }
+
+    free(store->shards);
+    free(store);
+}
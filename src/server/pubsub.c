@@ -0,0 +1,508 @@
+/**
+ * @file pubsub.c
+ * @brief Implementation of the publish/subscribe engine with refcounted shared frames and bounded subscriber queues.
+ */
+#include "server/pubsub.h"
+#include "protocol/protocol.h"
+#include "common/logger.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define PUBSUB_TOPIC_BUCKETS 256
+#define PUBSUB_FD_BUCKETS 1024
+#define PUBSUB_IOV_BATCH 64
+
+/**
+ * @brief A serialized frame shared by every queue it was published to.
+ */
+typedef struct {
+    atomic_uint refcount;
+    uint32_t length;
+    uint8_t data[];
+} SharedFrame;
+
+struct Topic;
+
+typedef struct Subscriber {
+    int fd;
+    int disconnecting;
+    pthread_mutex_t lock;
+
+    SharedFrame** queue;
+    uint32_t head;
+    uint32_t count;
+    size_t head_offset;
+    uint64_t dropped;
+
+    struct Topic** topics;
+    uint32_t topic_count;
+    uint32_t topic_capacity;
+
+    struct Subscriber* next;
+} Subscriber;
+
+typedef struct Topic {
+    uint8_t name[PUBSUB_MAX_TOPIC_LENGTH];
+    uint32_t name_len;
+    uint64_t hash;
+
+    Subscriber** subscribers;
+    uint32_t subscriber_count;
+    uint32_t subscriber_capacity;
+
+    struct Topic* next;
+} Topic;
+
+struct PubSub {
+    pthread_rwlock_t lock;
+    Topic* topics[PUBSUB_TOPIC_BUCKETS];
+    Subscriber* subscribers[PUBSUB_FD_BUCKETS];
+    atomic_uint subscriber_total;
+    uint32_t queue_depth;
+    PubSubSlowPolicy policy;
+};
+
+static uint64_t hash_topic(const uint8_t* topic, uint32_t topic_len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < topic_len; i++) {
+        hash ^= topic[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static SharedFrame* shared_frame_alloc(uint32_t length) {
+    SharedFrame* frame = (SharedFrame*)malloc(sizeof(SharedFrame) + length);
+    if (frame == NULL) {
+        return NULL;
+    }
+    atomic_init(&frame->refcount, 1);
+    frame->length = length;
+    return frame;
+}
+
+static void shared_frame_release(SharedFrame* frame) {
+    if (atomic_fetch_sub_explicit(&frame->refcount, 1, memory_order_acq_rel) == 1) {
+        free(frame);
+    }
+}
+
+// Grows a pointer array by doubling; returns -1 if the allocation fails
+static int ensure_capacity(void*** items, uint32_t* capacity, uint32_t needed) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    uint32_t new_capacity = (*capacity == 0) ? 4 : *capacity * 2;
+    void** grown = (void**)realloc(*items, sizeof(void*) * new_capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static Topic* find_topic(PubSub* pubsub, const uint8_t* name, uint32_t name_len, uint64_t hash) {
+    Topic* topic = pubsub->topics[hash % PUBSUB_TOPIC_BUCKETS];
+    while (topic != NULL) {
+        if (topic->hash == hash && topic->name_len == name_len && memcmp(topic->name, name, name_len) == 0) {
+            return topic;
+        }
+        topic = topic->next;
+    }
+    return NULL;
+}
+
+static Subscriber* find_subscriber(PubSub* pubsub, int fd) {
+    Subscriber* sub = pubsub->subscribers[(uint32_t)fd % PUBSUB_FD_BUCKETS];
+    while (sub != NULL && sub->fd != fd) {
+        sub = sub->next;
+    }
+    return sub;
+}
+
+// Writes queued frames with a single gathered sendmsg per batch until the socket would block
+static void subscriber_flush_locked(PubSub* pubsub, Subscriber* sub) {
+    while (sub->count > 0 && !sub->disconnecting) {
+        struct iovec iov[PUBSUB_IOV_BATCH];
+        uint32_t iov_count = 0;
+
+        for (uint32_t i = 0; i < sub->count && iov_count < PUBSUB_IOV_BATCH; i++) {
+            SharedFrame* frame = sub->queue[(sub->head + i) % pubsub->queue_depth];
+            size_t offset = (i == 0) ? sub->head_offset : 0;
+            iov[iov_count].iov_base = frame->data + offset;
+            iov[iov_count].iov_len = frame->length - offset;
+            iov_count++;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+
+        ssize_t sent = sendmsg(sub->fd, &msg, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return;
+            }
+            LOG_DEBUG("Subscriber fd %d write failed: %s", sub->fd, strerror(errno));
+            sub->disconnecting = 1;
+            return;
+        }
+
+        size_t remaining = (size_t)sent;
+        while (remaining > 0) {
+            SharedFrame* frame = sub->queue[sub->head];
+            size_t left = frame->length - sub->head_offset;
+            if (remaining < left) {
+                sub->head_offset += remaining;
+                break;
+            }
+            remaining -= left;
+            sub->head_offset = 0;
+            sub->head = (sub->head + 1) % pubsub->queue_depth;
+            sub->count--;
+            shared_frame_release(frame);
+        }
+
+        if (sub->count > 0 && sub->head_offset > 0) {
+            return;
+        }
+    }
+}
+
+// Takes a reference on the frame if it fits; applies the slow-subscriber policy otherwise
+static int subscriber_enqueue_locked(PubSub* pubsub, Subscriber* sub, SharedFrame* frame) {
+    if (sub->disconnecting) {
+        return -1;
+    }
+
+    if (sub->count == pubsub->queue_depth) {
+        sub->dropped++;
+        if (pubsub->policy == PUBSUB_POLICY_DISCONNECT) {
+            LOG_WARN("Subscriber fd %d exceeded queue depth %u, disconnecting.", sub->fd, pubsub->queue_depth);
+            sub->disconnecting = 1;
+            shutdown(sub->fd, SHUT_RDWR);
+        }
+        return -1;
+    }
+
+    atomic_fetch_add_explicit(&frame->refcount, 1, memory_order_relaxed);
+    sub->queue[(sub->head + sub->count) % pubsub->queue_depth] = frame;
+    sub->count++;
+
+    // Only the first queued frame triggers an inline write; later ones ride the same flush
+    if (sub->count == 1) {
+        subscriber_flush_locked(pubsub, sub);
+    }
+    return 0;
+}
+
+static void detach_from_topic(Topic* topic, Subscriber* sub) {
+    for (uint32_t i = 0; i < topic->subscriber_count; i++) {
+        if (topic->subscribers[i] == sub) {
+            topic->subscribers[i] = topic->subscribers[--topic->subscriber_count];
+            return;
+        }
+    }
+}
+
+static void free_topic_if_empty(PubSub* pubsub, Topic* topic) {
+    if (topic->subscriber_count > 0) {
+        return;
+    }
+
+    Topic** link = &pubsub->topics[topic->hash % PUBSUB_TOPIC_BUCKETS];
+    while (*link != topic) {
+        link = &(*link)->next;
+    }
+    *link = topic->next;
+    free(topic->subscribers);
+    free(topic);
+}
+
+PubSub* pubsub_create(uint32_t queue_depth, PubSubSlowPolicy policy) {
+    PubSub* pubsub = (PubSub*)calloc(1, sizeof(PubSub));
+    if (pubsub == NULL) {
+        return NULL;
+    }
+
+    if (pthread_rwlock_init(&pubsub->lock, NULL) != 0) {
+        free(pubsub);
+        return NULL;
+    }
+
+    atomic_init(&pubsub->subscriber_total, 0);
+    pubsub->queue_depth = (queue_depth == 0) ? 1 : queue_depth;
+    pubsub->policy = policy;
+    return pubsub;
+}
+
+int pubsub_subscribe(PubSub* pubsub, int fd, const uint8_t* topic_name, uint32_t topic_len) {
+    if (topic_len == 0 || topic_len > PUBSUB_MAX_TOPIC_LENGTH) {
+        return -1;
+    }
+
+    uint64_t hash = hash_topic(topic_name, topic_len);
+    pthread_rwlock_wrlock(&pubsub->lock);
+
+    Subscriber* sub = find_subscriber(pubsub, fd);
+    if (sub == NULL) {
+        sub = (Subscriber*)calloc(1, sizeof(Subscriber));
+        if (sub == NULL) goto fail;
+
+        sub->queue = (SharedFrame**)malloc(sizeof(SharedFrame*) * pubsub->queue_depth);
+        if (sub->queue == NULL || pthread_mutex_init(&sub->lock, NULL) != 0) {
+            free(sub->queue);
+            free(sub);
+            goto fail;
+        }
+
+        sub->fd = fd;
+        sub->next = pubsub->subscribers[(uint32_t)fd % PUBSUB_FD_BUCKETS];
+        pubsub->subscribers[(uint32_t)fd % PUBSUB_FD_BUCKETS] = sub;
+        atomic_fetch_add(&pubsub->subscriber_total, 1);
+    }
+
+    Topic* topic = find_topic(pubsub, topic_name, topic_len, hash);
+    if (topic == NULL) {
+        topic = (Topic*)calloc(1, sizeof(Topic));
+        if (topic == NULL) goto fail;
+
+        memcpy(topic->name, topic_name, topic_len);
+        topic->name_len = topic_len;
+        topic->hash = hash;
+        topic->next = pubsub->topics[hash % PUBSUB_TOPIC_BUCKETS];
+        pubsub->topics[hash % PUBSUB_TOPIC_BUCKETS] = topic;
+    }
+
+    for (uint32_t i = 0; i < sub->topic_count; i++) {
+        if (sub->topics[i] == topic) {
+            pthread_rwlock_unlock(&pubsub->lock);
+            return 0;
+        }
+    }
+
+    if (ensure_capacity((void***)&topic->subscribers, &topic->subscriber_capacity, topic->subscriber_count + 1) != 0 ||
+        ensure_capacity((void***)&sub->topics, &sub->topic_capacity, sub->topic_count + 1) != 0) {
+        free_topic_if_empty(pubsub, topic);
+        goto fail;
+    }
+
+    topic->subscribers[topic->subscriber_count++] = sub;
+    sub->topics[sub->topic_count++] = topic;
+
+    pthread_rwlock_unlock(&pubsub->lock);
+    return 0;
+
+fail:
+    pthread_rwlock_unlock(&pubsub->lock);
+    return -1;
+}
+
+int pubsub_unsubscribe(PubSub* pubsub, int fd, const uint8_t* topic_name, uint32_t topic_len) {
+    uint64_t hash = hash_topic(topic_name, topic_len);
+    int rc = -1;
+
+    pthread_rwlock_wrlock(&pubsub->lock);
+
+    Subscriber* sub = find_subscriber(pubsub, fd);
+    Topic* topic = find_topic(pubsub, topic_name, topic_len, hash);
+
+    if (sub != NULL && topic != NULL) {
+        for (uint32_t i = 0; i < sub->topic_count; i++) {
+            if (sub->topics[i] == topic) {
+                sub->topics[i] = sub->topics[--sub->topic_count];
+                detach_from_topic(topic, sub);
+                free_topic_if_empty(pubsub, topic);
+                rc = 0;
+                break;
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&pubsub->lock);
+    return rc;
+}
+
+int pubsub_publish(PubSub* pubsub, const uint8_t* topic_name, uint32_t topic_len,
+    const uint8_t* message, uint32_t message_len) {
+    if (topic_len == 0 || topic_len > PUBSUB_MAX_TOPIC_LENGTH) {
+        return -1;
+    }
+
+    uint64_t hash = hash_topic(topic_name, topic_len);
+    int delivered = 0;
+
+    pthread_rwlock_rdlock(&pubsub->lock);
+
+    Topic* topic = find_topic(pubsub, topic_name, topic_len, hash);
+    if (topic == NULL || topic->subscriber_count == 0) {
+        pthread_rwlock_unlock(&pubsub->lock);
+        return 0;
+    }
+
+    // Serialize exactly once; every subscriber queue references the same bytes
+    uint32_t payload_len = PUBSUB_TOPIC_LENGTH_SIZE + topic_len + message_len;
+    SharedFrame* frame = shared_frame_alloc((uint32_t)sizeof(PacketHeader) + payload_len);
+    if (frame == NULL) {
+        pthread_rwlock_unlock(&pubsub->lock);
+        return -1;
+    }
+
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = PACKET_TYPE_PUBLISH;
+    header.sequence_number = 0;
+    header.payload_length = payload_len;
+    serialize_header(&header, frame->data);
+
+    uint8_t* payload = frame->data + sizeof(PacketHeader);
+    payload[0] = (uint8_t)(topic_len >> 8);
+    payload[1] = (uint8_t)topic_len;
+    memcpy(payload + PUBSUB_TOPIC_LENGTH_SIZE, topic_name, topic_len);
+    if (message_len > 0) {
+        memcpy(payload + PUBSUB_TOPIC_LENGTH_SIZE + topic_len, message, message_len);
+    }
+
+    for (uint32_t i = 0; i < topic->subscriber_count; i++) {
+        Subscriber* sub = topic->subscribers[i];
+        pthread_mutex_lock(&sub->lock);
+        if (subscriber_enqueue_locked(pubsub, sub, frame) == 0) {
+            delivered++;
+        }
+        pthread_mutex_unlock(&sub->lock);
+    }
+
+    pthread_rwlock_unlock(&pubsub->lock);
+    shared_frame_release(frame);
+    return delivered;
+}
+
+int pubsub_send(PubSub* pubsub, int fd, const uint8_t* frame_data, uint32_t frame_len) {
+    if (atomic_load_explicit(&pubsub->subscriber_total, memory_order_relaxed) == 0) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&pubsub->lock);
+
+    Subscriber* sub = find_subscriber(pubsub, fd);
+    if (sub == NULL) {
+        pthread_rwlock_unlock(&pubsub->lock);
+        return -1;
+    }
+
+    SharedFrame* frame = shared_frame_alloc(frame_len);
+    if (frame != NULL) {
+        memcpy(frame->data, frame_data, frame_len);
+        pthread_mutex_lock(&sub->lock);
+        subscriber_enqueue_locked(pubsub, sub, frame);
+        pthread_mutex_unlock(&sub->lock);
+        shared_frame_release(frame);
+    }
+
+    pthread_rwlock_unlock(&pubsub->lock);
+    return 0;
+}
+
+void pubsub_flush(PubSub* pubsub, int fd) {
+    if (atomic_load_explicit(&pubsub->subscriber_total, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    pthread_rwlock_rdlock(&pubsub->lock);
+
+    Subscriber* sub = find_subscriber(pubsub, fd);
+    if (sub != NULL) {
+        pthread_mutex_lock(&sub->lock);
+        subscriber_flush_locked(pubsub, sub);
+        pthread_mutex_unlock(&sub->lock);
+    }
+
+    pthread_rwlock_unlock(&pubsub->lock);
+}
+
+int pubsub_has_connection(PubSub* pubsub, int fd) {
+    if (atomic_load_explicit(&pubsub->subscriber_total, memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&pubsub->lock);
+    int found = find_subscriber(pubsub, fd) != NULL;
+    pthread_rwlock_unlock(&pubsub->lock);
+    return found;
+}
+
+static void subscriber_free(PubSub* pubsub, Subscriber* sub) {
+    while (sub->count > 0) {
+        shared_frame_release(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % pubsub->queue_depth;
+        sub->count--;
+    }
+    pthread_mutex_destroy(&sub->lock);
+    free(sub->queue);
+    free(sub->topics);
+    free(sub);
+}
+
+void pubsub_remove_connection(PubSub* pubsub, int fd) {
+    if (atomic_load_explicit(&pubsub->subscriber_total, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&pubsub->lock);
+
+    Subscriber** link = &pubsub->subscribers[(uint32_t)fd % PUBSUB_FD_BUCKETS];
+    while (*link != NULL && (*link)->fd != fd) {
+        link = &(*link)->next;
+    }
+
+    Subscriber* sub = *link;
+    if (sub != NULL) {
+        *link = sub->next;
+        for (uint32_t i = 0; i < sub->topic_count; i++) {
+            detach_from_topic(sub->topics[i], sub);
+            free_topic_if_empty(pubsub, sub->topics[i]);
+        }
+        if (sub->dropped > 0) {
+            LOG_INFO("Subscriber fd %d closed after dropping %llu frames.", fd, (unsigned long long)sub->dropped);
+        }
+        subscriber_free(pubsub, sub);
+        atomic_fetch_sub(&pubsub->subscriber_total, 1);
+    }
+
+    pthread_rwlock_unlock(&pubsub->lock);
+}
+
+void pubsub_destroy(PubSub* pubsub) {
+    if (pubsub == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < PUBSUB_FD_BUCKETS; i++) {
+        Subscriber* sub = pubsub->subscribers[i];
+        while (sub != NULL) {
+            Subscriber* next = sub->next;
+            subscriber_free(pubsub, sub);
+            sub = next;
+        }
+    }
+
+    for (uint32_t i = 0; i < PUBSUB_TOPIC_BUCKETS; i++) {
+        Topic* topic = pubsub->topics[i];
+        while (topic != NULL) {
+            Topic* next = topic->next;
+            free(topic->subscribers);
+            free(topic);
+            topic = next;
+        }
+    }
+
+    pthread_rwlock_destroy(&pubsub->lock);
+    free(pubsub);
+}
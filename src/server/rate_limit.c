@@ -0,0 +1,338 @@
+/**
+ * @file rate_limit.c
+ * @brief Implementation of the reactor's token buckets with slot-indexed connection state and a source address table.
+ */
+#include "server/rate_limit.h"
+#include "server/connection_table.h"
+#include "protocol/protocol.h"
+#include "common/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+
+// Credits are tokens scaled by this, so microseconds times a per-second rate adds credit exactly
+#define CREDIT_SCALE 1000000ll
+
+// Idle longer than this and a bucket is simply full again
+#define REFILL_HORIZON_US 10000000ull
+
+/**
+ * @brief Credit in both dimensions as of refilled_us.
+ */
+typedef struct {
+    int64_t frame_credit;
+    int64_t byte_credit;
+    uint64_t refilled_us;
+} TokenBucket;
+
+/**
+ * @brief Rates and depths shared by every bucket of one kind.
+ */
+typedef struct {
+    int64_t frame_rate;
+    int64_t byte_rate;
+    int64_t frame_capacity;
+    int64_t byte_capacity;
+} BucketShape;
+
+// 32 bytes, so two connections share a cache line
+typedef struct {
+    TokenBucket bucket;
+    uint32_t source;            // Source table index plus one, 0 if the connection has none
+    uint32_t attached;
+} ConnectionLimit;
+
+typedef struct {
+    uint8_t address[16];
+    uint8_t length;             // 4 or 16, 0 for a slot that was never used
+    uint32_t connections;
+    TokenBucket bucket;
+} SourceLimit;
+
+// Indexed like the connection table, so a slot's bucket never moves
+static ConnectionLimit* limit_chunks[CONNECTION_TABLE_MAX_CHUNKS];
+static SourceLimit* sources = NULL;
+
+static BucketShape connection_shape;
+static BucketShape source_shape;
+static int connection_limited = 0;
+static int source_limited = 0;
+
+static uint64_t now_us = 0;
+static uint64_t delayed_frames = 0;
+static uint64_t rejected_frames = 0;
+static uint64_t untracked_sources = 0;
+
+static BucketShape make_shape(RateLimit limit) {
+    BucketShape shape;
+    int64_t burst_frames = (int64_t)limit.frames_per_sec * RATE_LIMIT_BURST_MS / 1000;
+    int64_t burst_bytes = (int64_t)limit.bytes_per_sec * RATE_LIMIT_BURST_MS / 1000;
+    int64_t largest_frame = (int64_t)sizeof(PacketHeader) + MAX_PAYLOAD_SIZE + PACKET_CRC32C_SIZE;
+
+    shape.frame_rate = limit.frames_per_sec;
+    shape.byte_rate = limit.bytes_per_sec;
+    shape.frame_capacity = (burst_frames > 1 ? burst_frames : 1) * CREDIT_SCALE;
+    shape.byte_capacity = (burst_bytes > largest_frame ? burst_bytes : largest_frame) * CREDIT_SCALE;
+    return shape;
+}
+
+static void fill_bucket(TokenBucket* bucket, const BucketShape* shape) {
+    bucket->frame_credit = shape->frame_capacity;
+    bucket->byte_credit = shape->byte_capacity;
+    bucket->refilled_us = now_us;
+}
+
+static void refill_bucket(TokenBucket* bucket, const BucketShape* shape) {
+    uint64_t elapsed = now_us - bucket->refilled_us;
+    if (elapsed == 0) {
+        return;
+    }
+    if (elapsed >= REFILL_HORIZON_US) {
+        fill_bucket(bucket, shape);
+        return;
+    }
+
+    bucket->refilled_us = now_us;
+    bucket->frame_credit += (int64_t)elapsed * shape->frame_rate;
+    if (bucket->frame_credit > shape->frame_capacity) {
+        bucket->frame_credit = shape->frame_capacity;
+    }
+    bucket->byte_credit += (int64_t)elapsed * shape->byte_rate;
+    if (bucket->byte_credit > shape->byte_capacity) {
+        bucket->byte_credit = shape->byte_capacity;
+    }
+}
+
+// A frame needs a whole frame token and any positive byte credit
+static uint64_t bucket_wait(const TokenBucket* bucket, const BucketShape* shape) {
+    uint64_t wait = 0;
+    if (shape->frame_rate > 0 && bucket->frame_credit < CREDIT_SCALE) {
+        wait = (uint64_t)((CREDIT_SCALE - bucket->frame_credit + shape->frame_rate - 1) / shape->frame_rate);
+    }
+    if (shape->byte_rate > 0 && bucket->byte_credit <= 0) {
+        uint64_t byte_wait = (uint64_t)(-bucket->byte_credit / shape->byte_rate) + 1;
+        if (byte_wait > wait) {
+            wait = byte_wait;
+        }
+    }
+    return wait;
+}
+
+static void charge_bucket(TokenBucket* bucket, const BucketShape* shape, uint32_t frame_bytes) {
+    if (shape->frame_rate > 0) {
+        bucket->frame_credit -= CREDIT_SCALE;
+    }
+    if (shape->byte_rate > 0) {
+        bucket->byte_credit -= (int64_t)frame_bytes * CREDIT_SCALE;
+    }
+}
+
+static ConnectionLimit* limit_at(uint32_t slot) {
+    ConnectionLimit* chunk = limit_chunks[slot / CONNECTION_TABLE_CHUNK_SIZE];
+    return chunk != NULL ? &chunk[slot % CONNECTION_TABLE_CHUNK_SIZE] : NULL;
+}
+
+// Mapped IPv4 peers on a dual-stack listener share the bucket of the plain IPv4 address
+static int source_key(const struct sockaddr* peer, uint8_t* address) {
+    if (peer->sa_family == AF_INET) {
+        memcpy(address, &((const struct sockaddr_in*)peer)->sin_addr, 4);
+        return 4;
+    }
+    if (peer->sa_family == AF_INET6) {
+        const uint8_t* bytes = ((const struct sockaddr_in6*)peer)->sin6_addr.s6_addr;
+        static const uint8_t mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+        if (memcmp(bytes, mapped_prefix, sizeof(mapped_prefix)) == 0) {
+            memcpy(address, bytes + 12, 4);
+            return 4;
+        }
+        memcpy(address, bytes, 16);
+        return 16;
+    }
+    return 0;
+}
+
+static uint32_t hash_source(const uint8_t* address, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ address[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Linear probing without deletion: slots are never emptied, so probe chains stay intact.
+ * A source with no connections left whose bucket has had a full burst window to refill
+ * carries no state worth keeping, so its slot is reused by the next new source.
+ */
+static uint32_t find_source(const struct sockaddr* peer) {
+    uint8_t address[16];
+    int length = source_key(peer, address);
+    if (length == 0) {
+        return 0;
+    }
+
+    uint32_t index = hash_source(address, length) & (RATE_LIMIT_SOURCE_SLOTS - 1);
+    uint32_t reusable = RATE_LIMIT_SOURCE_SLOTS;
+    for (uint32_t probe = 0; probe < RATE_LIMIT_SOURCE_SLOTS; probe++) {
+        SourceLimit* entry = &sources[index];
+        if (entry->length == length && memcmp(entry->address, address, (size_t)length) == 0) {
+            return index + 1;
+        }
+        if (entry->length == 0) {
+            break;
+        }
+        if (reusable == RATE_LIMIT_SOURCE_SLOTS && entry->connections == 0 &&
+            now_us - entry->bucket.refilled_us >= (uint64_t)RATE_LIMIT_BURST_MS * 1000ull) {
+            reusable = index;
+        }
+        index = (index + 1) & (RATE_LIMIT_SOURCE_SLOTS - 1);
+    }
+
+    if (sources[index].length != 0) {
+        if (reusable == RATE_LIMIT_SOURCE_SLOTS) {
+            untracked_sources++;
+            return 0;
+        }
+        index = reusable;
+    }
+    else if (reusable != RATE_LIMIT_SOURCE_SLOTS) {
+        index = reusable;
+    }
+
+    SourceLimit* entry = &sources[index];
+    memcpy(entry->address, address, (size_t)length);
+    entry->length = (uint8_t)length;
+    entry->connections = 0;
+    fill_bucket(&entry->bucket, &source_shape);
+    return index + 1;
+}
+
+int rate_limit_configure(RateLimit per_connection, RateLimit per_source) {
+    connection_shape = make_shape(per_connection);
+    source_shape = make_shape(per_source);
+    connection_limited = per_connection.frames_per_sec > 0 || per_connection.bytes_per_sec > 0;
+    source_limited = per_source.frames_per_sec > 0 || per_source.bytes_per_sec > 0;
+
+    if (source_limited) {
+        sources = (SourceLimit*)calloc(RATE_LIMIT_SOURCE_SLOTS, sizeof(SourceLimit));
+        if (sources == NULL) {
+            return -1;
+        }
+    }
+    rate_limit_tick();
+    return 0;
+}
+
+int rate_limit_enabled(void) {
+    return connection_limited || source_limited;
+}
+
+void rate_limit_tick(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now_us = (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+uint64_t rate_limit_now_us(void) {
+    return now_us;
+}
+
+void rate_limit_attach(uint32_t slot, const struct sockaddr* peer) {
+    if (!rate_limit_enabled()) {
+        return;
+    }
+
+    uint32_t chunk = slot / CONNECTION_TABLE_CHUNK_SIZE;
+    if (limit_chunks[chunk] == NULL) {
+        limit_chunks[chunk] = (ConnectionLimit*)calloc(CONNECTION_TABLE_CHUNK_SIZE, sizeof(ConnectionLimit));
+        if (limit_chunks[chunk] == NULL) {
+            LOG_ERROR("Failed to allocate rate limit state; slot %u is not limited.", slot);
+            return;
+        }
+    }
+
+    ConnectionLimit* limit = limit_at(slot);
+    fill_bucket(&limit->bucket, &connection_shape);
+    limit->attached = 1;
+    limit->source = (source_limited && peer != NULL) ? find_source(peer) : 0;
+    if (limit->source != 0) {
+        sources[limit->source - 1].connections++;
+    }
+}
+
+void rate_limit_detach(uint32_t slot) {
+    ConnectionLimit* limit = limit_at(slot);
+    if (limit == NULL || !limit->attached) {
+        return;
+    }
+
+    if (limit->source != 0) {
+        sources[limit->source - 1].connections--;
+        limit->source = 0;
+    }
+    limit->attached = 0;
+}
+
+uint64_t rate_limit_check(uint32_t slot) {
+    ConnectionLimit* limit = limit_at(slot);
+    if (limit == NULL || !limit->attached) {
+        return 0;
+    }
+
+    uint64_t wait = 0;
+    if (connection_limited) {
+        refill_bucket(&limit->bucket, &connection_shape);
+        wait = bucket_wait(&limit->bucket, &connection_shape);
+    }
+    if (limit->source != 0) {
+        TokenBucket* bucket = &sources[limit->source - 1].bucket;
+        refill_bucket(bucket, &source_shape);
+        uint64_t source_wait = bucket_wait(bucket, &source_shape);
+        if (source_wait > wait) {
+            wait = source_wait;
+        }
+    }
+    return wait;
+}
+
+void rate_limit_charge(uint32_t slot, uint32_t frame_bytes) {
+    ConnectionLimit* limit = limit_at(slot);
+    if (limit == NULL || !limit->attached) {
+        return;
+    }
+
+    if (connection_limited) {
+        charge_bucket(&limit->bucket, &connection_shape, frame_bytes);
+    }
+    if (limit->source != 0) {
+        charge_bucket(&sources[limit->source - 1].bucket, &source_shape, frame_bytes);
+    }
+}
+
+void rate_limit_count(RateLimitPolicy policy) {
+    if (policy == RATE_LIMIT_DELAY) {
+        delayed_frames++;
+    }
+    else {
+        rejected_frames++;
+    }
+}
+
+void rate_limit_log_stats(void) {
+    if (!rate_limit_enabled()) {
+        return;
+    }
+    LOG_INFO("Rate limiting: %llu frames delayed, %llu rejected, %llu sources not tracked.",
+        (unsigned long long)delayed_frames, (unsigned long long)rejected_frames,
+        (unsigned long long)untracked_sources);
+}
+
+void rate_limit_shutdown(void) {
+    for (uint32_t i = 0; i < CONNECTION_TABLE_MAX_CHUNKS; i++) {
+        free(limit_chunks[i]);
+        limit_chunks[i] = NULL;
+    }
+    free(sources);
+    sources = NULL;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file shm_transport.c
+ * @brief Implementation of shared-memory sessions served inline by the reactor thread.
+ */
+#include "server/shm_transport.h"
+#include "server/command_dispatch.h"
+#include "server/connection_table.h"
+#include "common/shm_channel.h"
+#include "common/net_utils.h"
+#include "common/logger.h"
+#include "protocol/protocol.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define SHM_STALL_POLL_MS 1
+// Sized for the largest response so a request is only consumed once its reply is sure to fit
+#define SHM_MAX_FRAME_SIZE (sizeof(PacketHeader) + COMMAND_MAX_RESPONSE_PAYLOAD)
+
+struct ShmSession {
+    ClientContext* doorbell_ctx;
+    ShmChannel channel;
+    int conn_fd;
+    int stalled;
+    int broken;
+    struct ShmSession* next;
+};
+
+// Only the reactor thread touches these lists, so they need no locking
+static ShmSession* active_sessions = NULL;
+static ShmSession* retired_sessions = NULL;
+
+static void shm_response_writer(void* context, const CommandRequest* request,
+    uint16_t type, const uint8_t* payload, uint32_t payload_len) {
+    ShmSession* session = (ShmSession*)context;
+
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = type;
+    header.sequence_number = request->sequence_number;
+    header.payload_length = payload_len;
+
+    if (shm_ring_write(&session->channel.responses, &header, payload) != 0) {
+        LOG_WARN("Shared-memory response ring full on fd %d, dropping response.", session->conn_fd);
+    }
+}
+
+ShmSession* shm_session_open(int conn_fd) {
+    ShmSession* session = (ShmSession*)calloc(1, sizeof(ShmSession));
+    if (session == NULL) {
+        return NULL;
+    }
+
+    if (shm_channel_create(&session->channel, SHM_RING_CAPACITY) != 0) {
+        LOG_ERROR("Failed to create shared-memory channel for fd %d.", conn_fd);
+        free(session);
+        return NULL;
+    }
+
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = PACKET_TYPE_ACK;
+    header.sequence_number = 0;
+    header.payload_length = sizeof(uint32_t);
+
+    uint8_t reply[sizeof(PacketHeader) + sizeof(uint32_t)];
+    uint32_t net_capacity = htonl(SHM_RING_CAPACITY);
+    serialize_header(&header, reply);
+    memcpy(reply + sizeof(PacketHeader), &net_capacity, sizeof(net_capacity));
+
+    int fds[SHM_ATTACH_FD_COUNT] = {
+        session->channel.memfd, session->channel.server_doorbell, session->channel.client_doorbell
+    };
+
+    // The doorbell is a reactor source like any connection, so it needs a table slot
+    session->doorbell_ctx = connection_table_open(session->channel.server_doorbell, TRANSPORT_UNIX);
+    if (session->doorbell_ctx == NULL) {
+        shm_channel_destroy(&session->channel);
+        free(session);
+        return NULL;
+    }
+
+    if (send_with_fds(conn_fd, reply, sizeof(reply), fds, SHM_ATTACH_FD_COUNT) != (ssize_t)sizeof(reply)) {
+        LOG_ERROR("Failed to pass shared-memory channel to fd %d.", conn_fd);
+        connection_table_discard(session->doorbell_ctx);
+        shm_channel_destroy(&session->channel);
+        free(session);
+        return NULL;
+    }
+
+    session->doorbell_ctx->shm_session = session;
+    session->conn_fd = conn_fd;
+    session->next = active_sessions;
+    active_sessions = session;
+
+    LOG_DEBUG("Shared-memory session established on fd %d.", conn_fd);
+    return session;
+}
+
+ClientContext* shm_session_doorbell_context(ShmSession* session) {
+    return session->doorbell_ctx;
+}
+
+int shm_session_drain(ShmSession* session) {
+    if (session->broken) {
+        return -1;
+    }
+
+    ShmChannel* channel = &session->channel;
+    uint8_t frame[SHM_MAX_FRAME_SIZE];
+    int produced = 0;
+
+    shm_doorbell_drain(channel->server_doorbell);
+    shm_ring_clear_sleep(&channel->requests);
+
+    // Never consume a request unless its largest possible response is guaranteed to fit
+    while (shm_ring_free_space(&channel->responses) >= SHM_MAX_FRAME_SIZE) {
+        uint32_t len = shm_ring_read(&channel->requests, frame, sizeof(frame));
+        if (len == 0) {
+            break;
+        }
+        if (len == SHM_RING_CORRUPT) {
+            LOG_WARN("Corrupt shared-memory request ring on fd %d, dropping session.", session->conn_fd);
+            session->broken = 1;
+            shutdown(session->conn_fd, SHUT_RDWR);
+            return -1;
+        }
+
+        PacketHeader header;
+        deserialize_header(frame, &header);
+        // As on the stream transport, HEARTBEAT is the only header-only frame that is answered
+        if ((header.payload_length == 0 && header.type != PACKET_TYPE_HEARTBEAT) ||
+            header.payload_length > MAX_PAYLOAD_SIZE) {
+            continue;
+        }
+
+        CommandRequest request;
+        request.fd = -1;
+        request.type = header.type;
+        request.sequence_number = header.sequence_number;
+        request.payload = frame + sizeof(PacketHeader);
+        request.payload_len = header.payload_length;
+
+        dispatch_command(&request, shm_response_writer, session);
+        produced = 1;
+    }
+
+    if (produced && shm_ring_needs_doorbell(&channel->responses)) {
+        shm_doorbell_ring(channel->client_doorbell);
+    }
+
+    session->stalled = shm_ring_has_data(&channel->requests);
+    return session->stalled;
+}
+
+int shm_transport_prepare_wait(void) {
+    int timeout = -1;
+
+    for (ShmSession* session = active_sessions; session != NULL; session = session->next) {
+        if (session->broken) {
+            continue;
+        }
+
+        if (session->stalled || shm_ring_has_data(&session->channel.requests)) {
+            int rc = shm_session_drain(session);
+            if (rc < 0) {
+                continue;
+            }
+            if (rc > 0) {
+                timeout = SHM_STALL_POLL_MS;
+                continue;
+            }
+        }
+
+        // Requests published after the flag is raised will ring the doorbell
+        if (!shm_ring_prepare_sleep(&session->channel.requests)) {
+            timeout = 0;
+        }
+    }
+
+    return timeout;
+}
+
+void shm_session_retire(ShmSession* session, int epoll_fd) {
+    // The peer still holds the eventfd, so closing ours would not remove it from epoll
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->channel.server_doorbell, NULL);
+    // Doorbell events still queued in this batch now fail their handle lookup
+    connection_table_discard(session->doorbell_ctx);
+    session->doorbell_ctx = NULL;
+
+    ShmSession** link = &active_sessions;
+    while (*link != NULL && *link != session) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = session->next;
+    }
+
+    session->next = retired_sessions;
+    retired_sessions = session;
+}
+
+void shm_transport_reap(void) {
+    while (retired_sessions != NULL) {
+        ShmSession* session = retired_sessions;
+        retired_sessions = session->next;
+        shm_channel_destroy(&session->channel);
+        free(session);
+    }
+}
@@ -8,11 +8,15 @@
 #include <unistd.h>
 
 volatile sig_atomic_t server_running = 1;
+volatile sig_atomic_t trace_dump_requested = 0;
 
 static void handle_signal(int sig) {
     if (sig == SIGINT || sig == SIGTERM) {
         server_running = 0;
     }
+    else if (sig == SIGUSR2) {
+        trace_dump_requested = 1;
+    }
 }
 
 void setup_signal_handlers(void) {
@@ -29,5 +33,9 @@ void setup_signal_handlers(void) {
         LOG_ERROR("Failed to register SIGTERM handler.");
     }
 
+    if (sigaction(SIGUSR2, &sa, NULL) == -1) {
+        LOG_ERROR("Failed to register SIGUSR2 handler.");
+    }
+
     signal(SIGPIPE, SIG_IGN);
 }
\ No newline at end of file
@@ -3,19 +3,196 @@
  * @brief Implementation of the thread pool using a circular buffer task queue.
  */
 #include "server/thread_pool.h"
+#include "server/trace.h"
+#include "server/arena.h"
 #include "common/logger.h"
 #include <stdlib.h>
+#include <signal.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define THREAD_SLOT_FREE 0
+#define THREAD_SLOT_RUNNING 1
+#define THREAD_SLOT_RETIRED 2   // Worker exited on its own and still has to be joined
+
+static void* thread_pool_worker(void* thread_pool);
+
+static uint64_t monotonic_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int is_elastic(const ThreadPool* pool) {
+    return pool->max_threads > pool->min_threads;
+}
+
+ // Anti-starvation first, then the configured schedule; called with the lock held and count > 0
+static TaskLane* select_lane_locked(ThreadPool* pool) {
+    TaskLane* chosen = NULL;
+
+    for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+        TaskLane* lane = &pool->lanes[i];
+        if (lane->count > 0 && lane->passed_over >= THREAD_POOL_STARVATION_LIMIT) {
+            if (chosen == NULL || lane->passed_over > chosen->passed_over) {
+                chosen = lane;
+            }
+        }
+    }
+
+    if (chosen == NULL && pool->schedule == THREAD_POOL_STRICT) {
+        for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT && chosen == NULL; i++) {
+            if (pool->lanes[i].count > 0) {
+                chosen = &pool->lanes[i];
+            }
+        }
+    }
+
+    if (chosen == NULL) {
+        // Smooth weighted round robin interleaves lanes instead of serving them in bursts
+        int32_t total_weight = 0;
+        for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+            TaskLane* lane = &pool->lanes[i];
+            if (lane->count == 0) {
+                continue;
+            }
+            lane->current_weight += lane->weight;
+            total_weight += lane->weight;
+            if (chosen == NULL || lane->current_weight > chosen->current_weight) {
+                chosen = lane;
+            }
+        }
+        chosen->current_weight -= total_weight;
+    }
+
+    for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+        TaskLane* lane = &pool->lanes[i];
+        if (lane == chosen) {
+            lane->passed_over = 0;
+        }
+        else if (lane->count > 0) {
+            lane->passed_over++;
+        }
+    }
+
+    return chosen;
+}
+
+ // Starts a worker in a free or retired slot; called with the lock held
+static int spawn_worker_locked(ThreadPool* pool) {
+    uint32_t slot = pool->max_threads;
+    for (uint32_t i = 0; i < pool->max_threads; i++) {
+        if (pool->slot_state[i] != THREAD_SLOT_RUNNING) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == pool->max_threads) {
+        return -1;
+    }
+
+    // A retired worker marked its slot under this lock, so it is already past any use of the pool
+    if (pool->slot_state[slot] == THREAD_SLOT_RETIRED) {
+        pthread_join(pool->threads[slot], NULL);
+        pool->slot_state[slot] = THREAD_SLOT_FREE;
+    }
+
+    // Workers inherit a blocked mask so process signals always interrupt the reactor's epoll_wait
+    sigset_t blocked;
+    sigset_t previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int rc = pthread_create(&(pool->threads[slot]), NULL, thread_pool_worker, (void*)pool);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (rc != 0) {
+        return -1;
+    }
+
+    pool->slot_state[slot] = THREAD_SLOT_RUNNING;
+    pool->thread_count++;
+    if (pool->thread_count > pool->stats.peak_threads) {
+        pool->stats.peak_threads = pool->thread_count;
+    }
+    return 0;
+}
+
+// How long the oldest queued task has been waiting; called with the lock held
+static uint64_t oldest_wait_locked(const ThreadPool* pool, uint64_t now) {
+    uint64_t oldest = now;
+    for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+        const TaskLane* lane = &pool->lanes[i];
+        if (lane->count > 0 && lane->queue[lane->head].enqueued_ns < oldest) {
+            oldest = lane->queue[lane->head].enqueued_ns;
+        }
+    }
+    return now - oldest;
+}
+
+// Adds one worker if tasks are waiting too long and the last grow is a cooldown ago; lock held
+static int maybe_grow_locked(ThreadPool* pool, uint64_t waited_ns, uint64_t now) {
+    if (pool->shutdown || pool->thread_count >= pool->max_threads ||
+        waited_ns < (uint64_t)THREAD_POOL_GROW_WAIT_US * 1000ull ||
+        now - pool->last_grow_ns < (uint64_t)THREAD_POOL_GROW_COOLDOWN_MS * 1000000ull) {
+        return 0;
+    }
+
+    // Stamped even if the spawn fails, so a failing pthread_create is not retried on every task
+    pool->last_grow_ns = now;
+    if (spawn_worker_locked(pool) != 0) {
+        return 0;
+    }
+    pool->stats.grow_events++;
+    return 1;
+}
+
+// An idle wait that timed out retires the worker if the pool is above its floor; lock held
+static int should_retire_locked(const ThreadPool* pool) {
+    return !pool->shutdown && pool->count == 0 && pool->thread_count > pool->min_threads &&
+        monotonic_nanos() - pool->last_grow_ns >= (uint64_t)THREAD_POOL_IDLE_RETIRE_MS * 1000000ull;
+}
+
+static void retire_self_locked(ThreadPool* pool) {
+    pthread_t self = pthread_self();
+    for (uint32_t i = 0; i < pool->max_threads; i++) {
+        if (pool->slot_state[i] == THREAD_SLOT_RUNNING && pthread_equal(pool->threads[i], self)) {
+            pool->slot_state[i] = THREAD_SLOT_RETIRED;
+            break;
+        }
+    }
+    pool->thread_count--;
+    pool->stats.shrink_events++;
+}
 
  // Worker thread routine to consume and execute tasks
 static void* thread_pool_worker(void* thread_pool) {
     ThreadPool* pool = (ThreadPool*)thread_pool;
+    int elastic = is_elastic(pool);
 
     while (1) {
         pthread_mutex_lock(&(pool->lock));
 
-        while (pool->count == 0 && !pool->shutdown) {
-            pthread_cond_wait(&(pool->notify), &(pool->lock));
+        int retire = 0;
+        while (pool->count == 0 && !pool->shutdown && !retire) {
+            if (!elastic) {
+                pthread_cond_wait(&(pool->notify), &(pool->lock));
+                continue;
+            }
+
+            uint64_t deadline_ns = monotonic_nanos() + (uint64_t)THREAD_POOL_IDLE_RETIRE_MS * 1000000ull;
+            struct timespec deadline = { (time_t)(deadline_ns / 1000000000ull), (long)(deadline_ns % 1000000000ull) };
+            if (pthread_cond_timedwait(&(pool->notify), &(pool->lock), &deadline) == ETIMEDOUT) {
+                retire = should_retire_locked(pool);
+            }
+        }
+
+        if (retire) {
+            retire_self_locked(pool);
+            uint32_t remaining = pool->thread_count;
+            pthread_mutex_unlock(&(pool->lock));
+            LOG_INFO("Thread pool shrank to %u workers after %d ms idle.", remaining, THREAD_POOL_IDLE_RETIRE_MS);
+            return NULL;
         }
 
         if (pool->shutdown && pool->count == 0) {
@@ -23,74 +200,153 @@ static void* thread_pool_worker(void* thread_pool) {
             pthread_exit(NULL);
         }
 
-        Task task = pool->queue[pool->head];
-        pool->head = (pool->head + 1) % pool->queue_size;
+        TaskLane* lane = select_lane_locked(pool);
+        Task task = lane->queue[lane->head];
+        lane->head = (lane->head + 1) % pool->queue_size;
+        lane->count -= 1;
         pool->count -= 1;
 
+        // A long wait with work still queued means the pool is short of workers, blocked or busy
+        uint64_t waited_ns = 0;
+        int grew = 0;
+        if (elastic && pool->count > 0) {
+            uint64_t now = monotonic_nanos();
+            waited_ns = now - task.enqueued_ns;
+            grew = maybe_grow_locked(pool, waited_ns, now);
+        }
+        uint32_t size = pool->thread_count;
+
         pthread_mutex_unlock(&(pool->lock));
 
+        if (grew) {
+            LOG_INFO("Thread pool grew to %u workers (task waited %llu us).", size,
+                (unsigned long long)(waited_ns / 1000));
+        }
+
+        trace_stamp(task.trace_id, TRACE_DEQUEUED, 0);
         (*(task.function))(task.argument);
     }
 
     return NULL;
 }
 
-ThreadPool* thread_pool_create(uint32_t thread_count, uint32_t queue_size) {
-    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+ThreadPool* thread_pool_create(uint32_t min_threads, uint32_t max_threads, uint32_t queue_size, ThreadPoolSchedule schedule) {
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
     if (pool == NULL) {
         return NULL;
     }
 
-    pool->thread_count = thread_count;
+    static const int32_t lane_weights[THREAD_POOL_LANE_COUNT] = {
+        THREAD_POOL_WEIGHT_CONTROL, THREAD_POOL_WEIGHT_INTERACTIVE, THREAD_POOL_WEIGHT_BULK
+    };
+
+    if (min_threads == 0) {
+        min_threads = 1;
+    }
+    if (max_threads < min_threads) {
+        max_threads = min_threads;
+    }
+
+    pool->thread_count = 0;
+    pool->min_threads = min_threads;
+    pool->max_threads = max_threads;
     pool->queue_size = queue_size;
-    pool->head = 0;
-    pool->tail = 0;
+    pool->schedule = schedule;
     pool->count = 0;
     pool->shutdown = 0;
+    pool->stats.min_threads = min_threads;
+    pool->stats.max_threads = max_threads;
+
+    // Idle deadlines are monotonic so a wall-clock step cannot retire or pin workers
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&(pool->lock), NULL);
+    pthread_cond_init(&(pool->notify), &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
 
-    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * thread_count);
-    pool->queue = (Task*)malloc(sizeof(Task) * queue_size);
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * max_threads);
+    pool->slot_state = (uint8_t*)calloc(max_threads, sizeof(uint8_t));
+    int allocated = pool->threads != NULL && pool->slot_state != NULL;
+    // Queues are touched by every enqueue and dequeue, so they come from prefaulted memory if there is any
+    for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+        pool->lanes[i].queue = (Task*)arena_reserve(sizeof(Task) * queue_size);
+        if (pool->lanes[i].queue == NULL) {
+            pool->lanes[i].queue = (Task*)malloc(sizeof(Task) * queue_size);
+        }
+        pool->lanes[i].weight = lane_weights[i];
+        allocated = allocated && pool->lanes[i].queue != NULL;
+    }
 
-    if (pthread_mutex_init(&(pool->lock), NULL) != 0 ||
-        pthread_cond_init(&(pool->notify), NULL) != 0 ||
-        pool->threads == NULL || pool->queue == NULL) {
+    if (!allocated) {
         thread_pool_destroy(pool);
         return NULL;
     }
 
-    for (uint32_t i = 0; i < thread_count; i++) {
-        if (pthread_create(&(pool->threads[i]), NULL, thread_pool_worker, (void*)pool) != 0) {
+    pthread_mutex_lock(&(pool->lock));
+    for (uint32_t i = 0; i < min_threads; i++) {
+        if (spawn_worker_locked(pool) != 0) {
+            pthread_mutex_unlock(&(pool->lock));
             thread_pool_destroy(pool);
             return NULL;
         }
     }
+    pthread_mutex_unlock(&(pool->lock));
 
     return pool;
 }
 
-int thread_pool_add_task(ThreadPool* pool, task_func_t function, void* argument) {
-    if (pool == NULL || function == NULL) {
+int thread_pool_add_task(ThreadPool* pool, uint32_t lane, task_func_t function, void* argument, uint32_t trace_id) {
+    if (pool == NULL || function == NULL || lane >= THREAD_POOL_LANE_COUNT) {
         return -1;
     }
 
+    // Fixed-size pools never look at queue wait, so they skip the clock read
+    uint64_t now = is_elastic(pool) ? monotonic_nanos() : 0;
+
     pthread_mutex_lock(&(pool->lock));
 
-    if (pool->count == pool->queue_size || pool->shutdown) {
+    TaskLane* target = &pool->lanes[lane];
+    if (target->count == pool->queue_size || pool->shutdown) {
         pthread_mutex_unlock(&(pool->lock));
         return -1;
     }
 
-    pool->queue[pool->tail].function = function;
-    pool->queue[pool->tail].argument = argument;
-    pool->tail = (pool->tail + 1) % pool->queue_size;
+    trace_stamp(trace_id, TRACE_ENQUEUED, lane);
+    target->queue[target->tail].function = function;
+    target->queue[target->tail].argument = argument;
+    target->queue[target->tail].trace_id = trace_id;
+    target->queue[target->tail].enqueued_ns = now;
+    target->tail = (target->tail + 1) % pool->queue_size;
+    target->count += 1;
     pool->count += 1;
 
+    // Workers stuck in blocking handlers dequeue nothing, so the producer checks the backlog too
+    uint64_t waited_ns = 0;
+    int grew = 0;
+    if (now != 0) {
+        waited_ns = oldest_wait_locked(pool, now);
+        grew = maybe_grow_locked(pool, waited_ns, now);
+    }
+    uint32_t size = pool->thread_count;
+
     pthread_cond_signal(&(pool->notify));
     pthread_mutex_unlock(&(pool->lock));
 
+    if (grew) {
+        LOG_INFO("Thread pool grew to %u workers (oldest task waited %llu us).", size,
+            (unsigned long long)(waited_ns / 1000));
+    }
     return 0;
 }
 
+void thread_pool_get_stats(ThreadPool* pool, ThreadPoolStats* stats) {
+    pthread_mutex_lock(&(pool->lock));
+    *stats = pool->stats;
+    stats->threads = pool->thread_count;
+    pthread_mutex_unlock(&(pool->lock));
+}
+
 void thread_pool_destroy(ThreadPool* pool) {
     if (pool == NULL) {
         return;
@@ -101,15 +357,24 @@ void thread_pool_destroy(ThreadPool* pool) {
     pthread_cond_broadcast(&(pool->notify));
     pthread_mutex_unlock(&(pool->lock));
 
-    if (pool->threads != NULL) {
-        for (uint32_t i = 0; i < pool->thread_count; i++) {
-            pthread_join(pool->threads[i], NULL);
+    // No slot is started after shutdown, so running ones can only move to retired from here
+    if (pool->threads != NULL && pool->slot_state != NULL) {
+        for (uint32_t i = 0; i < pool->max_threads; i++) {
+            pthread_mutex_lock(&(pool->lock));
+            uint8_t state = pool->slot_state[i];
+            pthread_mutex_unlock(&(pool->lock));
+            if (state != THREAD_SLOT_FREE) {
+                pthread_join(pool->threads[i], NULL);
+            }
         }
-        free(pool->threads);
     }
+    free(pool->threads);
+    free(pool->slot_state);
 
-    if (pool->queue != NULL) {
-        free(pool->queue);
+    for (uint32_t i = 0; i < THREAD_POOL_LANE_COUNT; i++) {
+        if (!arena_contains(pool->lanes[i].queue)) {
+            free(pool->lanes[i].queue);
+        }
     }
 
     pthread_mutex_destroy(&(pool->lock));
@@ -0,0 +1,223 @@
+/**
+ * @file trace.c
+ * @brief Implementation of sampled request tracing with per-thread rings and Chrome trace-event export.
+ */
+#include "server/trace.h"
+#include "common/logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TRACE_RING_MASK (TRACE_RING_CAPACITY - 1)
+
+typedef struct {
+    uint64_t ticks;
+    uint32_t trace_id;
+    uint16_t stage;
+    uint16_t thread;
+    uint32_t value;
+} TraceEvent;
+
+/**
+ * @brief Single-producer ring owned by one thread. The dumper only reads, so a
+ * release store of head is the whole synchronization; old events are overwritten.
+ */
+typedef struct TraceRing {
+    _Alignas(64) _Atomic uint64_t head;
+    uint16_t thread;
+    struct TraceRing* next;
+    TraceEvent events[TRACE_RING_CAPACITY];
+} TraceRing;
+
+// Span names indexed by the stage that closes the span
+static const char* span_names[TRACE_STAGE_COUNT] = {
+    "header", "read_payload", "submit", "queue_wait", "task_setup", "execute", "cleanup"
+};
+
+static uint32_t sample_every = 0;
+static _Atomic uint32_t sample_counter = 0;
+static _Atomic uint32_t next_trace_id = 0;
+
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing* rings = NULL;
+static uint16_t ring_count = 0;
+
+static _Thread_local TraceRing* local_ring = NULL;
+static _Thread_local uint32_t current_trace_id = 0;
+
+static uint64_t base_ticks = 0;
+static uint64_t base_nanos = 0;
+
+static uint64_t monotonic_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// The TSC is invariant on current x86 parts and far cheaper than a clock_gettime call
+static inline uint64_t read_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return monotonic_nanos();
+#endif
+}
+
+static TraceRing* register_ring(void) {
+    TraceRing* ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    ring->thread = ++ring_count;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&ring_lock);
+
+    local_ring = ring;
+    return ring;
+}
+
+void trace_init(uint32_t every) {
+    sample_every = every;
+    base_nanos = monotonic_nanos();
+    base_ticks = read_ticks();
+    if (every > 0) {
+        LOG_INFO("Request tracing enabled (1 in %u requests).", every);
+    }
+}
+
+uint32_t trace_sample(void) {
+    if (sample_every == 0) {
+        return 0;
+    }
+    if (atomic_fetch_add_explicit(&sample_counter, 1, memory_order_relaxed) % sample_every != 0) {
+        return 0;
+    }
+
+    uint32_t id = atomic_fetch_add_explicit(&next_trace_id, 1, memory_order_relaxed) + 1;
+    return id != 0 ? id : 1;
+}
+
+void trace_record(uint32_t trace_id, TraceStage stage, uint32_t value) {
+    TraceRing* ring = local_ring;
+    if (ring == NULL && (ring = register_ring()) == NULL) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent* event = &ring->events[head & TRACE_RING_MASK];
+    event->ticks = read_ticks();
+    event->trace_id = trace_id;
+    event->stage = (uint16_t)stage;
+    event->thread = ring->thread;
+    event->value = value;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_set_current(uint32_t trace_id) {
+    current_trace_id = trace_id;
+}
+
+uint32_t trace_current(void) {
+    return current_trace_id;
+}
+
+static int compare_events(const void* a, const void* b) {
+    const TraceEvent* x = (const TraceEvent*)a;
+    const TraceEvent* y = (const TraceEvent*)b;
+    if (x->trace_id != y->trace_id) return (x->trace_id > y->trace_id) - (x->trace_id < y->trace_id);
+    return (x->ticks > y->ticks) - (x->ticks < y->ticks);
+}
+
+int trace_dump(const char* path) {
+    if (sample_every == 0) {
+        return -1;
+    }
+
+    // Events still being written while we copy may be torn; tracing is best effort by design
+    pthread_mutex_lock(&ring_lock);
+    size_t total = 0;
+    for (TraceRing* ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        total += head < TRACE_RING_CAPACITY ? head : TRACE_RING_CAPACITY;
+    }
+
+    TraceEvent* events = (TraceEvent*)malloc(sizeof(TraceEvent) * (total > 0 ? total : 1));
+    if (events == NULL) {
+        pthread_mutex_unlock(&ring_lock);
+        return -1;
+    }
+
+    size_t count = 0;
+    for (TraceRing* ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t start = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+        for (uint64_t i = start; i < head && count < total; i++) {
+            const TraceEvent* event = &ring->events[i & TRACE_RING_MASK];
+            if (event->stage < TRACE_STAGE_COUNT) {
+                events[count++] = *event;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        free(events);
+        return -1;
+    }
+
+    uint64_t elapsed_ticks = read_ticks() - base_ticks;
+    uint64_t elapsed_nanos = monotonic_nanos() - base_nanos;
+    double micros_per_tick = elapsed_ticks > 0 ? (double)elapsed_nanos / (double)elapsed_ticks / 1000.0 : 0.0;
+
+    qsort(events, count, sizeof(TraceEvent), compare_events);
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"network_server\"}}");
+
+    size_t requests = 0;
+    for (size_t i = 0; i < count; ) {
+        size_t end = i;
+        while (end < count && events[end].trace_id == events[i].trace_id) {
+            end++;
+        }
+
+        // Each request gets an async track spanning its first to last stage
+        const TraceEvent* first = &events[i];
+        const TraceEvent* last = &events[end - 1];
+        fprintf(out, ",\n{\"name\":\"request\",\"cat\":\"request\",\"ph\":\"b\",\"id\":%u,\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+            first->trace_id, first->thread, (double)(first->ticks - base_ticks) * micros_per_tick);
+        fprintf(out, ",\n{\"name\":\"request\",\"cat\":\"request\",\"ph\":\"e\",\"id\":%u,\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+            last->trace_id, last->thread, (double)(last->ticks - base_ticks) * micros_per_tick);
+
+        // Consecutive stages become complete events on the thread that closed them
+        for (const TraceEvent* to = first + 1; to <= last; to++) {
+            const TraceEvent* from = to - 1;
+            double ts = (double)(from->ticks - base_ticks) * micros_per_tick;
+            double dur = (double)(to->ticks - from->ticks) * micros_per_tick;
+
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"request\":%u", span_names[to->stage], to->thread, ts, dur, to->trace_id);
+            if (to->stage == TRACE_BYTES_WRITTEN) {
+                fprintf(out, ",\"bytes\":%u", to->value);
+            }
+            fprintf(out, "}}");
+        }
+
+        requests++;
+        i = end;
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    free(events);
+
+    LOG_INFO("Trace with %zu requests (%zu events) written to %s.", requests, count, path);
+    return 0;
+}
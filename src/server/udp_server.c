@@ -0,0 +1,514 @@
+/**
+ * @file udp_server.c
+ * @brief Implementation of the UDP listener using recvmmsg/sendmmsg batching with optional GRO/GSO offload.
+ */
+#define _GNU_SOURCE
+#include "server/udp_server.h"
+#include "server/command_dispatch.h"
+#include "protocol/protocol.h"
+#include "common/net_utils.h"
+#include "common/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define UDP_BATCH_SIZE 32
+#define UDP_RECV_BUFFER_SIZE 65536
+#define UDP_REPLY_ARENA_SIZE (4 * 1024 * 1024)
+#define UDP_MAX_REPLIES 1024
+#define UDP_MAX_GSO_SEGMENTS 64
+#define UDP_GSO_MAX_SEGMENT_SIZE 1400
+#define UDP_SOURCE_SETS 256
+#define UDP_SOURCE_WAYS 4
+#define UDP_STATS_LOG_LIMIT 16
+
+/**
+ * @brief Counters for one remote address. family == 0 marks an empty slot.
+ */
+typedef struct {
+    uint8_t addr[16];
+    uint16_t port;
+    uint16_t family;
+    uint64_t last_seen;
+    uint64_t datagrams;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t errors;
+} UdpSourceStats;
+
+// A reply datagram staged in the arena; addr points into the receive batch it answers
+typedef struct {
+    const struct sockaddr_storage* addr;
+    socklen_t addr_len;
+    uint32_t offset;
+    uint32_t length;
+} UdpReply;
+
+struct UdpServer {
+    int fd;
+    int gro_enabled;
+    int gso_enabled;
+
+    uint8_t* recv_buffers;
+    struct mmsghdr recv_msgs[UDP_BATCH_SIZE];
+    struct iovec recv_iovs[UDP_BATCH_SIZE];
+    struct sockaddr_storage recv_addrs[UDP_BATCH_SIZE];
+    char recv_control[UDP_BATCH_SIZE][CMSG_SPACE(sizeof(int))];
+
+    uint8_t* reply_arena;
+    uint32_t reply_used;
+    UdpReply replies[UDP_MAX_REPLIES];
+    uint32_t reply_count;
+
+    struct mmsghdr send_msgs[UDP_MAX_REPLIES];
+    struct iovec send_iovs[UDP_MAX_REPLIES];
+    char send_control[UDP_MAX_REPLIES][CMSG_SPACE(sizeof(uint16_t))];
+
+    // Bounded set-associative table: a flood of new sources evicts the least recently seen way
+    UdpSourceStats sources[UDP_SOURCE_SETS * UDP_SOURCE_WAYS];
+    uint64_t tick;
+    uint64_t source_evictions;
+    uint64_t replies_dropped;
+};
+
+typedef struct {
+    UdpServer* server;
+    const struct sockaddr_storage* addr;
+    socklen_t addr_len;
+    int32_t envelope;
+} UdpReplyContext;
+
+static UdpSourceStats* lookup_source(UdpServer* server, const struct sockaddr_storage* addr) {
+    uint8_t key[16];
+    uint16_t port = 0;
+    uint16_t family = (uint16_t)addr->ss_family;
+    memset(key, 0, sizeof(key));
+
+    if (family == AF_INET) {
+        const struct sockaddr_in* in = (const struct sockaddr_in*)addr;
+        memcpy(key, &in->sin_addr, sizeof(in->sin_addr));
+        port = in->sin_port;
+    }
+    else if (family == AF_INET6) {
+        const struct sockaddr_in6* in6 = (const struct sockaddr_in6*)addr;
+        memcpy(key, &in6->sin6_addr, sizeof(in6->sin6_addr));
+        port = in6->sin6_port;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL ^ port;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        hash ^= key[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    UdpSourceStats* set = &server->sources[(hash % UDP_SOURCE_SETS) * UDP_SOURCE_WAYS];
+    UdpSourceStats* empty = NULL;
+    UdpSourceStats* oldest = &set[0];
+
+    for (uint32_t w = 0; w < UDP_SOURCE_WAYS; w++) {
+        UdpSourceStats* entry = &set[w];
+        if (entry->family == family && entry->port == port && memcmp(entry->addr, key, sizeof(key)) == 0) {
+            entry->last_seen = server->tick;
+            return entry;
+        }
+        if (entry->family == 0) {
+            if (empty == NULL) empty = entry;
+        }
+        else if (entry->last_seen < oldest->last_seen) {
+            oldest = entry;
+        }
+    }
+
+    UdpSourceStats* victim = (empty != NULL) ? empty : oldest;
+    if (victim->family != 0) {
+        server->source_evictions++;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    memcpy(victim->addr, key, sizeof(key));
+    victim->port = port;
+    victim->family = family;
+    victim->last_seen = server->tick;
+    return victim;
+}
+
+static int same_address(const UdpReply* a, const UdpReply* b) {
+    return a->addr_len == b->addr_len && memcmp(a->addr, b->addr, a->addr_len) == 0;
+}
+
+// Sends every staged reply; runs of equal-sized replies to one peer become a single GSO send
+static void flush_replies(UdpServer* server) {
+    uint32_t msg_count = 0;
+    uint32_t i = 0;
+
+    while (i < server->reply_count) {
+        const UdpReply* first = &server->replies[i];
+        uint32_t segments = 1;
+        uint32_t total = first->length;
+
+        if (server->gso_enabled && first->length <= UDP_GSO_MAX_SEGMENT_SIZE) {
+            while (i + segments < server->reply_count && segments < UDP_MAX_GSO_SEGMENTS) {
+                const UdpReply* next = &server->replies[i + segments];
+                if (!same_address(first, next) || next->length > first->length ||
+                    total + next->length > UDP_MAX_DATAGRAM_SIZE) {
+                    break;
+                }
+                segments++;
+                total += next->length;
+                // Only the final segment may be shorter than the segment size
+                if (next->length < first->length) break;
+            }
+        }
+
+        struct msghdr* hdr = &server->send_msgs[msg_count].msg_hdr;
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->msg_name = (void*)first->addr;
+        hdr->msg_namelen = first->addr_len;
+        hdr->msg_iov = &server->send_iovs[i];
+        hdr->msg_iovlen = segments;
+
+        for (uint32_t k = 0; k < segments; k++) {
+            const UdpReply* reply = &server->replies[i + k];
+            server->send_iovs[i + k].iov_base = server->reply_arena + reply->offset;
+            server->send_iovs[i + k].iov_len = reply->length;
+        }
+
+        if (segments > 1) {
+            hdr->msg_control = server->send_control[msg_count];
+            hdr->msg_controllen = sizeof(server->send_control[msg_count]);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment_size = (uint16_t)first->length;
+            memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+        }
+
+        msg_count++;
+        i += segments;
+    }
+
+    uint32_t sent = 0;
+    while (sent < msg_count) {
+        int rc = sendmmsg(server->fd, server->send_msgs + sent, msg_count - sent, MSG_DONTWAIT);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                server->replies_dropped += msg_count - sent;
+                break;
+            }
+            if (errno == EIO && server->send_msgs[sent].msg_hdr.msg_controllen > 0) {
+                LOG_WARN("UDP GSO rejected by the device, falling back to per-datagram sends.");
+                server->gso_enabled = 0;
+            }
+            // Skip the offending datagram and keep going with the rest of the batch
+            server->replies_dropped++;
+            sent++;
+            continue;
+        }
+        sent += (uint32_t)rc;
+    }
+
+    server->reply_count = 0;
+    server->reply_used = 0;
+}
+
+static UdpReply* stage_reply(UdpReplyContext* context, uint32_t reserve) {
+    UdpServer* server = context->server;
+
+    if (server->reply_count == UDP_MAX_REPLIES || server->reply_used + reserve > UDP_REPLY_ARENA_SIZE) {
+        flush_replies(server);
+    }
+
+    UdpReply* reply = &server->replies[server->reply_count++];
+    reply->addr = context->addr;
+    reply->addr_len = context->addr_len;
+    reply->offset = server->reply_used;
+    reply->length = 0;
+    return reply;
+}
+
+static void udp_response_writer(void* context, const CommandRequest* request,
+    uint16_t type, const uint8_t* payload, uint32_t payload_len) {
+    UdpReplyContext* reply_context = (UdpReplyContext*)context;
+    UdpServer* server = reply_context->server;
+    uint32_t frame_len = (uint32_t)sizeof(PacketHeader) + payload_len;
+    UdpReply* reply;
+
+    if (reply_context->envelope >= 0) {
+        reply = &server->replies[reply_context->envelope];
+        if (reply->length + frame_len > UDP_MAX_DATAGRAM_SIZE) {
+            server->replies_dropped++;
+            return;
+        }
+    }
+    else {
+        if (frame_len > UDP_MAX_DATAGRAM_SIZE) {
+            server->replies_dropped++;
+            return;
+        }
+        reply = stage_reply(reply_context, frame_len);
+    }
+
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = type;
+    header.sequence_number = request->sequence_number;
+    header.payload_length = payload_len;
+
+    // The open reply is always the last one in the arena, so it can grow in place
+    uint8_t* out = server->reply_arena + reply->offset + reply->length;
+    serialize_header(&header, out);
+    if (payload_len > 0 && payload != NULL) {
+        memcpy(out + sizeof(PacketHeader), payload, payload_len);
+    }
+
+    reply->length += frame_len;
+    server->reply_used += frame_len;
+}
+
+static void dispatch_frame(UdpReplyContext* context, UdpSourceStats* stats,
+    const PacketHeader* header, const uint8_t* payload) {
+    if (header->payload_length > MAX_PAYLOAD_SIZE) {
+        stats->errors++;
+        return;
+    }
+
+    stats->frames++;
+
+    // As on the stream transport, HEARTBEAT is the only header-only frame that is answered
+    if (header->payload_length == 0 && header->type != PACKET_TYPE_HEARTBEAT) {
+        return;
+    }
+
+    CommandRequest request;
+    request.fd = -1;
+    request.type = header->type;
+    request.sequence_number = header->sequence_number;
+    request.payload = payload;
+    request.payload_len = header->payload_length;
+
+    dispatch_command(&request, udp_response_writer, context);
+}
+
+static void process_datagram(UdpServer* server, const struct sockaddr_storage* addr, socklen_t addr_len,
+    const uint8_t* data, uint32_t len) {
+    server->tick++;
+    UdpSourceStats* stats = lookup_source(server, addr);
+    stats->datagrams++;
+    stats->bytes += len;
+
+    PacketHeader header;
+    if (len < sizeof(PacketHeader)) {
+        stats->errors++;
+        return;
+    }
+
+    deserialize_header(data, &header);
+    if (header.payload_length != len - sizeof(PacketHeader)) {
+        stats->errors++;
+        return;
+    }
+
+    UdpReplyContext context;
+    context.server = server;
+    context.addr = addr;
+    context.addr_len = addr_len;
+    context.envelope = -1;
+
+    if (header.type != PACKET_TYPE_BATCH) {
+        dispatch_frame(&context, stats, &header, data + sizeof(PacketHeader));
+        return;
+    }
+
+    // Reserve the envelope header now; it is serialized once the inner responses are known
+    UdpReply* envelope = stage_reply(&context, UDP_MAX_DATAGRAM_SIZE);
+    envelope->length = sizeof(PacketHeader);
+    server->reply_used += sizeof(PacketHeader);
+    context.envelope = (int32_t)(envelope - server->replies);
+
+    const uint8_t* cursor = data + sizeof(PacketHeader);
+    uint32_t remaining = header.payload_length;
+
+    while (remaining >= sizeof(PacketHeader)) {
+        PacketHeader inner;
+        deserialize_header(cursor, &inner);
+        if (inner.payload_length > remaining - sizeof(PacketHeader)) {
+            break;
+        }
+
+        dispatch_frame(&context, stats, &inner, cursor + sizeof(PacketHeader));
+
+        cursor += sizeof(PacketHeader) + inner.payload_length;
+        remaining -= (uint32_t)sizeof(PacketHeader) + inner.payload_length;
+    }
+
+    if (remaining != 0) {
+        stats->errors++;
+    }
+
+    envelope = &server->replies[context.envelope];
+    if (envelope->length == sizeof(PacketHeader)) {
+        server->reply_count--;
+        server->reply_used -= sizeof(PacketHeader);
+        return;
+    }
+
+    PacketHeader envelope_header;
+    envelope_header.version = PROTOCOL_VERSION_1;
+    envelope_header.type = PACKET_TYPE_BATCH;
+    envelope_header.sequence_number = header.sequence_number;
+    envelope_header.payload_length = envelope->length - (uint32_t)sizeof(PacketHeader);
+    serialize_header(&envelope_header, server->reply_arena + envelope->offset);
+}
+
+UdpServer* udp_server_create(const char* port, int inherited_fd) {
+    UdpServer* server = (UdpServer*)calloc(1, sizeof(UdpServer));
+    if (server == NULL) {
+        return NULL;
+    }
+
+    server->recv_buffers = (uint8_t*)malloc((size_t)UDP_BATCH_SIZE * UDP_RECV_BUFFER_SIZE);
+    server->reply_arena = (uint8_t*)malloc(UDP_REPLY_ARENA_SIZE);
+    if (server->recv_buffers == NULL || server->reply_arena == NULL) {
+        free(server->recv_buffers);
+        free(server->reply_arena);
+        free(server);
+        return NULL;
+    }
+
+    server->fd = (inherited_fd != -1) ? inherited_fd : setup_udp_server_socket(port);
+
+    int one = 1;
+    server->gro_enabled = (setsockopt(server->fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0);
+
+    int segment_size = 0;
+    socklen_t option_len = sizeof(segment_size);
+    server->gso_enabled = (getsockopt(server->fd, SOL_UDP, UDP_SEGMENT, &segment_size, &option_len) == 0);
+
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++) {
+        server->recv_iovs[i].iov_base = server->recv_buffers + (size_t)i * UDP_RECV_BUFFER_SIZE;
+        server->recv_iovs[i].iov_len = UDP_RECV_BUFFER_SIZE;
+    }
+
+    LOG_INFO("UDP listener bound on port %s (GRO: %s, GSO: %s).", port,
+        server->gro_enabled ? "on" : "off", server->gso_enabled ? "on" : "off");
+    return server;
+}
+
+int udp_server_fd(const UdpServer* server) {
+    return server->fd;
+}
+
+void udp_server_handle_readable(UdpServer* server) {
+    while (1) {
+        for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++) {
+            struct msghdr* hdr = &server->recv_msgs[i].msg_hdr;
+            hdr->msg_name = &server->recv_addrs[i];
+            hdr->msg_namelen = sizeof(server->recv_addrs[i]);
+            hdr->msg_iov = &server->recv_iovs[i];
+            hdr->msg_iovlen = 1;
+            hdr->msg_control = server->recv_control[i];
+            hdr->msg_controllen = sizeof(server->recv_control[i]);
+            hdr->msg_flags = 0;
+            server->recv_msgs[i].msg_len = 0;
+        }
+
+        int received = recvmmsg(server->fd, server->recv_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (received == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("recvmmsg failed: %s", strerror(errno));
+            }
+            break;
+        }
+
+        for (int i = 0; i < received; i++) {
+            struct msghdr* hdr = &server->recv_msgs[i].msg_hdr;
+            uint32_t len = server->recv_msgs[i].msg_len;
+            uint32_t segment = len;
+
+            // With GRO the kernel may coalesce several same-sized datagrams into one buffer
+            if (server->gro_enabled) {
+                for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+                    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                        int gso_size;
+                        memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                        if (gso_size > 0) segment = (uint32_t)gso_size;
+                    }
+                }
+            }
+
+            const uint8_t* data = (const uint8_t*)server->recv_iovs[i].iov_base;
+            for (uint32_t offset = 0; offset < len; offset += segment) {
+                uint32_t chunk = (len - offset < segment) ? len - offset : segment;
+                process_datagram(server, &server->recv_addrs[i], hdr->msg_namelen, data + offset, chunk);
+            }
+        }
+
+        flush_replies(server);
+
+        if (received < UDP_BATCH_SIZE) {
+            break;
+        }
+    }
+}
+
+void udp_server_log_stats(const UdpServer* server) {
+    uint64_t datagrams = 0;
+    uint64_t frames = 0;
+    uint64_t errors = 0;
+    uint32_t tracked = 0;
+
+    for (uint32_t i = 0; i < UDP_SOURCE_SETS * UDP_SOURCE_WAYS; i++) {
+        const UdpSourceStats* entry = &server->sources[i];
+        if (entry->family == 0) continue;
+        tracked++;
+        datagrams += entry->datagrams;
+        frames += entry->frames;
+        errors += entry->errors;
+    }
+
+    LOG_INFO("UDP: %u sources tracked (%llu evicted), %llu datagrams, %llu frames, %llu errors, %llu replies dropped.",
+        tracked, (unsigned long long)server->source_evictions, (unsigned long long)datagrams,
+        (unsigned long long)frames, (unsigned long long)errors, (unsigned long long)server->replies_dropped);
+
+    uint32_t logged = 0;
+    for (uint32_t i = 0; i < UDP_SOURCE_SETS * UDP_SOURCE_WAYS && logged < UDP_STATS_LOG_LIMIT; i++) {
+        const UdpSourceStats* entry = &server->sources[i];
+        if (entry->family == 0) continue;
+
+        char ip[INET6_ADDRSTRLEN];
+        inet_ntop(entry->family, entry->addr, ip, sizeof(ip));
+        LOG_INFO("UDP source %s:%u: %llu datagrams, %llu frames, %llu bytes, %llu errors.",
+            ip, ntohs(entry->port), (unsigned long long)entry->datagrams, (unsigned long long)entry->frames,
+            (unsigned long long)entry->bytes, (unsigned long long)entry->errors);
+        logged++;
+    }
+}
+
+void udp_server_destroy(UdpServer* server) {
+    if (server == NULL) {
+        return;
+    }
+
+    close(server->fd);
+    free(server->recv_buffers);
+    free(server->reply_arena);
+    free(server);
+}
@@ -0,0 +1,741 @@
+/**
+ * @file upstream.c
+ * @brief Implementation of type-routed forwarding over pooled, pipelined backend connections.
+ */
+#include "server/upstream.h"
+#include "protocol/protocol.h"
+#include "common/logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Probes travel under a sequence number no request ever uses
+#define UPSTREAM_PROBE_SEQUENCE 0xFFFFFFFFu
+
+#define UPSTREAM_MAX_NAME 64
+
+typedef enum {
+    UPSTREAM_DISCONNECTED,
+    UPSTREAM_CONNECTING,
+    UPSTREAM_CONNECTED
+} UpstreamState;
+
+/**
+ * @brief A request waiting for its backend response; client is CONNECTION_HANDLE_NONE when free.
+ */
+typedef struct {
+    ConnectionHandle client;
+    uint32_t client_sequence;
+    uint32_t upstream_sequence;
+    uint64_t sent_ms;
+    uint16_t flags;
+} InFlight;
+
+struct Backend;
+
+typedef struct {
+    struct Backend* backend;
+    ClientContext* ctx;         // Registered with the reactor while connecting or connected
+    int fd;
+    UpstreamState state;
+    int verified;               // A probe was answered since the connection came up
+    int blocked;                // The last send hit EAGAIN; EPOLLOUT resumes it
+    uint32_t next_sequence;
+    uint32_t inflight;
+    uint64_t probe_due_ms;
+    uint64_t probe_sent_ms;     // 0 while no probe is outstanding
+    uint64_t sweep_due_ms;
+    uint64_t reconnect_ms;
+    uint32_t backoff_ms;
+
+    uint8_t* output;
+    uint32_t output_head;       // Bytes of output already sent
+    uint32_t output_len;
+    uint32_t output_capacity;
+
+    uint8_t input[UPSTREAM_INPUT_BUFFER];
+    uint32_t input_len;
+
+    InFlight window[UPSTREAM_WINDOW];
+} UpstreamConn;
+
+typedef struct Backend {
+    char name[UPSTREAM_MAX_NAME];
+    struct sockaddr_storage address;
+    socklen_t address_len;
+    uint32_t verified_conns;
+    uint32_t next_conn;
+    int reported_down;
+    uint64_t forwarded;
+    uint64_t failed;
+    uint64_t disconnects;
+    UpstreamConn conns[UPSTREAM_POOL_SIZE];
+} Backend;
+
+typedef struct {
+    uint32_t backend_count;
+    uint32_t next_backend;
+    uint32_t backends[UPSTREAM_MAX_BACKENDS];
+} Route;
+
+static Backend* backends[UPSTREAM_MAX_BACKENDS];
+static uint32_t backend_count = 0;
+static Route routes[UPSTREAM_MAX_ROUTES];
+static uint32_t route_count = 0;
+
+// Route index plus one for every packet type, 0 where the type is executed locally
+static uint8_t route_of_type[PACKET_TYPE_MASK + 1];
+
+static int upstream_epoll_fd = -1;
+static upstream_reply_fn reply_to_client = NULL;
+static int started = 0;
+
+// Millisecond clock, refreshed once per reactor turn
+static uint64_t now_ms = 0;
+
+static uint64_t monotonic_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+// FNV-1a; only needs to spread keys evenly over a handful of backends
+static uint32_t hash_key(const uint8_t* key, uint32_t key_len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < key_len; i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Key the request is sharded on, or NULL if its type carries none
+static const uint8_t* request_key(uint16_t type, const uint8_t* payload, uint32_t payload_len, uint32_t* key_len) {
+    switch (type) {
+    case PACKET_TYPE_KV_GET:
+    case PACKET_TYPE_KV_DEL:
+        *key_len = payload_len;
+        return payload_len > 0 ? payload : NULL;
+    case PACKET_TYPE_KV_SET:
+    case PACKET_TYPE_PUBLISH:
+        // Both length prefixes are 16 bits in network order
+        if (payload_len >= KV_KEY_LENGTH_SIZE) {
+            uint32_t length = ((uint32_t)payload[0] << 8) | payload[1];
+            if (length <= payload_len - KV_KEY_LENGTH_SIZE) {
+                *key_len = length;
+                return payload + KV_KEY_LENGTH_SIZE;
+            }
+        }
+        return NULL;
+    default:
+        return NULL;
+    }
+}
+
+// Types whose semantics depend on this process: liveness, descriptor passing and push streams
+static int is_local_only(uint32_t type) {
+    return type == PACKET_TYPE_HEARTBEAT || type == PACKET_TYPE_SHM_ATTACH ||
+        type == PACKET_TYPE_SUBSCRIBE || type == PACKET_TYPE_UNSUBSCRIBE || type == PACKET_TYPE_ERROR;
+}
+
+static int add_backend(const char* endpoint, uint32_t* index) {
+    for (uint32_t i = 0; i < backend_count; i++) {
+        if (strcmp(backends[i]->name, endpoint) == 0) {
+            *index = i;
+            return 0;
+        }
+    }
+
+    const char* colon = strrchr(endpoint, ':');
+    size_t host_len = colon != NULL ? (size_t)(colon - endpoint) : 0;
+    if (colon == NULL || host_len == 0 || host_len >= UPSTREAM_MAX_NAME || colon[1] == '\0' ||
+        strlen(endpoint) >= UPSTREAM_MAX_NAME || backend_count == UPSTREAM_MAX_BACKENDS) {
+        LOG_ERROR("Invalid upstream endpoint '%s' (expected host:port).", endpoint);
+        return -1;
+    }
+
+    char host[UPSTREAM_MAX_NAME];
+    memcpy(host, endpoint, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int rc = getaddrinfo(host, colon + 1, &hints, &result);
+    if (rc != 0) {
+        LOG_ERROR("Cannot resolve upstream %s: %s", endpoint, gai_strerror(rc));
+        return -1;
+    }
+
+    Backend* backend = (Backend*)calloc(1, sizeof(Backend));
+    if (backend == NULL) {
+        freeaddrinfo(result);
+        return -1;
+    }
+    snprintf(backend->name, sizeof(backend->name), "%s", endpoint);
+    memcpy(&backend->address, result->ai_addr, result->ai_addrlen);
+    backend->address_len = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+        backend->conns[i].backend = backend;
+        backend->conns[i].fd = -1;
+        backend->conns[i].backoff_ms = UPSTREAM_RECONNECT_MIN_MS;
+    }
+
+    *index = backend_count;
+    backends[backend_count++] = backend;
+    return 0;
+}
+
+static int parse_route(const char* spec) {
+    const char* at = strchr(spec, '@');
+    if (at == NULL || route_count == UPSTREAM_MAX_ROUTES) {
+        LOG_ERROR("Invalid upstream route '%s' (expected types@host:port[,host:port...]).", spec);
+        return -1;
+    }
+
+    char* end = NULL;
+    unsigned long first = strtoul(spec, &end, 0);
+    unsigned long last = first;
+    if (end != spec && *end == '-') {
+        const char* upper = end + 1;
+        last = strtoul(upper, &end, 0);
+        if (end == upper) {
+            end = NULL;
+        }
+    }
+    if (end == spec || end != at || first > last || last > PACKET_TYPE_MASK) {
+        LOG_ERROR("Invalid packet types in upstream route '%s'.", spec);
+        return -1;
+    }
+
+    for (unsigned long type = first; type <= last; type++) {
+        if (is_local_only((uint32_t)type) || route_of_type[type] != 0) {
+            LOG_ERROR("Packet type 0x%02lx cannot be forwarded by route '%s'.", type, spec);
+            return -1;
+        }
+    }
+
+    Route* route = &routes[route_count];
+    memset(route, 0, sizeof(*route));
+
+    char endpoints[UPSTREAM_MAX_BACKENDS * UPSTREAM_MAX_NAME];
+    snprintf(endpoints, sizeof(endpoints), "%s", at + 1);
+    char* saveptr = NULL;
+    for (char* endpoint = strtok_r(endpoints, ",", &saveptr); endpoint != NULL; endpoint = strtok_r(NULL, ",", &saveptr)) {
+        if (route->backend_count == UPSTREAM_MAX_BACKENDS) {
+            LOG_ERROR("Too many backends in upstream route '%s'.", spec);
+            return -1;
+        }
+        if (add_backend(endpoint, &route->backends[route->backend_count]) != 0) {
+            return -1;
+        }
+        route->backend_count++;
+    }
+    if (route->backend_count == 0) {
+        LOG_ERROR("Upstream route '%s' names no backend.", spec);
+        return -1;
+    }
+
+    route_count++;
+    for (unsigned long type = first; type <= last; type++) {
+        route_of_type[type] = (uint8_t)route_count;
+    }
+    return 0;
+}
+
+int upstream_configure(const char* const* route_specs, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (parse_route(route_specs[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int upstream_routes_type(uint16_t type) {
+    return route_of_type[type & PACKET_TYPE_MASK] != 0;
+}
+
+static void update_backend_health(Backend* backend, int verified_delta) {
+    uint32_t before = backend->verified_conns;
+    backend->verified_conns += (uint32_t)verified_delta;
+
+    if (!started) {
+        return;
+    }
+    if (before == 0 && backend->verified_conns > 0) {
+        LOG_INFO("Upstream %s is healthy.", backend->name);
+        backend->reported_down = 0;
+    }
+    else if (before > 0 && backend->verified_conns == 0) {
+        LOG_WARN("Upstream %s is out of rotation.", backend->name);
+        backend->reported_down = 1;
+    }
+}
+
+// Fails outstanding requests and tears the connection down; schedule selects a reconnect
+static void close_conn(UpstreamConn* conn, const char* reason, int schedule) {
+    Backend* backend = conn->backend;
+    if (conn->state == UPSTREAM_DISCONNECTED) {
+        return;
+    }
+
+    if (conn->state == UPSTREAM_CONNECTED) {
+        backend->disconnects++;
+    }
+    if (!backend->reported_down && backend->verified_conns == 0) {
+        LOG_WARN("Upstream %s unreachable: %s", backend->name, reason);
+        backend->reported_down = 1;
+    }
+    else {
+        LOG_DEBUG("Upstream %s connection closed: %s", backend->name, reason);
+    }
+
+    epoll_ctl(upstream_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    connection_table_discard(conn->ctx);
+    conn->fd = -1;
+    conn->ctx = NULL;
+    conn->state = UPSTREAM_DISCONNECTED;
+    if (conn->verified) {
+        conn->verified = 0;
+        update_backend_health(backend, -1);
+    }
+
+    for (uint32_t i = 0; i < UPSTREAM_WINDOW && conn->inflight > 0; i++) {
+        InFlight* entry = &conn->window[i];
+        if (entry->client != CONNECTION_HANDLE_NONE) {
+            reply_to_client(entry->client, PACKET_TYPE_ERROR, entry->client_sequence, NULL, 0, entry->flags);
+            entry->client = CONNECTION_HANDLE_NONE;
+            conn->inflight--;
+            backend->failed++;
+        }
+    }
+    conn->inflight = 0;
+    conn->output_head = 0;
+    conn->output_len = 0;
+    conn->input_len = 0;
+    conn->blocked = 0;
+    conn->probe_sent_ms = 0;
+
+    if (schedule) {
+        conn->reconnect_ms = now_ms + conn->backoff_ms;
+        conn->backoff_ms = conn->backoff_ms * 2 < UPSTREAM_RECONNECT_MAX_MS ? conn->backoff_ms * 2 : UPSTREAM_RECONNECT_MAX_MS;
+    }
+}
+
+static int reserve_output(UpstreamConn* conn, uint32_t length) {
+    if (conn->output_head > 0 && conn->output_len + length > conn->output_capacity) {
+        memmove(conn->output, conn->output + conn->output_head, conn->output_len - conn->output_head);
+        conn->output_len -= conn->output_head;
+        conn->output_head = 0;
+    }
+    if (conn->output_len + length <= conn->output_capacity) {
+        return 0;
+    }
+
+    uint32_t capacity = conn->output_capacity > 0 ? conn->output_capacity : 4096;
+    while (capacity < conn->output_len + length) {
+        capacity *= 2;
+    }
+    uint8_t* grown = (uint8_t*)realloc(conn->output, capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    conn->output = grown;
+    conn->output_capacity = capacity;
+    return 0;
+}
+
+// Frames are only appended here; upstream_poll sends everything queued in one call per connection
+static int queue_frame(UpstreamConn* conn, uint16_t type, uint32_t sequence_number, const uint8_t* payload, uint32_t payload_len) {
+    if (reserve_output(conn, (uint32_t)sizeof(PacketHeader) + payload_len) != 0) {
+        return -1;
+    }
+
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = type;
+    header.sequence_number = sequence_number;
+    header.payload_length = payload_len;
+    serialize_header(&header, conn->output + conn->output_len);
+    conn->output_len += (uint32_t)sizeof(PacketHeader);
+
+    if (payload_len > 0) {
+        memcpy(conn->output + conn->output_len, payload, payload_len);
+        conn->output_len += payload_len;
+    }
+    return 0;
+}
+
+static int flush_conn(UpstreamConn* conn) {
+    while (conn->output_head < conn->output_len) {
+        ssize_t sent = send(conn->fd, conn->output + conn->output_head, conn->output_len - conn->output_head, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->blocked = 1;
+                return 0;
+            }
+            close_conn(conn, strerror(errno), 1);
+            return -1;
+        }
+        conn->output_head += (uint32_t)sent;
+    }
+
+    conn->output_head = 0;
+    conn->output_len = 0;
+    return 0;
+}
+
+static void on_connected(UpstreamConn* conn) {
+    conn->state = UPSTREAM_CONNECTED;
+    conn->next_sequence = 0;
+    conn->probe_due_ms = now_ms;
+    conn->sweep_due_ms = now_ms + UPSTREAM_HEALTH_INTERVAL_MS;
+}
+
+static void start_connect(UpstreamConn* conn) {
+    Backend* backend = conn->backend;
+    int fd = socket(backend->address.ss_family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        conn->reconnect_ms = now_ms + conn->backoff_ms;
+        return;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    ClientContext* ctx = connection_table_open(fd, TRANSPORT_TCP);
+    if (ctx == NULL) {
+        close(fd);
+        conn->reconnect_ms = now_ms + conn->backoff_ms;
+        return;
+    }
+    ctx->flags |= CLIENT_FLAG_UPSTREAM;
+    conn->fd = fd;
+    conn->ctx = ctx;
+    conn->state = UPSTREAM_CONNECTING;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.u64 = connection_table_handle(ctx);
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    if (epoll_ctl(upstream_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        close_conn(conn, strerror(errno), 1);
+        return;
+    }
+
+    if (connect(fd, (struct sockaddr*)&backend->address, backend->address_len) == 0) {
+        on_connected(conn);
+    }
+    else if (errno != EINPROGRESS) {
+        close_conn(conn, strerror(errno), 1);
+    }
+}
+
+void upstream_start(int epoll_fd, upstream_reply_fn reply) {
+    if (route_count == 0) {
+        return;
+    }
+
+    upstream_epoll_fd = epoll_fd;
+    reply_to_client = reply;
+    now_ms = monotonic_millis();
+    started = 1;
+
+    for (uint32_t b = 0; b < backend_count; b++) {
+        for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+            start_connect(&backends[b]->conns[i]);
+        }
+    }
+    LOG_INFO("Forwarding %u routes to %u upstreams (%d connections each).", route_count, backend_count, UPSTREAM_POOL_SIZE);
+}
+
+static UpstreamConn* usable_conn(Backend* backend) {
+    for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+        UpstreamConn* conn = &backend->conns[(backend->next_conn + i) % UPSTREAM_POOL_SIZE];
+        if (conn->verified && conn->inflight < UPSTREAM_WINDOW &&
+            conn->window[conn->next_sequence & (UPSTREAM_WINDOW - 1)].client == CONNECTION_HANDLE_NONE &&
+            conn->output_len - conn->output_head < UPSTREAM_OUTPUT_LIMIT) {
+            backend->next_conn = (backend->next_conn + i + 1) % UPSTREAM_POOL_SIZE;
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+int upstream_forward(ConnectionHandle client, uint16_t type, uint32_t sequence_number,
+    const uint8_t* payload, uint32_t payload_len, uint16_t flags) {
+    uint32_t index = route_of_type[type & PACKET_TYPE_MASK];
+    if (index == 0 || !started) {
+        return -1;
+    }
+    Route* route = &routes[index - 1];
+
+    // Keyed requests stick to one backend and only move while it is out of rotation
+    uint32_t key_len = 0;
+    const uint8_t* key = request_key(type, payload, payload_len, &key_len);
+    uint32_t start = (key != NULL) ? hash_key(key, key_len) % route->backend_count : route->next_backend++ % route->backend_count;
+
+    for (uint32_t i = 0; i < route->backend_count; i++) {
+        Backend* backend = backends[route->backends[(start + i) % route->backend_count]];
+        if (backend->verified_conns == 0) {
+            continue;
+        }
+
+        UpstreamConn* conn = usable_conn(backend);
+        if (conn == NULL) {
+            continue;
+        }
+
+        uint32_t upstream_sequence = conn->next_sequence;
+        if (queue_frame(conn, type, upstream_sequence, payload, payload_len) != 0) {
+            return -1;
+        }
+        conn->next_sequence++;
+        if (conn->next_sequence == UPSTREAM_PROBE_SEQUENCE) {
+            conn->next_sequence = 0;
+        }
+
+        InFlight* entry = &conn->window[upstream_sequence & (UPSTREAM_WINDOW - 1)];
+        entry->client = client;
+        entry->client_sequence = sequence_number;
+        entry->upstream_sequence = upstream_sequence;
+        entry->sent_ms = now_ms;
+        entry->flags = flags;
+        conn->inflight++;
+        backend->forwarded++;
+        return 0;
+    }
+
+    return -1;
+}
+
+static void handle_response(UpstreamConn* conn, const PacketHeader* header, const uint8_t* payload) {
+    if (header->sequence_number == UPSTREAM_PROBE_SEQUENCE && header->type == PACKET_TYPE_HEARTBEAT) {
+        conn->probe_sent_ms = 0;
+        conn->probe_due_ms = now_ms + UPSTREAM_HEALTH_INTERVAL_MS;
+        conn->backoff_ms = UPSTREAM_RECONNECT_MIN_MS;
+        if (!conn->verified) {
+            conn->verified = 1;
+            update_backend_health(conn->backend, 1);
+        }
+        return;
+    }
+
+    InFlight* entry = &conn->window[header->sequence_number & (UPSTREAM_WINDOW - 1)];
+    if (entry->client == CONNECTION_HANDLE_NONE || entry->upstream_sequence != header->sequence_number) {
+        // Expired requests, or frames the backend pushes on its own
+        LOG_DEBUG("Dropping unmatched upstream frame (type %d, sequence %u) from %s.",
+            header->type, header->sequence_number, conn->backend->name);
+        return;
+    }
+
+    ConnectionHandle client = entry->client;
+    entry->client = CONNECTION_HANDLE_NONE;
+    conn->inflight--;
+    reply_to_client(client, header->type, entry->client_sequence, payload, header->payload_length, entry->flags);
+}
+
+static void read_responses(UpstreamConn* conn) {
+    while (1) {
+        ssize_t bytes_read = recv(conn->fd, conn->input + conn->input_len, sizeof(conn->input) - conn->input_len, 0);
+        if (bytes_read == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            close_conn(conn, strerror(errno), 1);
+            return;
+        }
+        if (bytes_read == 0) {
+            close_conn(conn, "closed by peer", 1);
+            return;
+        }
+        conn->input_len += (uint32_t)bytes_read;
+
+        uint32_t offset = 0;
+        while (conn->input_len - offset >= sizeof(PacketHeader)) {
+            PacketHeader header;
+            deserialize_header(conn->input + offset, &header);
+            if (header.payload_length > MAX_PAYLOAD_SIZE + PACKET_CRC32C_SIZE) {
+                close_conn(conn, "oversized response frame", 1);
+                return;
+            }
+
+            uint32_t frame_len = (uint32_t)sizeof(PacketHeader) + header.payload_length;
+            if (conn->input_len - offset < frame_len) {
+                break;
+            }
+            handle_response(conn, &header, conn->input + offset + sizeof(PacketHeader));
+            offset += frame_len;
+        }
+
+        if (offset > 0) {
+            memmove(conn->input, conn->input + offset, conn->input_len - offset);
+            conn->input_len -= offset;
+        }
+    }
+}
+
+static UpstreamConn* find_conn(const ClientContext* ctx) {
+    for (uint32_t b = 0; b < backend_count; b++) {
+        for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+            if (backends[b]->conns[i].ctx == ctx) {
+                return &backends[b]->conns[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+void upstream_handle_event(ClientContext* ctx, uint32_t events) {
+    UpstreamConn* conn = find_conn(ctx);
+    if (conn == NULL) {
+        return;
+    }
+
+    if (conn->state == UPSTREAM_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            return;
+        }
+
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1) {
+            error = errno;
+        }
+        if (error != 0) {
+            close_conn(conn, strerror(error), 1);
+            return;
+        }
+        on_connected(conn);
+    }
+
+    if ((events & EPOLLOUT) && conn->blocked) {
+        conn->blocked = 0;
+        if (flush_conn(conn) != 0) {
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        read_responses(conn);
+    }
+}
+
+// Gives up on requests the backend never answered, e.g. types it does not implement
+static void expire_requests(UpstreamConn* conn) {
+    for (uint32_t i = 0; i < UPSTREAM_WINDOW && conn->inflight > 0; i++) {
+        InFlight* entry = &conn->window[i];
+        if (entry->client != CONNECTION_HANDLE_NONE && now_ms - entry->sent_ms >= UPSTREAM_REQUEST_TIMEOUT_MS) {
+            reply_to_client(entry->client, PACKET_TYPE_ERROR, entry->client_sequence, NULL, 0, entry->flags);
+            entry->client = CONNECTION_HANDLE_NONE;
+            conn->inflight--;
+            conn->backend->failed++;
+        }
+    }
+}
+
+static uint64_t earlier(uint64_t deadline, uint64_t candidate) {
+    return candidate < deadline ? candidate : deadline;
+}
+
+int upstream_poll(void) {
+    if (!started) {
+        return -1;
+    }
+
+    now_ms = monotonic_millis();
+    uint64_t next_ms = now_ms + UPSTREAM_HEALTH_INTERVAL_MS;
+
+    for (uint32_t b = 0; b < backend_count; b++) {
+        for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+            UpstreamConn* conn = &backends[b]->conns[i];
+
+            if (conn->state == UPSTREAM_DISCONNECTED) {
+                if (now_ms >= conn->reconnect_ms) {
+                    start_connect(conn);
+                }
+                if (conn->state == UPSTREAM_DISCONNECTED) {
+                    next_ms = earlier(next_ms, conn->reconnect_ms);
+                    continue;
+                }
+            }
+            if (conn->state != UPSTREAM_CONNECTED) {
+                continue;
+            }
+
+            if (conn->probe_sent_ms != 0) {
+                if (now_ms - conn->probe_sent_ms >= UPSTREAM_HEALTH_TIMEOUT_MS) {
+                    close_conn(conn, "health probe unanswered", 1);
+                    next_ms = earlier(next_ms, conn->reconnect_ms);
+                    continue;
+                }
+                next_ms = earlier(next_ms, conn->probe_sent_ms + UPSTREAM_HEALTH_TIMEOUT_MS);
+            }
+            else if (now_ms >= conn->probe_due_ms) {
+                if (queue_frame(conn, PACKET_TYPE_HEARTBEAT, UPSTREAM_PROBE_SEQUENCE, NULL, 0) == 0) {
+                    conn->probe_sent_ms = now_ms;
+                }
+                next_ms = earlier(next_ms, now_ms + UPSTREAM_HEALTH_TIMEOUT_MS);
+            }
+            else {
+                next_ms = earlier(next_ms, conn->probe_due_ms);
+            }
+
+            if (now_ms >= conn->sweep_due_ms) {
+                expire_requests(conn);
+                conn->sweep_due_ms = now_ms + UPSTREAM_HEALTH_INTERVAL_MS;
+            }
+
+            if (!conn->blocked && conn->output_len > conn->output_head) {
+                flush_conn(conn);
+            }
+        }
+    }
+
+    return next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+}
+
+void upstream_shutdown(void) {
+    if (!started) {
+        return;
+    }
+    started = 0;
+    now_ms = monotonic_millis();
+
+    for (uint32_t b = 0; b < backend_count; b++) {
+        Backend* backend = backends[b];
+        for (uint32_t i = 0; i < UPSTREAM_POOL_SIZE; i++) {
+            UpstreamConn* conn = &backend->conns[i];
+            // Requests still queued or in flight get an answer before their clients go away
+            backend->reported_down = 1;
+            close_conn(conn, "shutting down", 0);
+            free(conn->output);
+            conn->output = NULL;
+            conn->output_capacity = 0;
+        }
+        LOG_INFO("Upstream %s: %llu forwarded, %llu failed, %llu disconnects.", backend->name,
+            (unsigned long long)backend->forwarded, (unsigned long long)backend->failed,
+            (unsigned long long)backend->disconnects);
+        free(backend);
+        backends[b] = NULL;
+    }
+    backend_count = 0;
+    route_count = 0;
+    memset(route_of_type, 0, sizeof(route_of_type));
+}
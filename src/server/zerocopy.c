@@ -0,0 +1,230 @@
+/**
+ * @file zerocopy.c
+ * @brief Implementation of MSG_ZEROCOPY sends with completion harvesting from the socket error queue.
+ */
+#define _GNU_SOURCE
+#include "server/zerocopy.h"
+#include "common/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+typedef struct ZeroCopyFrame {
+    uint32_t id;
+    int completed;
+    uint8_t* data;
+    struct ZeroCopyFrame* next;
+} ZeroCopyFrame;
+
+/**
+ * @brief In-flight frames of one connection. The lock orders sends against each other so
+ * the locally assigned ids match the kernel's per-socket counter.
+ */
+typedef struct ZeroCopyConnection {
+    int fd;
+    pthread_mutex_t lock;
+    uint32_t next_id;
+    uint32_t pending;
+    ZeroCopyFrame* head;
+    ZeroCopyFrame* tail;
+    struct ZeroCopyConnection* next;
+} ZeroCopyConnection;
+
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static ZeroCopyConnection* connections[ZEROCOPY_FD_BUCKETS];
+
+// Frames still pinned when their socket closed; guarded by map_lock and kept until exit
+static ZeroCopyFrame* orphans = NULL;
+static uint64_t orphaned_frames = 0;
+
+static _Atomic uint64_t frames_sent = 0;
+static _Atomic uint64_t frames_copied = 0;
+
+// Entries appear on a connection's first zerocopy send, so idle connections cost nothing
+static ZeroCopyConnection* find_connection(int fd, int create) {
+    pthread_mutex_lock(&map_lock);
+    ZeroCopyConnection** bucket = &connections[(uint32_t)fd % ZEROCOPY_FD_BUCKETS];
+    ZeroCopyConnection* conn = *bucket;
+    while (conn != NULL && conn->fd != fd) {
+        conn = conn->next;
+    }
+
+    if (conn == NULL && create) {
+        conn = (ZeroCopyConnection*)calloc(1, sizeof(ZeroCopyConnection));
+        if (conn != NULL) {
+            conn->fd = fd;
+            pthread_mutex_init(&conn->lock, NULL);
+            conn->next = *bucket;
+            *bucket = conn;
+        }
+    }
+    pthread_mutex_unlock(&map_lock);
+    return conn;
+}
+
+static void free_completed_frames(ZeroCopyConnection* conn) {
+    while (conn->head != NULL && conn->head->completed) {
+        ZeroCopyFrame* frame = conn->head;
+        conn->head = frame->next;
+        free(frame->data);
+        free(frame);
+        conn->pending--;
+    }
+    if (conn->head == NULL) {
+        conn->tail = NULL;
+    }
+}
+
+int zerocopy_enable(int fd) {
+    int flag = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &flag, sizeof(flag));
+}
+
+ssize_t zerocopy_send(int fd, uint8_t* frame, size_t len) {
+    ZeroCopyConnection* conn = find_connection(fd, 1);
+    ZeroCopyFrame* node = (ZeroCopyFrame*)malloc(sizeof(ZeroCopyFrame));
+    if (conn == NULL || node == NULL) {
+        free(node);
+        return -1;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    if (conn->pending >= ZEROCOPY_MAX_PENDING) {
+        pthread_mutex_unlock(&conn->lock);
+        free(node);
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    // A failed call does not consume an id; any accepted byte count does
+    ssize_t sent = send(fd, frame, len, MSG_ZEROCOPY);
+    if (sent < 0) {
+        pthread_mutex_unlock(&conn->lock);
+        free(node);
+        return -1;
+    }
+
+    node->id = conn->next_id++;
+    node->completed = 0;
+    node->data = frame;
+    node->next = NULL;
+    if (conn->tail != NULL) {
+        conn->tail->next = node;
+    }
+    else {
+        conn->head = node;
+    }
+    conn->tail = node;
+    conn->pending++;
+    pthread_mutex_unlock(&conn->lock);
+
+    atomic_fetch_add_explicit(&frames_sent, 1, memory_order_relaxed);
+    return sent;
+}
+
+static void harvest_connection(ZeroCopyConnection* conn, int fd) {
+    while (1) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            break;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0 || conn == NULL) {
+                continue;
+            }
+
+            // The notification covers the inclusive id range [ee_info, ee_data], which may wrap
+            uint32_t lo = err.ee_info;
+            uint32_t span = err.ee_data - lo;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                atomic_fetch_add_explicit(&frames_copied, (uint64_t)span + 1, memory_order_relaxed);
+            }
+
+            pthread_mutex_lock(&conn->lock);
+            for (ZeroCopyFrame* frame = conn->head; frame != NULL; frame = frame->next) {
+                if (frame->id - lo <= span) {
+                    frame->completed = 1;
+                }
+            }
+            free_completed_frames(conn);
+            pthread_mutex_unlock(&conn->lock);
+        }
+    }
+}
+
+void zerocopy_harvest(int fd) {
+    harvest_connection(find_connection(fd, 0), fd);
+}
+
+void zerocopy_release(int fd) {
+    pthread_mutex_lock(&map_lock);
+    ZeroCopyConnection** link = &connections[(uint32_t)fd % ZEROCOPY_FD_BUCKETS];
+    while (*link != NULL && (*link)->fd != fd) {
+        link = &(*link)->next;
+    }
+    ZeroCopyConnection* conn = *link;
+    if (conn != NULL) {
+        *link = conn->next;
+    }
+    pthread_mutex_unlock(&map_lock);
+
+    if (conn == NULL) {
+        return;
+    }
+
+    // Completions cannot be read once the fd is closed, yet the kernel may still be sending frames
+    // the peer is owed. They are never reused or freed, so the close stays graceful
+    harvest_connection(conn, fd);
+    if (conn->tail != NULL) {
+        pthread_mutex_lock(&map_lock);
+        conn->tail->next = orphans;
+        orphans = conn->head;
+        orphaned_frames += conn->pending;
+        pthread_mutex_unlock(&map_lock);
+    }
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+void zerocopy_log_stats(void) {
+    uint64_t sent = atomic_load(&frames_sent);
+    if (sent == 0) {
+        return;
+    }
+    pthread_mutex_lock(&map_lock);
+    uint64_t orphaned = orphaned_frames;
+    pthread_mutex_unlock(&map_lock);
+    LOG_INFO("Zerocopy: %llu frames sent, %llu completed by kernel copy, %llu still in flight at close.",
+        (unsigned long long)sent, (unsigned long long)atomic_load(&frames_copied), (unsigned long long)orphaned);
+}
@@ -2,45 +2,91 @@
  * @file benchmark.c
  * @brief Concurrent load testing tool to measure server throughput and temporal efficiency.
  */
+#include "client/net_client.h"
 #include "protocol/protocol.h"
+#include "protocol/crc32c.h"
+#include "protocol/lz.h"
+#include "common/shm_channel.h"
+#include "common/net_utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
-#include <arpa/inet.h>
+#include <math.h>
 #include <sys/socket.h>
-#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #define SERVER_IP "127.0.0.1"
 #define CMD_ECHO 0x02
 #define THREAD_COUNT 10
 #define REQUESTS_PER_THREAD 10000
+#define KV_DEFAULT_READ_PERCENT 90
+#define KV_DEFAULT_KEY_COUNT 100000
+#define KV_ZIPF_THETA 0.99
+#define KV_VALUE_SIZE 64
+#define RTT_DEFAULT_UNIX_PATH "/tmp/network_server.sock"
+#define RTT_SAMPLES 20000
+#define RTT_SHM_SPIN_ITERATIONS 2000
+#define DEFAULT_PIPELINE_DEPTH 1
+#define DEFAULT_POOL_SIZE 1
+#define PRIORITY_BULK_PAYLOAD 1000
+#define PRIORITY_BULK_DEPTH 64
+#define NEIGHBOR_BULK_DEPTH 512
+#define NEIGHBOR_BULK_REQUESTS 300000
+#define IDLE_DEFAULT_CONNECTIONS 10000
+#define IDLE_CONNECTIONS_PER_SOURCE 20000
+#define IDLE_SETTLE_NANOS 500000000L
+#define SWEEP_DEPTH 16
+#define CRC_BYTES_PER_SIZE (512UL << 20)
+#define COMPRESS_PAYLOAD_SIZE 1000
+#define COMPRESS_CODEC_BYTES (256UL << 20)
+#define WARMUP_REQUESTS 20000
+#define WARMUP_PAYLOAD 1000
+
+typedef enum {
+    WORKLOAD_ECHO,
+    WORKLOAD_KV,
+    WORKLOAD_RTT,
+    WORKLOAD_PRIORITY,
+    WORKLOAD_SWEEP,
+    WORKLOAD_COMPRESS
+} Workload;
 
 typedef struct {
-    int port;
+    const char* endpoint;
     int thread_id;
     uint32_t success_count;
+    uint32_t kv_hits;
+    uint32_t kv_misses;
+    uint64_t wire_bytes;
 } BenchmarkConfig;
 
+static Workload workload = WORKLOAD_ECHO;
+static int kv_read_percent = KV_DEFAULT_READ_PERCENT;
+static uint32_t kv_key_count = KV_DEFAULT_KEY_COUNT;
+static double* zipf_cdf = NULL;
+static uint32_t pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+static uint32_t pool_size = DEFAULT_POOL_SIZE;
+static uint32_t sweep_payload_size = 0;
+static uint32_t bulk_depth = PRIORITY_BULK_DEPTH;
+static int requests_per_thread = REQUESTS_PER_THREAD;
+static int checksum_frames = 0;
+static uint32_t compress_threshold = 0;
+static uint8_t compress_corpus[COMPRESS_PAYLOAD_SIZE];
+static uint32_t compress_corpus_len = 0;
+
 static double get_time_seconds(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 }
 
-static ssize_t recv_full(int fd, void* buf, size_t n) {
-    size_t total_read = 0;
-    char* ptr = (char*)buf;
-    while (total_read < n) {
-        ssize_t bytes = recv(fd, ptr + total_read, n - total_read, 0);
-        if (bytes <= 0) return bytes;
-        total_read += (size_t)bytes;
-    }
-    return (ssize_t)total_read;
-}
-
 static ssize_t send_full(int fd, const void* buf, size_t n) {
     size_t total_sent = 0;
     const char* ptr = (const char*)buf;
@@ -52,69 +98,948 @@ static ssize_t send_full(int fd, const void* buf, size_t n) {
     return (ssize_t)total_sent;
 }
 
-static void* benchmark_worker(void* arg) {
-    BenchmarkConfig* config = (BenchmarkConfig*)arg;
-    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock_fd < 0) pthread_exit(NULL);
+// Cumulative distribution over key ranks; rank 0 is the hottest key
+static int build_zipf_table(uint32_t key_count, double theta) {
+    zipf_cdf = (double*)malloc(sizeof(double) * key_count);
+    if (zipf_cdf == NULL) return -1;
 
-    int flag = 1;
-    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
+    double sum = 0.0;
+    for (uint32_t i = 0; i < key_count; i++) {
+        sum += 1.0 / pow((double)(i + 1), theta);
+        zipf_cdf[i] = sum;
+    }
+    for (uint32_t i = 0; i < key_count; i++) {
+        zipf_cdf[i] /= sum;
+    }
+    return 0;
+}
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(config->port);
-    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t next_zipf_key(uint64_t* state) {
+    double u = (double)(next_random(state) >> 11) / (double)(1ULL << 53);
+    uint32_t lo = 0;
+    uint32_t hi = kv_key_count - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (zipf_cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void echo_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    (void)header;
+    (void)payload;
+    if (status == 0) ((BenchmarkConfig*)user_data)->success_count++;
+}
+
+// Echoes must come back byte for byte, whichever way each direction was encoded
+static void compress_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    if (status == 0 && header->payload_length == compress_corpus_len &&
+        memcmp(payload, compress_corpus, compress_corpus_len) == 0) {
+        ((BenchmarkConfig*)user_data)->success_count++;
+    }
+}
+
+static void kv_write_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    (void)payload;
+    if (status == 0 && header->payload_length >= 1) ((BenchmarkConfig*)user_data)->success_count++;
+}
+
+static void kv_read_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    BenchmarkConfig* config = (BenchmarkConfig*)user_data;
+    if (status != 0 || header->payload_length < 1) return;
+
+    if (payload[0] == KV_STATUS_OK) config->kv_hits++;
+    else config->kv_misses++;
+    config->success_count++;
+}
 
-    if (connect(sock_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+static int submit_kv_request(NetClient* client, BenchmarkConfig* config, uint64_t* rng_state) {
+    uint8_t payload[KV_KEY_LENGTH_SIZE + 32 + KV_VALUE_SIZE];
+    char key[32];
+    int key_len = snprintf(key, sizeof(key), "key:%08u", next_zipf_key(rng_state));
+    int is_read = (int)(next_random(rng_state) % 100) < kv_read_percent;
+
+    if (is_read) {
+        memcpy(payload, key, (size_t)key_len);
+        return net_client_submit(client, PACKET_TYPE_KV_GET, payload, (uint32_t)key_len, kv_read_done, config);
+    }
+
+    payload[0] = (uint8_t)(key_len >> 8);
+    payload[1] = (uint8_t)key_len;
+    memcpy(payload + KV_KEY_LENGTH_SIZE, key, (size_t)key_len);
+    memset(payload + KV_KEY_LENGTH_SIZE + key_len, 'v', KV_VALUE_SIZE);
+    return net_client_submit(client, PACKET_TYPE_KV_SET, payload,
+        KV_KEY_LENGTH_SIZE + (uint32_t)key_len + KV_VALUE_SIZE, kv_write_done, config);
+}
+
+// Keeps pipeline_depth requests outstanding; depth 1 degenerates to strict request/response
+static void run_workload(NetClient* client, BenchmarkConfig* config) {
+    static uint8_t bulk_payload[MAX_PAYLOAD_SIZE];
+    const char* message_data = "BENCHMARK_PAYLOAD";
+    uint32_t data_len = (uint32_t)strlen(message_data);
+    uint32_t depth = pipeline_depth;
+    uint64_t rng_state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(config->thread_id + 1) << 32);
+    int issued = 0;
+
+    // Bulk senders keep the pool's queue saturated with large frames
+    if (workload == WORKLOAD_PRIORITY) {
+        message_data = (const char*)bulk_payload;
+        data_len = PRIORITY_BULK_PAYLOAD;
+        depth = bulk_depth;
+    }
+    else if (workload == WORKLOAD_SWEEP) {
+        message_data = (const char*)bulk_payload;
+        data_len = sweep_payload_size;
+        depth = SWEEP_DEPTH;
+    }
+    else if (workload == WORKLOAD_COMPRESS) {
+        message_data = (const char*)compress_corpus;
+        data_len = compress_corpus_len;
+        depth = SWEEP_DEPTH;
+    }
+
+    while (issued < requests_per_thread) {
+        while (issued < requests_per_thread && net_client_in_flight(client) < depth) {
+            int rc = (workload == WORKLOAD_KV)
+                ? submit_kv_request(client, config, &rng_state)
+                : net_client_submit(client, CMD_ECHO, (const uint8_t*)message_data, data_len,
+                    workload == WORKLOAD_COMPRESS ? compress_done : echo_done, config);
+            if (rc != 0) break;
+            issued++;
+        }
+
+        if (net_client_in_flight(client) == 0) break;
+        if (net_client_poll(client, -1) < 0) break;
+    }
+
+    net_client_wait_all(client);
+}
+
+static int connect_unix(const char* path) {
+    int sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock_fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(sock_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         close(sock_fd);
-        pthread_exit(NULL);
+        return -1;
+    }
+    return sock_fd;
+}
+
+// Sends SHM_ATTACH over the Unix connection and maps the channel passed back with SCM_RIGHTS
+static int attach_shm(int unix_fd, ShmChannel* channel) {
+    PacketHeader header;
+    memset(&header, 0, sizeof(header));
+    header.version = PROTOCOL_VERSION_1;
+    header.type = PACKET_TYPE_SHM_ATTACH;
+
+    uint8_t request[sizeof(PacketHeader)];
+    serialize_header(&header, request);
+    if (send_full(unix_fd, request, sizeof(request)) <= 0) return -1;
+
+    uint8_t reply[sizeof(PacketHeader) + sizeof(uint32_t)];
+    int fds[SHM_ATTACH_FD_COUNT];
+    int fd_count = SHM_ATTACH_FD_COUNT;
+    if (recv_with_fds(unix_fd, reply, sizeof(reply), fds, &fd_count) != (ssize_t)sizeof(reply)) return -1;
+
+    deserialize_header(reply, &header);
+    if (header.type != PACKET_TYPE_ACK || fd_count != SHM_ATTACH_FD_COUNT) {
+        for (int i = 0; i < fd_count; i++) close(fds[i]);
+        return -1;
     }
 
+    return shm_channel_attach(channel, fds[0], fds[1], fds[2]);
+}
+
+// Spins briefly on the response ring before announcing sleep and blocking on the doorbell
+static int shm_exchange(ShmChannel* channel, const PacketHeader* req_header, const uint8_t* payload,
+    uint8_t* resp, uint32_t resp_capacity) {
+    while (shm_ring_write(&channel->requests, req_header, payload) != 0) {
+    }
+    if (shm_ring_needs_doorbell(&channel->requests)) {
+        shm_doorbell_ring(channel->server_doorbell);
+    }
+
+    for (int spin = 0; spin < RTT_SHM_SPIN_ITERATIONS; spin++) {
+        uint32_t len = shm_ring_read(&channel->responses, resp, resp_capacity);
+        if (len == SHM_RING_CORRUPT) return -1;
+        if (len > 0) return 0;
+    }
+
+    while (1) {
+        if (shm_ring_prepare_sleep(&channel->responses)) {
+            shm_doorbell_drain(channel->client_doorbell);
+        }
+        shm_ring_clear_sleep(&channel->responses);
+
+        uint32_t len = shm_ring_read(&channel->responses, resp, resp_capacity);
+        if (len == SHM_RING_CORRUPT) return -1;
+        if (len > 0) return 0;
+    }
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void report_rtt(const char* label, double* samples, int count) {
+    if (count == 0) {
+        printf("[BENCHMARK] %-6s unavailable\n", label);
+        return;
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    qsort(samples, (size_t)count, sizeof(double), compare_double);
+
+    printf("[BENCHMARK] %-6s avg %.2f us, p50 %.2f us, p99 %.2f us (%d samples)\n", label,
+        sum / count, samples[count / 2], samples[(int)(count * 0.99)], count);
+}
+
+// Single outstanding ECHO per transport so the numbers are pure round-trip latency
+static void run_rtt_comparison(int port, const char* unix_path) {
     const char* message_data = "BENCHMARK_PAYLOAD";
     uint32_t data_len = (uint32_t)strlen(message_data);
-    size_t total_req_len = sizeof(PacketHeader) + data_len;
+    double* samples = (double*)malloc(sizeof(double) * RTT_SAMPLES);
+    if (samples == NULL) return;
 
-    // Coalesced buffer using Stack Memory
-    uint8_t out_buf[256];
     PacketHeader req_header;
-    memset(&req_header, 0, sizeof(PacketHeader));
+    memset(&req_header, 0, sizeof(req_header));
+    req_header.version = PROTOCOL_VERSION_1;
     req_header.type = CMD_ECHO;
     req_header.payload_length = data_len;
 
-    memcpy(out_buf + sizeof(PacketHeader), message_data, data_len);
+    uint8_t resp_payload[MAX_PAYLOAD_SIZE + sizeof(PacketHeader)];
+
+    char endpoints[2][128];
+    const char* labels[2] = { "tcp", "unix" };
+    snprintf(endpoints[0], sizeof(endpoints[0]), "%s:%d", SERVER_IP, port);
+    snprintf(endpoints[1], sizeof(endpoints[1]), "unix:%s", unix_path);
+
+    for (int t = 0; t < 2; t++) {
+        NetClient* client = net_client_create(endpoints[t], 1);
+        int count = 0;
+        for (int i = 0; client != NULL && i < RTT_SAMPLES; i++) {
+            PacketHeader resp_header;
+            uint32_t resp_len;
+            double start = get_time_seconds();
+            if (net_client_call(client, CMD_ECHO, (const uint8_t*)message_data, data_len, &resp_header,
+                resp_payload, sizeof(resp_payload), &resp_len) != 0) break;
+            samples[count++] = (get_time_seconds() - start) * 1e6;
+        }
+        report_rtt(labels[t], samples, count);
+        net_client_destroy(client);
+    }
+
+    // Shared memory is negotiated over a raw Unix connection rather than through the client library
+    ShmChannel channel;
+    int count = 0;
+    int unix_fd = connect_unix(unix_path);
+    if (unix_fd >= 0 && attach_shm(unix_fd, &channel) == 0) {
+        for (int i = 0; i < RTT_SAMPLES; i++) {
+            req_header.sequence_number = (uint32_t)i;
+            double start = get_time_seconds();
+            if (shm_exchange(&channel, &req_header, (const uint8_t*)message_data,
+                resp_payload, sizeof(resp_payload)) != 0) break;
+            samples[count++] = (get_time_seconds() - start) * 1e6;
+        }
+        shm_channel_destroy(&channel);
+    }
+    report_rtt("shm", samples, count);
+
+    if (unix_fd >= 0) close(unix_fd);
+    free(samples);
+}
+
+// Resident set of another process in kilobytes, or -1 if it cannot be read. smaps_rollup walks
+// the page tables, whereas VmRSS in status is a per-CPU approximation that lags behind
+static long read_resident_kb(int pid) {
+    char path[64];
+    char line[256];
+    long resident_kb = -1;
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+
+    FILE* status = fopen(path, "r");
+    if (status == NULL) return -1;
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "Rss:", 4) == 0) {
+            resident_kb = strtol(line + 4, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return resident_kb;
+}
+
+// Spreads connections over 127.0.0.x sources so the count is not capped by one ephemeral port range
+static int open_idle_connection(int port, int index) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (uint32_t)(index / IDLE_CONNECTIONS_PER_SOURCE));
 
-    uint8_t resp_header_buf[sizeof(PacketHeader)];
-    char resp_payload[64];
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, SERVER_IP, &server.sin_addr);
+
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    // Defer port choice to connect so ports still in TIME_WAIT toward other servers can be reused
+    int flag = 1;
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &flag, sizeof(flag));
+#endif
+    if (bind(fd, (struct sockaddr*)&source, sizeof(source)) != 0 ||
+        connect(fd, (struct sockaddr*)&server, sizeof(server)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Opens idle connections and reports how much the server's resident set grew per connection
+static void run_idle_scale_test(int port, int count, int server_pid) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    int* fds = (int*)malloc(sizeof(int) * (size_t)count);
+    long before_kb = read_resident_kb(server_pid);
+    if (fds == NULL || before_kb < 0) {
+        fprintf(stderr, "[BENCHMARK] Cannot read resident set of pid %d.\n", server_pid);
+        free(fds);
+        return;
+    }
+
+    int opened = 0;
+    while (opened < count) {
+        int fd = open_idle_connection(port, opened);
+        if (fd < 0) {
+            perror("[BENCHMARK] connect");
+            break;
+        }
+        fds[opened++] = fd;
+    }
+
+    // One header-only heartbeat per connection proves the server accepted it and leaves it idle again
+    uint8_t frame[sizeof(PacketHeader)];
+    PacketHeader header;
+    memset(&header, 0, sizeof(header));
+    header.version = PROTOCOL_VERSION_1;
+    header.type = PACKET_TYPE_HEARTBEAT;
+    serialize_header(&header, frame);
+
+    int live = 0;
+    for (int i = 0; i < opened; i++) {
+        send_full(fds[i], frame, sizeof(frame));
+    }
+    for (int i = 0; i < opened; i++) {
+        uint8_t reply[sizeof(PacketHeader)];
+        if (recv(fds[i], reply, sizeof(reply), MSG_WAITALL) == (ssize_t)sizeof(reply)) live++;
+    }
+
+    struct timespec settle = { 0, IDLE_SETTLE_NANOS };
+    nanosleep(&settle, NULL);
+    long after_kb = read_resident_kb(server_pid);
+
+    printf("[BENCHMARK] Idle connections: %d opened, %d answered\n", opened, live);
+    printf("[BENCHMARK] Server resident set: %ld KB -> %ld KB\n", before_kb, after_kb);
+    if (live > 0) {
+        printf("[BENCHMARK] Resident bytes per idle connection: %.1f\n", (double)(after_kb - before_kb) * 1024.0 / live);
+    }
+
+    // Abortive close keeps thousands of loopback tuples out of TIME_WAIT for the next run
+    struct linger abort_close = { 1, 0 };
+    for (int i = 0; i < opened; i++) {
+        setsockopt(fds[i], SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+        close(fds[i]);
+    }
+    free(fds);
+}
+
+// User plus system CPU time of another process in seconds, or -1 if it cannot be read
+static double read_cpu_seconds(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* stat = fopen(path, "r");
+    if (stat == NULL) return -1.0;
+
+    // Fields 14 and 15 follow the parenthesised command name, which may itself contain spaces
+    char line[1024];
+    double seconds = -1.0;
+    if (fgets(line, sizeof(line), stat) != NULL) {
+        char* rest = strrchr(line, ')');
+        unsigned long utime = 0;
+        unsigned long stime = 0;
+        if (rest != NULL && sscanf(rest + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2) {
+            seconds = (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+        }
+    }
+    fclose(stat);
+    return seconds;
+}
+
+static void* benchmark_worker(void* arg);
+
+// Echo throughput and server CPU per request across payload sizes, to locate the zerocopy crossover
+static void run_payload_sweep(const char* endpoint, int server_pid) {
+    static const uint32_t sizes[] = { 64, 128, 256, 512, 768, 1024 };
+    pthread_t threads[THREAD_COUNT];
+    BenchmarkConfig configs[THREAD_COUNT];
 
-    for (int i = 0; i < REQUESTS_PER_THREAD; i++) {
-        req_header.sequence_number = (uint32_t)i;
-        serialize_header(&req_header, out_buf);
+    printf("[BENCHMARK] %8s %14s %10s %14s\n", "payload", "requests/s", "MB/s", "server us/req");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t largest = MAX_PAYLOAD_SIZE - (checksum_frames ? PACKET_CRC32C_SIZE : 0);
+        sweep_payload_size = sizes[s] < largest ? sizes[s] : largest;
+        double cpu_before = server_pid > 0 ? read_cpu_seconds(server_pid) : -1.0;
+        double start_time = get_time_seconds();
 
-        if (send_full(sock_fd, out_buf, total_req_len) <= 0) break;
+        for (int i = 0; i < THREAD_COUNT; i++) {
+            memset(&configs[i], 0, sizeof(configs[i]));
+            configs[i].endpoint = endpoint;
+            configs[i].thread_id = i;
+            pthread_create(&threads[i], NULL, benchmark_worker, &configs[i]);
+        }
 
-        if (recv_full(sock_fd, resp_header_buf, sizeof(resp_header_buf)) <= 0) break;
+        uint32_t total = 0;
+        for (int i = 0; i < THREAD_COUNT; i++) {
+            pthread_join(threads[i], NULL);
+            total += configs[i].success_count;
+        }
 
+        double elapsed = get_time_seconds() - start_time;
+        double cpu_after = server_pid > 0 ? read_cpu_seconds(server_pid) : -1.0;
+        double rps = elapsed > 0.0 ? total / elapsed : 0.0;
+        double megabytes = rps * (double)(sweep_payload_size + sizeof(PacketHeader)) / 1e6;
+
+        if (cpu_before >= 0.0 && cpu_after >= 0.0 && total > 0) {
+            printf("[BENCHMARK] %8u %14.0f %10.1f %14.2f\n", sweep_payload_size, rps, megabytes,
+                (cpu_after - cpu_before) * 1e6 / total);
+        }
+        else {
+            printf("[BENCHMARK] %8u %14.0f %10.1f %14s\n", sweep_payload_size, rps, megabytes, "-");
+        }
+    }
+}
+
+typedef uint32_t (*crc_func_t)(uint32_t crc, const void* data, size_t length);
+
+static double time_crc(crc_func_t function, const uint8_t* buffer, size_t size) {
+    size_t rounds = CRC_BYTES_PER_SIZE / size;
+    volatile uint32_t sink = 0;
+
+    double start = get_time_seconds();
+    for (size_t i = 0; i < rounds; i++) {
+        sink ^= function(0, buffer, size);
+    }
+    double elapsed = get_time_seconds() - start;
+    (void)sink;
+    return elapsed / (double)(rounds * size) * 1e9;
+}
+
+// Checksum cost per byte, and the share of one core it takes to keep up with common line rates
+static void run_crc_microbenchmark(void) {
+    static const size_t sizes[] = { 64, 256, 1024, 4096, 65536, 1 << 20 };
+    static const double line_rates_gbps[] = { 10.0, 25.0, 100.0 };
+    uint8_t* buffer = (uint8_t*)malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    if (buffer == NULL) return;
+
+    uint64_t rng_state = 1;
+    for (size_t i = 0; i < sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]; i++) {
+        buffer[i] = (uint8_t)next_random(&rng_state);
+    }
+
+    printf("[BENCHMARK] CRC32C: %s\n", crc32c_accelerated() ? "SSE4.2, 3-way interleaved" : "slicing-by-8");
+    printf("[BENCHMARK] %8s %10s %10s %12s %9s %9s %9s\n", "size", "ns/byte", "GB/s", "sliced GB/s",
+        "10GbE", "25GbE", "100GbE");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double ns_per_byte = time_crc(crc32c, buffer, sizes[s]);
+        double sliced_ns_per_byte = time_crc(crc32c_portable, buffer, sizes[s]);
+
+        printf("[BENCHMARK] %8zu %10.4f %10.2f %12.2f", sizes[s], ns_per_byte, 1.0 / ns_per_byte,
+            1.0 / sliced_ns_per_byte);
+        for (size_t r = 0; r < sizeof(line_rates_gbps) / sizeof(line_rates_gbps[0]); r++) {
+            // Bytes per nanosecond at line rate times nanoseconds per byte is the core share
+            printf(" %8.1f%%", line_rates_gbps[r] / 8.0 * ns_per_byte * 100.0);
+        }
+        printf("\n");
+    }
+
+    free(buffer);
+}
+
+// Fills the corpus with one of three payload shapes: 0 log text, 1 binary telemetry, 2 random bytes
+static const char* fill_compress_corpus(int kind, uint32_t length) {
+    uint64_t rng_state = 0x243F6A8885A308D3ULL;
+    uint32_t used = 0;
+    compress_corpus_len = length;
+
+    if (kind == 0) {
+        while (used < length) {
+            char line[160];
+            uint64_t r = next_random(&rng_state);
+            int n = snprintf(line, sizeof(line),
+                "2026-10-18T09:14:%02u.%03uZ INFO request id=%u path=/api/v1/items/%u status=200 bytes=%u\n",
+                (unsigned)(r % 60), (unsigned)((r >> 8) % 1000), (unsigned)(r >> 32) % 100000,
+                (unsigned)((r >> 16) % 500), (unsigned)((r >> 24) % 65536));
+            uint32_t take = (uint32_t)n < length - used ? (uint32_t)n : length - used;
+            memcpy(compress_corpus + used, line, take);
+            used += take;
+        }
+        return "text";
+    }
+    if (kind == 1) {
+        // Fixed-layout samples: a handful of sensor ids, small readings and a steadily rising clock
+        uint64_t timestamp = 1792314840000000ULL;
+        while (used < length) {
+            uint8_t sample[16];
+            uint64_t r = next_random(&rng_state);
+            uint32_t sensor = (uint32_t)(r % 8);
+            uint16_t reading = (uint16_t)(2000 + (r >> 8) % 64);
+            uint16_t status = 0;
+            timestamp += 1000;
+            memcpy(sample, &sensor, sizeof(sensor));
+            memcpy(sample + 4, &reading, sizeof(reading));
+            memcpy(sample + 6, &status, sizeof(status));
+            memcpy(sample + 8, &timestamp, sizeof(timestamp));
+            uint32_t take = sizeof(sample) < length - used ? (uint32_t)sizeof(sample) : length - used;
+            memcpy(compress_corpus + used, sample, take);
+            used += take;
+        }
+        return "telemetry";
+    }
+    for (; used < length; used++) {
+        compress_corpus[used] = (uint8_t)next_random(&rng_state);
+    }
+    return "random";
+}
+
+// Client and server CPU per request and bytes on the wire per round trip, with and without compression
+static void run_compression_tradeoff(const char* endpoint, int server_pid) {
+    pthread_t threads[THREAD_COUNT];
+    BenchmarkConfig configs[THREAD_COUNT];
+    uint32_t length = COMPRESS_PAYLOAD_SIZE - (checksum_frames ? PACKET_CRC32C_SIZE : 0);
+    uint8_t* packed = (uint8_t*)malloc(LZ_MAX_INPUT);
+    if (packed == NULL) return;
+
+    printf("[BENCHMARK] %-10s %7s %16s %18s\n", "payload", "ratio", "compress MB/s", "decompress MB/s");
+    for (int kind = 0; kind < 3; kind++) {
+        const char* name = fill_compress_corpus(kind, length);
+        size_t rounds = COMPRESS_CODEC_BYTES / length;
+        uint32_t packed_len = 0;
+
+        double start = get_time_seconds();
+        for (size_t i = 0; i < rounds; i++) {
+            packed_len = lz_compress(compress_corpus, length, packed, LZ_MAX_INPUT);
+        }
+        double compress_seconds = get_time_seconds() - start;
+
+        uint8_t restored[COMPRESS_PAYLOAD_SIZE];
+        start = get_time_seconds();
+        for (size_t i = 0; i < rounds; i++) {
+            lz_decompress(packed, packed_len, restored, sizeof(restored));
+        }
+        double decompress_seconds = get_time_seconds() - start;
+
+        printf("[BENCHMARK] %-10s %7.2f %16.0f %18.0f\n", name, (double)length / packed_len,
+            (double)rounds * length / compress_seconds / 1e6, (double)rounds * length / decompress_seconds / 1e6);
+    }
+
+    printf("[BENCHMARK] %-10s %-5s %12s %12s %14s %14s\n", "payload", "lz", "requests/s", "wire B/req",
+        "client us/req", "server us/req");
+    for (int kind = 0; kind < 3; kind++) {
+        const char* name = fill_compress_corpus(kind, length);
+        for (int enabled = 0; enabled <= 1; enabled++) {
+            compress_threshold = enabled ? LZ_DEFAULT_THRESHOLD : 0;
+            struct rusage usage_before;
+            struct rusage usage_after;
+            getrusage(RUSAGE_SELF, &usage_before);
+            double server_before = server_pid > 0 ? read_cpu_seconds(server_pid) : -1.0;
+            double start_time = get_time_seconds();
+
+            for (int i = 0; i < THREAD_COUNT; i++) {
+                memset(&configs[i], 0, sizeof(configs[i]));
+                configs[i].endpoint = endpoint;
+                configs[i].thread_id = i;
+                pthread_create(&threads[i], NULL, benchmark_worker, &configs[i]);
+            }
+
+            uint32_t total = 0;
+            uint64_t wire_bytes = 0;
+            for (int i = 0; i < THREAD_COUNT; i++) {
+                pthread_join(threads[i], NULL);
+                total += configs[i].success_count;
+                wire_bytes += configs[i].wire_bytes;
+            }
+
+            double elapsed = get_time_seconds() - start_time;
+            double server_after = server_pid > 0 ? read_cpu_seconds(server_pid) : -1.0;
+            getrusage(RUSAGE_SELF, &usage_after);
+            double client_seconds =
+                (double)(usage_after.ru_utime.tv_sec - usage_before.ru_utime.tv_sec) +
+                (double)(usage_after.ru_utime.tv_usec - usage_before.ru_utime.tv_usec) / 1e6 +
+                (double)(usage_after.ru_stime.tv_sec - usage_before.ru_stime.tv_sec) +
+                (double)(usage_after.ru_stime.tv_usec - usage_before.ru_stime.tv_usec) / 1e6;
+
+            if (total == 0) {
+                printf("[BENCHMARK] %-10s %-5s failed\n", name, enabled ? "on" : "off");
+                continue;
+            }
+            printf("[BENCHMARK] %-10s %-5s %12.0f %12.1f %14.2f", name, enabled ? "on" : "off",
+                total / elapsed, (double)wire_bytes / total, client_seconds * 1e6 / total);
+            if (server_before >= 0.0 && server_after >= 0.0) {
+                printf(" %14.2f\n", (server_after - server_before) * 1e6 / total);
+            }
+            else {
+                printf(" %14s\n", "-");
+            }
+        }
+    }
+    compress_threshold = 0;
+    free(packed);
+}
+
+// Minor page faults a process has taken so far, or -1 if they cannot be read
+static long read_minor_faults(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* stat = fopen(path, "r");
+    if (stat == NULL) return -1;
+
+    char line[1024];
+    long faults = -1;
+    if (fgets(line, sizeof(line), stat) != NULL) {
+        char* rest = strrchr(line, ')');
+        unsigned long minflt = 0;
+        if (rest != NULL && sscanf(rest + 2, "%*c %*d %*d %*d %*d %*d %*u %lu", &minflt) == 1) {
+            faults = (long)minflt;
+        }
+    }
+    fclose(stat);
+    return faults;
+}
+
+typedef struct WarmupWorker WarmupWorker;
+
+typedef struct {
+    WarmupWorker* worker;
+    uint32_t index;
+} WarmupRequest;
+
+struct WarmupWorker {
+    const char* endpoint;
+    double* start;
+    double* latency_us;         // By issue order; negative for a failed request
+    WarmupRequest* requests;
+};
+
+static void warmup_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    (void)header;
+    (void)payload;
+    WarmupRequest* request = (WarmupRequest*)user_data;
+    WarmupWorker* worker = request->worker;
+    worker->latency_us[request->index] = (status == 0)
+        ? (get_time_seconds() - worker->start[request->index]) * 1e6 : -1.0;
+}
+
+static void* warmup_worker(void* arg) {
+    static uint8_t payload[WARMUP_PAYLOAD];
+    WarmupWorker* worker = (WarmupWorker*)arg;
+    uint32_t length = WARMUP_PAYLOAD - (checksum_frames ? PACKET_CRC32C_SIZE : 0);
+    NetClient* client = net_client_create(worker->endpoint, 1);
+    if (client == NULL) return NULL;
+
+    net_client_set_checksum(client, checksum_frames);
+    uint32_t issued = 0;
+    while (issued < WARMUP_REQUESTS) {
+        while (issued < WARMUP_REQUESTS && net_client_in_flight(client) < SWEEP_DEPTH) {
+            WarmupRequest* request = &worker->requests[issued];
+            request->worker = worker;
+            request->index = issued;
+            worker->start[issued] = get_time_seconds();
+            if (net_client_submit(client, CMD_ECHO, payload, length, warmup_done, request) != 0) break;
+            issued++;
+        }
+        if (net_client_in_flight(client) == 0) break;
+        if (net_client_poll(client, -1) < 0) break;
+    }
+
+    net_client_wait_all(client);
+    net_client_destroy(client);
+    return NULL;
+}
+
+// Latency by position in each connection's request stream, so a fresh server's first requests
+// can be compared against the same connections once everything they touch is warm
+static void run_warmup_latency(const char* endpoint, int server_pid) {
+    static const uint32_t phase_ends[] = { 100, 1000, 5000, WARMUP_REQUESTS };
+    pthread_t threads[THREAD_COUNT];
+    WarmupWorker workers[THREAD_COUNT];
+    double* samples = (double*)malloc(sizeof(double) * WARMUP_REQUESTS * THREAD_COUNT);
+    if (samples == NULL) return;
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        workers[i].endpoint = endpoint;
+        workers[i].start = (double*)malloc(sizeof(double) * WARMUP_REQUESTS);
+        workers[i].latency_us = (double*)malloc(sizeof(double) * WARMUP_REQUESTS);
+        workers[i].requests = (WarmupRequest*)malloc(sizeof(WarmupRequest) * WARMUP_REQUESTS);
+        if (workers[i].start == NULL || workers[i].latency_us == NULL || workers[i].requests == NULL) return;
+        for (uint32_t r = 0; r < WARMUP_REQUESTS; r++) workers[i].latency_us[r] = -1.0;
+    }
+
+    long faults_before = server_pid > 0 ? read_minor_faults(server_pid) : -1;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&threads[i], NULL, warmup_worker, &workers[i]);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    long faults_after = server_pid > 0 ? read_minor_faults(server_pid) : -1;
+
+    printf("[BENCHMARK] %13s %10s %10s %10s %10s\n", "requests", "p50 us", "p99 us", "max us", "failed");
+    uint32_t phase_start = 0;
+    for (size_t p = 0; p < sizeof(phase_ends) / sizeof(phase_ends[0]); p++) {
+        int count = 0;
+        int failed = 0;
+        for (int i = 0; i < THREAD_COUNT; i++) {
+            for (uint32_t r = phase_start; r < phase_ends[p]; r++) {
+                if (workers[i].latency_us[r] < 0.0) failed++;
+                else samples[count++] = workers[i].latency_us[r];
+            }
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "%u-%u", phase_start + 1, phase_ends[p]);
+        if (count > 0) {
+            qsort(samples, (size_t)count, sizeof(double), compare_double);
+            printf("[BENCHMARK] %13s %10.1f %10.1f %10.1f %10d\n", label, samples[count / 2],
+                samples[(int)(count * 0.99)], samples[count - 1], failed);
+        }
+        else {
+            printf("[BENCHMARK] %13s %10s %10s %10s %10d\n", label, "-", "-", "-", failed);
+        }
+        phase_start = phase_ends[p];
+    }
+
+    if (faults_before >= 0 && faults_after >= 0) {
+        printf("[BENCHMARK] Server minor page faults during the run: %ld\n", faults_after - faults_before);
+    }
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        free(workers[i].start);
+        free(workers[i].latency_us);
+        free(workers[i].requests);
+    }
+    free(samples);
+}
+
+static atomic_int bulk_workers_running;
+
+static void* priority_bulk_worker(void* arg) {
+    BenchmarkConfig* config = (BenchmarkConfig*)arg;
+    NetClient* client = net_client_create(config->endpoint, pool_size);
+    if (client != NULL) {
+        net_client_set_checksum(client, checksum_frames);
+        run_workload(client, config);
+        net_client_destroy(client);
+    }
+    atomic_fetch_sub(&bulk_workers_running, 1);
+    return NULL;
+}
+
+// Measures probe round trips on one connection while bulk_threads others flood the server with DATA
+static void run_latency_under_load(const char* endpoint, int bulk_threads, uint16_t probe_type, const char* label) {
+    pthread_t threads[THREAD_COUNT - 1];
+    BenchmarkConfig configs[THREAD_COUNT - 1];
+    double* samples = (double*)malloc(sizeof(double) * RTT_SAMPLES);
+    NetClient* client = net_client_create(endpoint, 1);
+    if (samples == NULL || client == NULL) return;
+
+    atomic_store(&bulk_workers_running, bulk_threads);
+    double start_time = get_time_seconds();
+    for (int i = 0; i < bulk_threads; i++) {
+        memset(&configs[i], 0, sizeof(configs[i]));
+        configs[i].endpoint = endpoint;
+        configs[i].thread_id = i;
+        pthread_create(&threads[i], NULL, priority_bulk_worker, &configs[i]);
+    }
+
+    int count = 0;
+    uint64_t nonce = 0;
+    while (atomic_load(&bulk_workers_running) > 0 && count < RTT_SAMPLES) {
         PacketHeader resp_header;
-        deserialize_header(resp_header_buf, &resp_header);
+        uint8_t resp_payload[sizeof(nonce)];
+        uint32_t resp_len;
+        nonce++;
 
-        if (resp_header.payload_length > sizeof(resp_payload)) break;
-        if (recv_full(sock_fd, resp_payload, resp_header.payload_length) <= 0) break;
+        double start = get_time_seconds();
+        if (net_client_call(client, probe_type, (const uint8_t*)&nonce, sizeof(nonce), &resp_header,
+            resp_payload, sizeof(resp_payload), &resp_len) != 0) break;
+        samples[count++] = (get_time_seconds() - start) * 1e6;
+    }
 
-        config->success_count++;
+    uint32_t bulk_total = 0;
+    for (int i = 0; i < bulk_threads; i++) {
+        pthread_join(threads[i], NULL);
+        bulk_total += configs[i].success_count;
     }
+    double elapsed = get_time_seconds() - start_time;
+
+    printf("[BENCHMARK] Bulk: %u x %d-byte DATA frames, %.2f requests/second\n",
+        bulk_total, PRIORITY_BULK_PAYLOAD, elapsed > 0.0 ? bulk_total / elapsed : 0.0);
+    report_rtt(label, samples, count);
+
+    net_client_destroy(client);
+    free(samples);
+}
+
+static void* benchmark_worker(void* arg) {
+    BenchmarkConfig* config = (BenchmarkConfig*)arg;
+    NetClient* client = net_client_create(config->endpoint, pool_size);
+    if (client == NULL) pthread_exit(NULL);
 
-    close(sock_fd);
+    net_client_set_checksum(client, checksum_frames);
+    net_client_set_compression(client, compress_threshold);
+    run_workload(client, config);
+
+    uint64_t sent;
+    uint64_t received;
+    net_client_wire_bytes(client, &sent, &received);
+    config->wire_bytes = sent + received;
+
+    net_client_destroy(client);
     pthread_exit(NULL);
 }
 
 int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "d:c:k")) != -1) {
+        switch (opt) {
+        case 'd':
+            pipeline_depth = atoi(optarg) > 0 ? (uint32_t)atoi(optarg) : DEFAULT_PIPELINE_DEPTH;
+            break;
+        case 'c':
+            pool_size = atoi(optarg) > 0 ? (uint32_t)atoi(optarg) : DEFAULT_POOL_SIZE;
+            break;
+        case 'k':
+            checksum_frames = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d pipeline_depth] [-c connections] [-k] [port] [echo|kv|rtt|prio|neighbor|idle|sweep|compress|warmup|crc] [args...]\n", argv[0]);
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     int port = 8080;
     if (argc > 1) {
         port = atoi(argv[1]);
     }
+    if (argc > 2 && strcmp(argv[2], "kv") == 0) {
+        workload = WORKLOAD_KV;
+    }
+    if (argc > 2 && strcmp(argv[2], "idle") == 0) {
+        if (argc < 5) {
+            fprintf(stderr, "Usage: %s [port] idle <connections> <server_pid>\n", argv[0]);
+            return 1;
+        }
+        int count = atoi(argv[3]) > 0 ? atoi(argv[3]) : IDLE_DEFAULT_CONNECTIONS;
+        printf("[BENCHMARK] Idle connection scale test on port %d\n", port);
+        run_idle_scale_test(port, count, atoi(argv[4]));
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "crc") == 0) {
+        run_crc_microbenchmark();
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "rtt") == 0) {
+        printf("[BENCHMARK] Same-host round trip comparison on port %d\n", port);
+        run_rtt_comparison(port, argc > 3 ? argv[3] : RTT_DEFAULT_UNIX_PATH);
+        return 0;
+    }
+    if (argc > 3) {
+        kv_read_percent = atoi(argv[3]);
+    }
+    if (argc > 4 && atoi(argv[4]) > 0) {
+        kv_key_count = (uint32_t)atoi(argv[4]);
+    }
+
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "%s:%d", SERVER_IP, port);
+
+    if (argc > 2 && strcmp(argv[2], "sweep") == 0) {
+        workload = WORKLOAD_SWEEP;
+        printf("[BENCHMARK] Echo payload sweep on %s (%d threads, depth %d)\n", endpoint, THREAD_COUNT, SWEEP_DEPTH);
+        run_payload_sweep(endpoint, argc > 3 ? atoi(argv[3]) : 0);
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "compress") == 0) {
+        workload = WORKLOAD_COMPRESS;
+        printf("[BENCHMARK] Compression trade-off on %s (%d threads, depth %d, %d-byte payloads)\n",
+            endpoint, THREAD_COUNT, SWEEP_DEPTH, COMPRESS_PAYLOAD_SIZE);
+        run_compression_tradeoff(endpoint, argc > 3 ? atoi(argv[3]) : 0);
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "warmup") == 0) {
+        printf("[BENCHMARK] Latency from a fresh start on %s (%d threads, depth %d, %d-byte echoes)\n",
+            endpoint, THREAD_COUNT, SWEEP_DEPTH, WARMUP_PAYLOAD);
+        run_warmup_latency(endpoint, argc > 3 ? atoi(argv[3]) : 0);
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "prio") == 0) {
+        workload = WORKLOAD_PRIORITY;
+        printf("[BENCHMARK] Heartbeat latency under bulk load on %s (%d bulk threads, depth %d)\n",
+            endpoint, THREAD_COUNT - 1, PRIORITY_BULK_DEPTH);
+        run_latency_under_load(endpoint, THREAD_COUNT - 1, PACKET_TYPE_HEARTBEAT, "hbeat");
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[2], "neighbor") == 0) {
+        workload = WORKLOAD_PRIORITY;
+        bulk_depth = NEIGHBOR_BULK_DEPTH;
+        requests_per_thread = NEIGHBOR_BULK_REQUESTS;
+        printf("[BENCHMARK] Light client latency next to one heavy connection on %s (depth %d)\n",
+            endpoint, NEIGHBOR_BULK_DEPTH);
+        // Heartbeats ride the control lane, so what remains is time spent waiting on the reactor
+        run_latency_under_load(endpoint, 1, PACKET_TYPE_HEARTBEAT, "light");
+        return 0;
+    }
 
-    printf("[BENCHMARK] Starting load test on %s:%d\n", SERVER_IP, port);
+    printf("[BENCHMARK] Starting load test on %s\n", endpoint);
     printf("[BENCHMARK] Threads: %d, Requests per thread: %d\n", THREAD_COUNT, REQUESTS_PER_THREAD);
+    printf("[BENCHMARK] Connections per thread: %u, Pipeline depth: %u%s\n", pool_size, pipeline_depth,
+        checksum_frames ? ", CRC32C frames" : "");
+
+    if (workload == WORKLOAD_KV) {
+        if (build_zipf_table(kv_key_count, KV_ZIPF_THETA) != 0) {
+            fprintf(stderr, "[BENCHMARK] Failed to allocate Zipfian table.\n");
+            return 1;
+        }
+        printf("[BENCHMARK] Workload: KV (Zipfian theta %.2f, %u keys, %d%% reads)\n",
+            KV_ZIPF_THETA, kv_key_count, kv_read_percent);
+    }
 
     pthread_t threads[THREAD_COUNT];
     BenchmarkConfig configs[THREAD_COUNT];
@@ -122,16 +1047,22 @@ int main(int argc, char* argv[]) {
     double start_time = get_time_seconds();
 
     for (int i = 0; i < THREAD_COUNT; i++) {
-        configs[i].port = port;
+        configs[i].endpoint = endpoint;
         configs[i].thread_id = i;
         configs[i].success_count = 0;
+        configs[i].kv_hits = 0;
+        configs[i].kv_misses = 0;
         pthread_create(&threads[i], NULL, benchmark_worker, &configs[i]);
     }
 
     uint32_t total_success = 0;
+    uint32_t total_hits = 0;
+    uint32_t total_misses = 0;
     for (int i = 0; i < THREAD_COUNT; i++) {
         pthread_join(threads[i], NULL);
         total_success += configs[i].success_count;
+        total_hits += configs[i].kv_hits;
+        total_misses += configs[i].kv_misses;
     }
 
     double end_time = get_time_seconds();
@@ -142,5 +1073,12 @@ int main(int argc, char* argv[]) {
     printf("[BENCHMARK] Total successful requests: %u\n", total_success);
     printf("[BENCHMARK] Throughput: %.2f requests/second\n", rps);
 
+    if (workload == WORKLOAD_KV) {
+        uint32_t reads = total_hits + total_misses;
+        printf("[BENCHMARK] KV reads: %u (hit ratio %.2f%%)\n", reads,
+            reads > 0 ? 100.0 * total_hits / reads : 0.0);
+        free(zipf_cdf);
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -2,98 +2,477 @@
  * @file client_test.c
  * @brief Integration test client to validate bidirectional binary protocol communication.
  */
-#include "protocol/protocol.h"
+#include "client/net_client.h"
+#include "protocol/crc32c.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
-#include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
 
 #define SERVER_IP "127.0.0.1"
 #define CMD_ECHO 0x02
+#define PIPELINE_POOL_SIZE 2
+#define PIPELINE_DEPTH 64
+#define HANDOFF_TIMEOUT_MS 5000
 
-int main(int argc, char* argv[]) {
-    int sock_fd;
-    struct sockaddr_in server_addr;
-    const char* port_str = "8080";
+typedef struct {
+    char expected[32];
+    int matched;
+} PipelinedEcho;
 
-    if (argc > 1) {
-        port_str = argv[1];
+static void pipelined_echo_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    PipelinedEcho* echo = (PipelinedEcho*)user_data;
+    size_t len = strlen(echo->expected);
+
+    echo->matched = status == 0 && header->payload_length == len &&
+        memcmp(payload, echo->expected, len) == 0;
+}
+
+// Many requests in flight across the pool; every response must reach the callback of its own request
+static int run_pipeline_check(NetClient* client) {
+    PipelinedEcho echoes[PIPELINE_DEPTH];
+
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        snprintf(echoes[i].expected, sizeof(echoes[i].expected), "pipelined-%d", i);
+        echoes[i].matched = 0;
+        if (net_client_submit(client, CMD_ECHO, (const uint8_t*)echoes[i].expected,
+            (uint32_t)strlen(echoes[i].expected), pipelined_echo_done, &echoes[i]) != 0) {
+            fprintf(stderr, "[TEST] Failed to queue pipelined request %d.\n", i);
+            return -1;
+        }
     }
-    int server_port = atoi(port_str);
 
-    sock_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock_fd < 0) {
-        perror("[TEST] Socket creation failed");
-        return 1;
+    if (net_client_wait_all(client) != 0) {
+        fprintf(stderr, "[TEST] Pipelined requests did not complete.\n");
+        return -1;
     }
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(server_port);
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
-        perror("[TEST] Invalid address/ Address not supported");
-        return 1;
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        if (!echoes[i].matched) {
+            printf("[TEST] Failure! Pipelined response %d mismatched.\n", i);
+            return -1;
+        }
     }
 
-    if (connect(sock_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("[TEST] Connection failed");
-        return 1;
+    printf("[TEST] Success! %d pipelined requests matched by sequence number.\n", PIPELINE_DEPTH);
+    return 0;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static pid_t start_server(const char* server_path, const char* restart_path, const char* port) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execl(server_path, server_path, "-r", restart_path, "-m", port, (char*)NULL);
+        _exit(127);
     }
-    printf("[TEST] Connected to server on port %d.\n", server_port);
+    return pid;
+}
 
-    const char* message_data = "Integration Check: Bidirectional Flow";
-    uint32_t data_len = (uint32_t)strlen(message_data);
+static int wait_for_exit(pid_t pid, long timeout_ms) {
+    for (long waited = 0; waited < timeout_ms; waited += 10) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            return 0;
+        }
+        sleep_ms(10);
+    }
+    return -1;
+}
 
-    PacketHeader req_header;
-    memset(&req_header, 0, sizeof(PacketHeader));
-    req_header.type = CMD_ECHO;
-    req_header.sequence_number = 1;
-    req_header.payload_length = data_len;
+static void stop_server(pid_t pid) {
+    kill(pid, SIGINT);
+    if (wait_for_exit(pid, HANDOFF_TIMEOUT_MS) != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+}
 
-    uint8_t buffer[sizeof(PacketHeader)];
-    serialize_header(&req_header, buffer);
+// Retries while the freshly started server is still binding its port
+static int connect_raw(const char* port) {
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(SERVER_IP, port, &hints, &result) != 0) {
+        return -1;
+    }
 
-    if (send(sock_fd, buffer, sizeof(buffer), 0) != sizeof(buffer)) {
-        perror("[TEST] Failed to send header");
-        close(sock_fd);
-        return 1;
+    int fd = -1;
+    for (long waited = 0; fd == -1 && waited < HANDOFF_TIMEOUT_MS; waited += 50) {
+        fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if (fd != -1 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+            sleep_ms(50);
+        }
     }
+    freeaddrinfo(result);
 
-    if (send(sock_fd, message_data, data_len, 0) != (ssize_t)data_len) {
-        perror("[TEST] Failed to send payload");
-        close(sock_fd);
-        return 1;
+    if (fd != -1) {
+        struct timeval timeout = { HANDOFF_TIMEOUT_MS / 1000, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
     }
-    printf("[TEST] Request sent (Type: %d, Len: %d). Waiting for response...\n", CMD_ECHO, data_len);
+    return fd;
+}
+
+static int send_all(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) return -1;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t received = recv(fd, data, len, 0);
+        if (received <= 0) return -1;
+        data += received;
+        len -= (size_t)received;
+    }
+    return 0;
+}
+
+static size_t build_echo_frame(uint8_t* frame, uint32_t sequence, const char* text) {
+    PacketHeader header;
+    header.version = PROTOCOL_VERSION_1;
+    header.type = CMD_ECHO;
+    header.sequence_number = sequence;
+    header.payload_length = (uint32_t)strlen(text);
+    serialize_header(&header, frame);
+    memcpy(frame + sizeof(PacketHeader), text, header.payload_length);
+    return sizeof(PacketHeader) + header.payload_length;
+}
+
+static int expect_echo(int fd, uint32_t sequence, const char* text) {
+    uint8_t buffer[sizeof(PacketHeader) + MAX_PAYLOAD_SIZE];
+    PacketHeader header;
+    if (recv_all(fd, buffer, sizeof(PacketHeader)) != 0) {
+        return -1;
+    }
+    deserialize_header(buffer, &header);
+    if (header.type != CMD_ECHO || header.sequence_number != sequence || header.payload_length != strlen(text) ||
+        recv_all(fd, buffer, header.payload_length) != 0) {
+        return -1;
+    }
+    return memcmp(buffer, text, header.payload_length) == 0 ? 0 : -1;
+}
+
+static int echo_raw(int fd, uint32_t sequence, const char* text) {
+    uint8_t frame[sizeof(PacketHeader) + MAX_PAYLOAD_SIZE];
+    size_t len = build_echo_frame(frame, sequence, text);
+    return (send_all(fd, frame, len) == 0) ? expect_echo(fd, sequence, text) : -1;
+}
+
+// Returns the KV status byte and copies any value after it, or -1 if the call failed
+static int kv_call(NetClient* client, uint16_t type, const char* key, const char* value,
+    char* out, uint32_t out_capacity, uint32_t* out_len) {
+    uint8_t request[MAX_PAYLOAD_SIZE];
+    uint8_t response[MAX_PAYLOAD_SIZE + KV_STATUS_SIZE];
+    uint32_t key_len = (uint32_t)strlen(key);
+    uint32_t request_len = 0;
+
+    if (type == PACKET_TYPE_KV_SET) {
+        uint32_t value_len = (uint32_t)strlen(value);
+        request[0] = (uint8_t)(key_len >> 8);
+        request[1] = (uint8_t)key_len;
+        memcpy(request + KV_KEY_LENGTH_SIZE, key, key_len);
+        memcpy(request + KV_KEY_LENGTH_SIZE + key_len, value, value_len);
+        request_len = KV_KEY_LENGTH_SIZE + key_len + value_len;
+    }
+    else {
+        memcpy(request, key, key_len);
+        request_len = key_len;
+    }
+
+    PacketHeader header;
+    uint32_t response_len = 0;
+    if (net_client_call(client, type, request, request_len, &header, response, sizeof(response), &response_len) != 0 ||
+        response_len < KV_STATUS_SIZE) {
+        return -1;
+    }
+
+    if (out != NULL) {
+        *out_len = response_len - KV_STATUS_SIZE < out_capacity ? response_len - KV_STATUS_SIZE : out_capacity;
+        memcpy(out, response + KV_STATUS_SIZE, *out_len);
+    }
+    return response[0];
+}
+
+static int expect_kv_value(NetClient* client, const char* key, const char* expected) {
+    char value[MAX_PAYLOAD_SIZE];
+    uint32_t value_len = 0;
+    return kv_call(client, PACKET_TYPE_KV_GET, key, NULL, value, sizeof(value), &value_len) == KV_STATUS_OK &&
+        value_len == strlen(expected) && memcmp(value, expected, value_len) == 0 ? 0 : -1;
+}
+
+// SET, GET, overwrite into another size class, then DEL and a miss
+static int run_kv_check(NetClient* client) {
+    char large[600];
+    memset(large, 'L', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    if (kv_call(client, PACKET_TYPE_KV_SET, "client-test:key", "small value", NULL, 0, NULL) != KV_STATUS_OK ||
+        expect_kv_value(client, "client-test:key", "small value") != 0) {
+        printf("[TEST] Failure! KV SET then GET did not return the value.\n");
+        return -1;
+    }
+    if (kv_call(client, PACKET_TYPE_KV_SET, "client-test:key", large, NULL, 0, NULL) != KV_STATUS_OK ||
+        expect_kv_value(client, "client-test:key", large) != 0 ||
+        kv_call(client, PACKET_TYPE_KV_SET, "client-test:key", "tiny", NULL, 0, NULL) != KV_STATUS_OK ||
+        expect_kv_value(client, "client-test:key", "tiny") != 0) {
+        printf("[TEST] Failure! KV overwrite across size classes lost the new value.\n");
+        return -1;
+    }
+    if (kv_call(client, PACKET_TYPE_KV_DEL, "client-test:key", NULL, NULL, 0, NULL) != KV_STATUS_OK ||
+        kv_call(client, PACKET_TYPE_KV_GET, "client-test:key", NULL, NULL, 0, NULL) != KV_STATUS_NOT_FOUND) {
+        printf("[TEST] Failure! KV DEL did not turn the key into a miss.\n");
+        return -1;
+    }
+
+    printf("[TEST] Success! KV SET, GET, size-class overwrite and DEL behaved.\n");
+    return 0;
+}
+
+// Compressible payloads must round-trip intact and take fewer bytes on the wire than they hold
+static int run_compression_check(const char* endpoint) {
+    char payload[800];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = "compressible "[i % 13];
+    }
+
+    NetClient* client = net_client_create(endpoint, 1);
+    if (client == NULL) {
+        return -1;
+    }
+    net_client_set_compression(client, 128);
+
+    // The first call also carries the feature negotiation, so only the second is measured
+    PacketHeader header;
+    uint8_t response[MAX_PAYLOAD_SIZE];
+    uint32_t response_len = 0;
+    uint64_t sent_before = 0;
+    uint64_t received_before = 0;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    int rc = net_client_call(client, CMD_ECHO, (const uint8_t*)payload, sizeof(payload), &header,
+        response, sizeof(response), &response_len);
+    net_client_wire_bytes(client, &sent_before, &received_before);
+    if (rc == 0) {
+        rc = net_client_call(client, CMD_ECHO, (const uint8_t*)payload, sizeof(payload), &header,
+            response, sizeof(response), &response_len);
+    }
+    net_client_wire_bytes(client, &sent, &received);
+    sent -= sent_before;
+    received -= received_before;
+    net_client_destroy(client);
+
+    if (rc != 0 || response_len != sizeof(payload) || memcmp(response, payload, sizeof(payload)) != 0) {
+        printf("[TEST] Failure! Compressed echo did not round-trip.\n");
+        return -1;
+    }
+    if (sent >= sizeof(payload) || received >= sizeof(payload)) {
+        printf("[TEST] Failure! Echo was not compressed (%llu bytes sent, %llu received).\n",
+            (unsigned long long)sent, (unsigned long long)received);
+        return -1;
+    }
+
+    printf("[TEST] Success! Compressed echo round-tripped in %llu bytes each way or less.\n",
+        (unsigned long long)(sent > received ? sent : received));
+    return 0;
+}
+
+// A checksummed echo comes back intact; a frame whose trailer does not match is answered with ERROR
+static int run_checksum_check(NetClient* client, const char* port) {
+    const char* text = "checksummed echo";
+    PacketHeader header;
+    uint8_t response[MAX_PAYLOAD_SIZE];
+    uint32_t response_len = 0;
+
+    net_client_set_checksum(client, 1);
+    int rc = net_client_call(client, CMD_ECHO, (const uint8_t*)text, (uint32_t)strlen(text), &header,
+        response, sizeof(response), &response_len);
+    net_client_set_checksum(client, 0);
+    if (rc != 0 || response_len != strlen(text) || memcmp(response, text, response_len) != 0) {
+        printf("[TEST] Failure! Checksummed echo did not round-trip.\n");
+        return -1;
+    }
+
+    int fd = connect_raw(port);
+    if (fd == -1) {
+        return -1;
+    }
+
+    uint8_t frame[sizeof(PacketHeader) + 64];
+    uint32_t text_len = (uint32_t)strlen(text);
+    header.version = PROTOCOL_VERSION_2;
+    header.type = CMD_ECHO | PACKET_FLAG_CRC32C;
+    header.sequence_number = 77;
+    header.payload_length = text_len + PACKET_CRC32C_SIZE;
+    serialize_header(&header, frame);
+    memcpy(frame + sizeof(PacketHeader), text, text_len);
+    uint32_t wrong_crc = htonl(crc32c(0, text, text_len) ^ 1u);
+    memcpy(frame + sizeof(PacketHeader) + text_len, &wrong_crc, sizeof(wrong_crc));
+
+    uint8_t reply[sizeof(PacketHeader)];
+    rc = -1;
+    if (send_all(fd, frame, sizeof(PacketHeader) + header.payload_length) == 0 &&
+        recv_all(fd, reply, sizeof(reply)) == 0) {
+        deserialize_header(reply, &header);
+        rc = ((header.type & PACKET_TYPE_MASK) == PACKET_TYPE_ERROR && header.sequence_number == 77) ? 0 : -1;
+    }
+    close(fd);
+
+    if (rc != 0) {
+        printf("[TEST] Failure! CRC32C mismatch was not answered with ERROR.\n");
+        return -1;
+    }
+    printf("[TEST] Success! Checksummed echo verified and CRC32C mismatch rejected.\n");
+    return 0;
+}
+
+/*
+ * Starts a server of its own on port + 1, then a successor that takes it over with -m.
+ * One connection is left halfway through a frame's payload and another idle; both must
+ * carry on against the successor as if nothing had happened.
+ */
+static int run_handoff_check(const char* server_path, const char* base_port) {
+    char port[16];
+    char restart_path[64];
+    snprintf(port, sizeof(port), "%d", atoi(base_port) + 1);
+    snprintf(restart_path, sizeof(restart_path), "/tmp/client_test_restart_%s.sock", port);
+
+    pid_t predecessor = start_server(server_path, restart_path, port);
+    if (predecessor == -1) {
+        fprintf(stderr, "[TEST] Failed to start %s.\n", server_path);
+        return -1;
+    }
+
+    int result = -1;
+    pid_t successor = -1;
+    int idle_fd = connect_raw(port);
+    int split_fd = connect_raw(port);
+    const char* split_text = "payload split across a hot restart";
+    uint8_t split_frame[sizeof(PacketHeader) + MAX_PAYLOAD_SIZE];
+    size_t split_len = build_echo_frame(split_frame, 2, split_text);
+    size_t first_part = sizeof(PacketHeader) + 8;
+
+    // A round trip each proves the predecessor has registered both connections
+    if (idle_fd == -1 || split_fd == -1 || echo_raw(idle_fd, 1, "idle before") != 0 ||
+        echo_raw(split_fd, 1, "split before") != 0 || send_all(split_fd, split_frame, first_part) != 0) {
+        fprintf(stderr, "[TEST] Handoff setup against %s failed.\n", server_path);
+        goto cleanup;
+    }
+    sleep_ms(200);
+
+    successor = start_server(server_path, restart_path, port);
+    if (successor == -1 || wait_for_exit(predecessor, HANDOFF_TIMEOUT_MS) != 0) {
+        fprintf(stderr, "[TEST] Predecessor did not exit after the handoff.\n");
+        goto cleanup;
+    }
+    predecessor = -1;
+
+    if (send_all(split_fd, split_frame + first_part, split_len - first_part) != 0 ||
+        expect_echo(split_fd, 2, split_text) != 0) {
+        printf("[TEST] Failure! Connection caught mid-frame did not survive the handoff.\n");
+        goto cleanup;
+    }
+    if (echo_raw(idle_fd, 2, "idle after") != 0) {
+        printf("[TEST] Failure! Idle connection did not survive the handoff.\n");
+        goto cleanup;
+    }
+
+    printf("[TEST] Success! Mid-frame and idle connections kept working across a hot restart.\n");
+    result = 0;
+
+cleanup:
+    if (idle_fd != -1) close(idle_fd);
+    if (split_fd != -1) close(split_fd);
+    if (predecessor != -1) stop_server(predecessor);
+    if (successor != -1) stop_server(successor);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    const char* port_str = "8080";
+
+    if (argc > 1) {
+        port_str = argv[1];
+    }
+
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "%s:%s", SERVER_IP, port_str);
 
-    uint8_t resp_header_buf[sizeof(PacketHeader)];
-    if (recv(sock_fd, resp_header_buf, sizeof(resp_header_buf), 0) <= 0) {
-        fprintf(stderr, "[TEST] Failed to receive response header.\n");
-        close(sock_fd);
+    NetClient* client = net_client_create(endpoint, PIPELINE_POOL_SIZE);
+    if (client == NULL) {
+        fprintf(stderr, "[TEST] Invalid endpoint %s.\n", endpoint);
         return 1;
     }
+    printf("[TEST] Client pool created for %s.\n", endpoint);
+
+    const char* message_data = "Integration Check: Bidirectional Flow";
+    uint32_t data_len = (uint32_t)strlen(message_data);
+
+    printf("[TEST] Request sent (Type: %d, Len: %d). Waiting for response...\n", CMD_ECHO, data_len);
 
     PacketHeader resp_header;
-    deserialize_header(resp_header_buf, &resp_header);
+    char resp_payload[MAX_PAYLOAD_SIZE + 1];
+    uint32_t resp_len = 0;
 
-    char* resp_payload = (char*)malloc(resp_header.payload_length + 1);
-    if (recv(sock_fd, resp_payload, resp_header.payload_length, 0) != (ssize_t)resp_header.payload_length) {
-        fprintf(stderr, "[TEST] Incomplete payload received.\n");
-        free(resp_payload);
-        close(sock_fd);
+    if (net_client_call(client, CMD_ECHO, (const uint8_t*)message_data, data_len, &resp_header,
+        (uint8_t*)resp_payload, MAX_PAYLOAD_SIZE, &resp_len) != 0) {
+        fprintf(stderr, "[TEST] Connection failed before a response arrived.\n");
+        net_client_destroy(client);
         return 1;
     }
-    resp_payload[resp_header.payload_length] = '\0';
+    resp_payload[resp_len] = '\0';
 
+    int failed = 0;
     if (strcmp(resp_payload, message_data) == 0) {
         printf("[TEST] Success! Server echoed: '%s'\n", resp_payload);
     }
     else {
         printf("[TEST] Failure! Payload mismatch.\n");
+        failed = 1;
     }
 
-    free(resp_payload);
-    close(sock_fd);
-    return 0;
-}
\ No newline at end of file
+    if (run_pipeline_check(client) != 0) {
+        failed = 1;
+    }
+    if (run_kv_check(client) != 0) {
+        failed = 1;
+    }
+    if (run_checksum_check(client, port_str) != 0) {
+        failed = 1;
+    }
+    if (run_compression_check(endpoint) != 0) {
+        failed = 1;
+    }
+
+    // The handoff check runs servers of its own, so it needs to know where the binary is
+    if (argc > 2 && run_handoff_check(argv[2], port_str) != 0) {
+        failed = 1;
+    }
+
+    net_client_destroy(client);
+    return failed;
+}
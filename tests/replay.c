@@ -0,0 +1,529 @@
+/**
+ * @file replay.c
+ * @brief Replays a server capture file against a live server and reports latency histograms.
+ *
+ * Captured connections are spread over worker threads, each driving one connection of its
+ * own, so frames of one original connection keep their order. Frames are sent at their
+ * original offsets, at a multiple of the original speed, or as fast as the pipeline allows.
+ * Paced latencies are measured from the scheduled send time, so a server that falls behind
+ * is charged for the queueing it causes rather than hidden by a replayer that waits for it.
+ */
+#include "client/net_client.h"
+#include "protocol/protocol.h"
+#include "protocol/lz.h"
+#include "server/capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REPLAY_MAX_WORKERS 64
+#define REPLAY_DEFAULT_MAX_DEPTH 64
+#define REPLAY_IDLE_SLEEP_NANOS 20000L
+#define REPLAY_STALL_TIMEOUT_MS 2000
+
+// Log-linear histogram: 16 sub-buckets per power of two keeps every bucket within 6.25%
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+#define HIST_TYPES 256
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+typedef struct ReplayWorker ReplayWorker;
+
+typedef struct {
+    ReplayWorker* worker;
+    uint64_t start_ns;
+    uint8_t type;
+} ReplayRequest;
+
+struct ReplayWorker {
+    pthread_t thread;
+    const char* endpoint;
+    const uint8_t** records;     // Records of the connections assigned to this worker, in file order
+    uint32_t record_count;
+    ReplayRequest* requests;
+    Histogram* by_type[HIST_TYPES];
+    Histogram schedule_slip;
+    uint64_t completed;
+    uint64_t errors;
+    uint64_t skipped;
+};
+
+static double speed = 1.0;
+static int max_speed = 0;
+static uint32_t max_depth = REPLAY_DEFAULT_MAX_DEPTH;
+static uint64_t first_timestamp = 0;
+static uint64_t replay_start = 0;
+static pthread_barrier_t start_barrier;
+
+static uint64_t now_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) {
+        return (uint32_t)value;
+    }
+    uint32_t shift = (uint32_t)(63 - __builtin_clzll(value)) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (uint32_t)((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+static uint64_t hist_lower_bound(uint32_t index) {
+    if (index < HIST_SUB_COUNT) {
+        return index;
+    }
+    uint32_t shift = index / HIST_SUB_COUNT - 1;
+    return (uint64_t)(HIST_SUB_COUNT + index % HIST_SUB_COUNT) << shift;
+}
+
+static void hist_record(Histogram* hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+static void hist_merge(Histogram* into, const Histogram* from) {
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+// Upper edge of the bucket holding the percentile, capped by the largest value seen
+static uint64_t hist_percentile(const Histogram* hist, double percentile) {
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist->total);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen > rank) {
+            uint64_t upper = hist_lower_bound(i + 1) - 1;
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+static const char* type_name(uint32_t type) {
+    switch (type) {
+    case PACKET_TYPE_HEARTBEAT: return "HEARTBEAT";
+    case PACKET_TYPE_DATA: return "DATA";
+    case PACKET_TYPE_KV_GET: return "KV_GET";
+    case PACKET_TYPE_KV_SET: return "KV_SET";
+    case PACKET_TYPE_KV_DEL: return "KV_DEL";
+    case PACKET_TYPE_SUBSCRIBE: return "SUBSCRIBE";
+    case PACKET_TYPE_UNSUBSCRIBE: return "UNSUBSCRIBE";
+    case PACKET_TYPE_PUBLISH: return "PUBLISH";
+    default: return NULL;
+    }
+}
+
+static void print_percentiles(const char* label, const Histogram* hist) {
+    printf("[REPLAY] %-12s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", label, (unsigned long long)hist->total,
+        hist_percentile(hist, 50.0) / 1e3, hist_percentile(hist, 90.0) / 1e3, hist_percentile(hist, 99.0) / 1e3,
+        hist_percentile(hist, 99.9) / 1e3, hist->max / 1e3);
+}
+
+// One row per power of two, so the shape of the distribution is visible at a glance
+static void print_histogram(const Histogram* hist) {
+    uint64_t rows[64] = { 0 };
+    uint64_t widest = 0;
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        if (hist->counts[i] == 0) continue;
+        uint64_t lower = hist_lower_bound(i);
+        uint32_t row = lower > 0 ? (uint32_t)(63 - __builtin_clzll(lower)) : 0;
+        rows[row] += hist->counts[i];
+        if (rows[row] > widest) widest = rows[row];
+    }
+
+    for (uint32_t row = 0; row < 64; row++) {
+        if (rows[row] == 0) continue;
+        char bar[41];
+        uint32_t width = (uint32_t)(rows[row] * 40 / widest);
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        printf("[REPLAY] %10.1f - %10.1f us %10llu |%s\n", (double)(1ull << row) / 1e3,
+            (double)(1ull << (row + 1)) / 1e3, (unsigned long long)rows[row], bar);
+    }
+}
+
+static void replay_done(void* user_data, int status, const PacketHeader* header, const uint8_t* payload) {
+    (void)header;
+    (void)payload;
+    ReplayRequest* request = (ReplayRequest*)user_data;
+    ReplayWorker* worker = request->worker;
+
+    if (status != 0) {
+        worker->errors++;
+        return;
+    }
+
+    Histogram* hist = worker->by_type[request->type];
+    if (hist == NULL) {
+        hist = worker->by_type[request->type] = (Histogram*)calloc(1, sizeof(Histogram));
+        if (hist == NULL) return;
+    }
+    hist_record(hist, now_nanos() - request->start_ns);
+    worker->completed++;
+}
+
+// Keeps completions flowing while waiting for the next scheduled send
+static void wait_until(NetClient* client, uint64_t due) {
+    while (1) {
+        uint64_t now = now_nanos();
+        if (now >= due) return;
+
+        uint64_t remaining = due - now;
+        if (remaining >= 1000000ull) {
+            net_client_poll(client, (int)(remaining / 1000000ull));
+            continue;
+        }
+
+        net_client_poll(client, 0);
+        struct timespec pause = { 0, remaining < REPLAY_IDLE_SLEEP_NANOS ? (long)remaining : REPLAY_IDLE_SLEEP_NANOS };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Returns 0 once at least one request completes, -1 if none does within REPLAY_STALL_TIMEOUT_MS
+static int await_completion(NetClient* client) {
+    uint64_t deadline = now_nanos() + REPLAY_STALL_TIMEOUT_MS * 1000000ull;
+    while (1) {
+        uint64_t now = now_nanos();
+        if (now >= deadline) return -1;
+
+        int completions = net_client_poll(client, (int)((deadline - now + 999999ull) / 1000000ull));
+        if (completions != 0) return completions > 0 ? 0 : -1;
+    }
+}
+
+// An overloaded server may drop requests outright. They would hold their sequence slots forever,
+// so the stalled connection is replaced; destroying it fails the lost requests as errors
+static NetClient* replace_client(NetClient* client, const ReplayWorker* worker) {
+    net_client_destroy(client);
+    return net_client_create(worker->endpoint, 1);
+}
+
+static void* replay_worker(void* arg) {
+    ReplayWorker* worker = (ReplayWorker*)arg;
+    NetClient* client = net_client_create(worker->endpoint, 1);
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&start_barrier);
+    if (client == NULL) {
+        worker->errors += worker->record_count;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < worker->record_count && client != NULL; i++) {
+        CaptureRecord record;
+        memcpy(&record, worker->records[i], sizeof(record));
+        const uint8_t* frame = worker->records[i] + sizeof(record);
+
+        PacketHeader header;
+        deserialize_header(frame, &header);
+        const uint8_t* payload = frame + sizeof(PacketHeader);
+        uint8_t inflated[MAX_PAYLOAD_SIZE];
+
+        // Checksummed and compressed frames go out plain; integrity and wire size are not what is being replayed
+        if (header.version == PROTOCOL_VERSION_2) {
+            if ((header.type & PACKET_FLAG_CRC32C) && header.payload_length >= PACKET_CRC32C_SIZE) {
+                header.payload_length -= PACKET_CRC32C_SIZE;
+            }
+            if (header.type & PACKET_FLAG_COMPRESSED) {
+                int32_t inflated_len = lz_decompress_payload(payload, header.payload_length, inflated, sizeof(inflated));
+                if (inflated_len < 0) {
+                    worker->skipped++;
+                    continue;
+                }
+                payload = inflated;
+                header.payload_length = (uint32_t)inflated_len;
+            }
+            header.type &= PACKET_TYPE_MASK;
+        }
+
+        // Connection negotiation and unanswered header-only frames cannot be replayed
+        if (header.type == PACKET_TYPE_SHM_ATTACH || header.type == PACKET_TYPE_FEATURES ||
+            (header.payload_length == 0 && header.type != PACKET_TYPE_HEARTBEAT)) {
+            worker->skipped++;
+            continue;
+        }
+
+        ReplayRequest* request = &worker->requests[i];
+        request->worker = worker;
+        request->type = (uint8_t)header.type;
+
+        if (max_speed) {
+            while (client != NULL && net_client_in_flight(client) >= max_depth && await_completion(client) != 0) {
+                client = replace_client(client, worker);
+            }
+            if (client == NULL) break;
+            request->start_ns = now_nanos();
+        }
+        else {
+            uint64_t due = replay_start + (uint64_t)((double)(record.timestamp_ns - first_timestamp) / speed);
+            wait_until(client, due);
+            request->start_ns = due;
+            hist_record(&worker->schedule_slip, now_nanos() - due);
+        }
+
+        while (net_client_submit(client, header.type, payload, header.payload_length, replay_done, request) != 0) {
+            if (net_client_in_flight(client) == 0) {
+                worker->errors++;
+                break;
+            }
+            if (await_completion(client) != 0 && (client = replace_client(client, worker)) == NULL) {
+                break;
+            }
+        }
+        if (client == NULL) {
+            worker->errors += worker->record_count - i;
+            break;
+        }
+        net_client_flush(client);
+    }
+
+    if (client != NULL) {
+        while (net_client_in_flight(client) > 0 && await_completion(client) == 0) {
+        }
+        net_client_destroy(client);
+    }
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t connection_rank(const uint64_t* unique, uint32_t count, uint64_t connection) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (unique[mid] < connection) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-w workers] [-s speed | -m [-d depth]] <host:port|unix:path> <capture_file>\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t worker_limit = REPLAY_MAX_WORKERS;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:s:md:")) != -1) {
+        switch (opt) {
+        case 'w':
+            worker_limit = atoi(optarg) > 0 ? (uint32_t)atoi(optarg) : 1;
+            if (worker_limit > REPLAY_MAX_WORKERS) worker_limit = REPLAY_MAX_WORKERS;
+            break;
+        case 's':
+            speed = atof(optarg) > 0.0 ? atof(optarg) : 1.0;
+            break;
+        case 'm':
+            max_speed = 1;
+            break;
+        case 'd':
+            max_depth = atoi(optarg) > 0 ? (uint32_t)atoi(optarg) : REPLAY_DEFAULT_MAX_DEPTH;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* endpoint = argv[optind];
+    const char* path = argv[optind + 1];
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CaptureFileHeader)) {
+        fprintf(stderr, "[REPLAY] Cannot read capture file %s.\n", path);
+        return 1;
+    }
+    const uint8_t* file = (const uint8_t*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "[REPLAY] Cannot map capture file %s.\n", path);
+        return 1;
+    }
+
+    CaptureFileHeader file_header;
+    memcpy(&file_header, file, sizeof(file_header));
+    if (file_header.magic != CAPTURE_MAGIC || file_header.version != CAPTURE_FORMAT_VERSION) {
+        fprintf(stderr, "[REPLAY] %s is not a version %d capture file.\n", path, CAPTURE_FORMAT_VERSION);
+        return 1;
+    }
+
+    // A file copied while the server was still writing is valid up to the last complete record
+    uint64_t data_bytes = file_header.data_bytes;
+    if (data_bytes > (uint64_t)st.st_size - sizeof(CaptureFileHeader)) {
+        data_bytes = (uint64_t)st.st_size - sizeof(CaptureFileHeader);
+    }
+    const uint8_t* data = file + sizeof(CaptureFileHeader);
+
+    uint64_t record_count = 0;
+    uint64_t offset = 0;
+    while (offset + sizeof(CaptureRecord) <= data_bytes) {
+        CaptureRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+        uint64_t size = capture_record_size(record.frame_length);
+        if (record.frame_length < sizeof(PacketHeader) || offset + size > data_bytes) break;
+        record_count++;
+        offset += size;
+    }
+    if (record_count == 0) {
+        fprintf(stderr, "[REPLAY] %s holds no frames.\n", path);
+        return 1;
+    }
+
+    const uint8_t** records = (const uint8_t**)malloc(sizeof(uint8_t*) * record_count);
+    uint64_t* unique = (uint64_t*)malloc(sizeof(uint64_t) * record_count);
+    if (records == NULL || unique == NULL) return 1;
+
+    offset = 0;
+    for (uint64_t i = 0; i < record_count; i++) {
+        CaptureRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+        records[i] = data + offset;
+        unique[i] = record.connection;
+        if (i == 0 || record.timestamp_ns < first_timestamp) first_timestamp = record.timestamp_ns;
+        offset += capture_record_size(record.frame_length);
+    }
+    CaptureRecord last;
+    memcpy(&last, records[record_count - 1], sizeof(last));
+
+    qsort(unique, record_count, sizeof(uint64_t), compare_u64);
+    uint32_t connections = 0;
+    for (uint64_t i = 0; i < record_count; i++) {
+        if (connections == 0 || unique[connections - 1] != unique[i]) unique[connections++] = unique[i];
+    }
+    uint32_t worker_count = connections < worker_limit ? connections : worker_limit;
+
+    ReplayWorker* workers = (ReplayWorker*)calloc(worker_count, sizeof(ReplayWorker));
+    if (workers == NULL) return 1;
+
+    // Each original connection lands on exactly one worker, which preserves its frame order
+    uint32_t* assignment = (uint32_t*)malloc(sizeof(uint32_t) * record_count);
+    if (assignment == NULL) return 1;
+    for (uint64_t i = 0; i < record_count; i++) {
+        CaptureRecord record;
+        memcpy(&record, records[i], sizeof(record));
+        assignment[i] = connection_rank(unique, connections, record.connection) % worker_count;
+        workers[assignment[i]].record_count++;
+    }
+    for (uint32_t w = 0; w < worker_count; w++) {
+        workers[w].endpoint = endpoint;
+        workers[w].records = (const uint8_t**)malloc(sizeof(uint8_t*) * (workers[w].record_count + 1));
+        workers[w].requests = (ReplayRequest*)calloc(workers[w].record_count + 1, sizeof(ReplayRequest));
+        if (workers[w].records == NULL || workers[w].requests == NULL) return 1;
+        workers[w].record_count = 0;
+    }
+    for (uint64_t i = 0; i < record_count; i++) {
+        ReplayWorker* worker = &workers[assignment[i]];
+        worker->records[worker->record_count++] = records[i];
+    }
+
+    double original_seconds = (double)(last.timestamp_ns - first_timestamp) / 1e9;
+    printf("[REPLAY] %llu frames from %u connections over %.3f s (%llu dropped at capture)\n",
+        (unsigned long long)record_count, connections, original_seconds,
+        (unsigned long long)file_header.dropped_records);
+    if (max_speed) {
+        printf("[REPLAY] Replaying to %s at max speed on %u connections (depth %u)\n", endpoint, worker_count, max_depth);
+    }
+    else {
+        printf("[REPLAY] Replaying to %s at %.2fx original timing on %u connections\n", endpoint, speed, worker_count);
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, worker_count + 1);
+    for (uint32_t w = 0; w < worker_count; w++) {
+        pthread_create(&workers[w].thread, NULL, replay_worker, &workers[w]);
+    }
+    // Workers connect first so connection setup is not charged to the first frames
+    pthread_barrier_wait(&start_barrier);
+    replay_start = now_nanos();
+    pthread_barrier_wait(&start_barrier);
+
+    Histogram* by_type[HIST_TYPES] = { NULL };
+    Histogram all;
+    Histogram slip;
+    memset(&all, 0, sizeof(all));
+    memset(&slip, 0, sizeof(slip));
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    uint64_t skipped = 0;
+
+    for (uint32_t w = 0; w < worker_count; w++) {
+        pthread_join(workers[w].thread, NULL);
+        completed += workers[w].completed;
+        errors += workers[w].errors;
+        skipped += workers[w].skipped;
+        hist_merge(&slip, &workers[w].schedule_slip);
+        for (uint32_t t = 0; t < HIST_TYPES; t++) {
+            if (workers[w].by_type[t] == NULL) continue;
+            if (by_type[t] == NULL && (by_type[t] = (Histogram*)calloc(1, sizeof(Histogram))) == NULL) return 1;
+            hist_merge(by_type[t], workers[w].by_type[t]);
+            hist_merge(&all, workers[w].by_type[t]);
+            free(workers[w].by_type[t]);
+        }
+        free(workers[w].records);
+        free(workers[w].requests);
+    }
+    double elapsed = (double)(now_nanos() - replay_start) / 1e9;
+
+    printf("[REPLAY] Completed %llu requests in %.3f s (%.2f requests/second), %llu errors, %llu skipped\n",
+        (unsigned long long)completed, elapsed, elapsed > 0.0 ? completed / elapsed : 0.0,
+        (unsigned long long)errors, (unsigned long long)skipped);
+    if (!max_speed && slip.total > 0) {
+        printf("[REPLAY] Send slip behind schedule: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            hist_percentile(&slip, 50.0) / 1e3, hist_percentile(&slip, 99.0) / 1e3, slip.max / 1e3);
+    }
+
+    printf("[REPLAY] %-12s %10s %9s %9s %9s %9s %9s  (us)\n", "type", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (uint32_t t = 0; t < HIST_TYPES; t++) {
+        if (by_type[t] == NULL) continue;
+        char label[16];
+        const char* name = type_name(t);
+        if (name == NULL) {
+            snprintf(label, sizeof(label), "0x%02x", t);
+            name = label;
+        }
+        print_percentiles(name, by_type[t]);
+        free(by_type[t]);
+    }
+    if (all.total > 0) {
+        print_percentiles("all", &all);
+        print_histogram(&all);
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+    free(assignment);
+    free(unique);
+    free(records);
+    free(workers);
+    munmap((void*)file, (size_t)st.st_size);
+    return errors > 0 ? 1 : 0;
+}